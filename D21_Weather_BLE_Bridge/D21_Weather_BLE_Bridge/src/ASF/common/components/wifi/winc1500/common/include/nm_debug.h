@@ -70,7 +70,21 @@
 #define M2M_DBG(...)
 #define M2M_PRINT(...)
 
-#if (CONF_WINC_DEBUG == 1)
+#if (CONF_WINC_DEBUG == 1) && defined(CONF_WINC_USE_TRACE) && (CONF_WINC_USE_TRACE == 1)
+/* Route driver logging through the application trace layer: levels are
+   filtered by CONF_TRACE_LEVEL and formatting is deferred to the host. */
+#include "trace.h"
+#undef M2M_PRINT
+#define M2M_PRINT(...)							TRACE_INFO(__VA_ARGS__)
+#undef M2M_ERR
+#define M2M_ERR(...)							TRACE_ERR(__VA_ARGS__)
+#undef M2M_INFO
+#define M2M_INFO(...)							TRACE_INFO(__VA_ARGS__)
+#undef M2M_REQ
+#define M2M_REQ(...)							TRACE_DBG(__VA_ARGS__)
+#undef M2M_DBG
+#define M2M_DBG(...)							TRACE_DBG(__VA_ARGS__)
+#elif (CONF_WINC_DEBUG == 1)
 #undef M2M_PRINT
 #define M2M_PRINT(...)							do{CONF_WINC_PRINTF(__VA_ARGS__);CONF_WINC_PRINTF("\r");}while(0)
 #if (M2M_LOG_LEVEL >= M2M_LOG_ERROR)
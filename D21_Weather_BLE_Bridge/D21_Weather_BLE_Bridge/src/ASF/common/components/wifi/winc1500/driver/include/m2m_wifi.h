@@ -654,6 +654,34 @@ Following are the possible Wi-Fi events that are expected to be received through
 	The function returns @ref M2M_SUCCESS for successful operations and a negative value otherwise.
 */
 NMI_API sint8  m2m_wifi_init(tstrWifiInitParam * pWifiInitParam);
+
+/*!
+@fn	\
+	NMI_API sint8  m2m_wifi_init_start(tstrWifiInitParam * pWifiInitParam);
+
+@brief First half of @ref m2m_wifi_init.
+	Registers the callbacks, initializes the bus and releases the WINC firmware, then returns
+	without waiting for it to boot. The host is free to do other work until @ref m2m_wifi_init_finish.
+
+@param [in]	pWifiInitParam
+	Same as for @ref m2m_wifi_init.
+
+@return
+	The function returns @ref M2M_SUCCESS for successful operations and a negative value otherwise.
+*/
+NMI_API sint8  m2m_wifi_init_start(tstrWifiInitParam * pWifiInitParam);
+
+/*!
+@fn	\
+	NMI_API sint8  m2m_wifi_init_finish(void);
+
+@brief Second half of @ref m2m_wifi_init.
+	Waits for the firmware started by @ref m2m_wifi_init_start and initializes the host interface.
+
+@return
+	The function returns @ref M2M_SUCCESS for successful operations and a negative value otherwise.
+*/
+NMI_API sint8  m2m_wifi_init_finish(void);
  /**@}*/
  /** @defgroup WifiDeinitFn m2m_wifi_deinit
  *  @ingroup WLANAPI
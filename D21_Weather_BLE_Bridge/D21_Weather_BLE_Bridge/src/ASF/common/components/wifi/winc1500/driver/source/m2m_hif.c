@@ -610,6 +610,11 @@ sint8 hif_handle_isr(void)
 
 	return ret;
 }
+
+uint8 hif_irq_pending(void)
+{
+	return gstrHifCxt.u8Interrupt;
+}
 /*
 *	@fn		hif_receive
 *	@brief	Host interface interrupt serviece routine
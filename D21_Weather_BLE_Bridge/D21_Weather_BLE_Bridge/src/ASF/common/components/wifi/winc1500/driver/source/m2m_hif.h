@@ -250,6 +250,15 @@ NMI_API void hif_yield(void);
 */
 NMI_API sint8 hif_handle_isr(void);
 
+/**
+*	@fn		hif_irq_pending(void)
+*	@brief
+			Check for interrupts from the NMC1500 firmware not yet handled by hif_handle_isr().
+*   @return
+			Number of pending interrupts.
+*/
+NMI_API uint8 hif_irq_pending(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -448,9 +448,21 @@ sint8 m2m_wifi_send_crl(tstrTlsCrlInfo* pCRL)
 	return s8Ret;
 }
 
+/* Mode handed from m2m_wifi_init_start to m2m_wifi_init_finish */
+static uint8 gu8WifiInitMode = M2M_WIFI_MODE_NORMAL;
+
 sint8 m2m_wifi_init(tstrWifiInitParam * param)
 {
-	tstrM2mRev strtmp;
+	sint8 ret = m2m_wifi_init_start(param);
+
+	if(ret == M2M_SUCCESS) {
+		ret = m2m_wifi_init_finish();
+	}
+	return ret;
+}
+
+sint8 m2m_wifi_init_start(tstrWifiInitParam * param)
+{
 	sint8 ret = M2M_SUCCESS;
 	uint8 u8WifiMode = M2M_WIFI_MODE_NORMAL;
 	
@@ -473,8 +485,19 @@ sint8 m2m_wifi_init(tstrWifiInitParam * param)
 	gpfAppMonCb  = param->pfAppMonCb;
 #endif
 	gu8scanInProgress = 0;
+	gu8WifiInitMode = u8WifiMode;
 	/* Apply device specific initialization. */
-	ret = nm_drv_init(&u8WifiMode);
+	ret = nm_drv_init_start(&gu8WifiInitMode);
+_EXIT0:
+	return ret;
+}
+
+sint8 m2m_wifi_init_finish(void)
+{
+	tstrM2mRev strtmp;
+	sint8 ret = M2M_SUCCESS;
+
+	ret = nm_drv_init_finish(&gu8WifiInitMode);
 	if(ret != M2M_SUCCESS) 	goto _EXIT0;
 	/* Initialize host interface module */
 	ret = hif_init(NULL);
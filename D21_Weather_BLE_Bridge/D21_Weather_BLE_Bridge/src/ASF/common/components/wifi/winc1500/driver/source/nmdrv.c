@@ -276,11 +276,10 @@ ERR1:
 *	@date	15 July 2012
 *	@version	1.0
 */
-sint8 nm_drv_init(void * arg)
+static uint8 nm_drv_get_mode(void * arg)
 {
-	sint8 ret = M2M_SUCCESS;
 	uint8 u8Mode;
-	
+
 	if(NULL != arg) {
 		u8Mode = *((uint8 *)arg);
 		if((u8Mode < M2M_WIFI_MODE_NORMAL)||(u8Mode >= M2M_WIFI_MODE_MAX)) {
@@ -289,6 +288,26 @@ sint8 nm_drv_init(void * arg)
 	} else {
 		u8Mode = M2M_WIFI_MODE_NORMAL;
 	}
+	return u8Mode;
+}
+
+sint8 nm_drv_init(void * arg)
+{
+	sint8 ret = M2M_SUCCESS;
+
+	ret = nm_drv_init_start(arg);
+	if (M2M_SUCCESS != ret) {
+		goto ERR1;
+	}
+	ret = nm_drv_init_finish(arg);
+ERR1:
+	return ret;
+}
+
+sint8 nm_drv_init_start(void * arg)
+{
+	sint8 ret = M2M_SUCCESS;
+	uint8 u8Mode = nm_drv_get_mode(arg);
 	
 	ret = nm_bus_iface_init(NULL);
 	if (M2M_SUCCESS != ret) {
@@ -324,6 +343,18 @@ sint8 nm_drv_init(void * arg)
 	if (M2M_SUCCESS != ret) {
 		goto ERR2;
 	}
+	/* The firmware now boots on its own */
+	return ret;
+ERR2:
+	nm_bus_iface_deinit();
+ERR1:
+	return ret;
+}
+
+sint8 nm_drv_init_finish(void * arg)
+{
+	sint8 ret = M2M_SUCCESS;
+	uint8 u8Mode = nm_drv_get_mode(arg);
 		
 	ret = wait_for_firmware_start(u8Mode);
 	if (M2M_SUCCESS != ret) {
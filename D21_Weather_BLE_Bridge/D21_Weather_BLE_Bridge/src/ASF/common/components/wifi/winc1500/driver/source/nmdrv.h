@@ -119,6 +119,25 @@ sint8 nm_drv_init_download_mode(void);
 */
 sint8 nm_drv_init(void * arg);
 
+/*
+*	@fn		nm_drv_init_start
+*	@brief	First half of nm_drv_init: bus setup and boot ROM, then returns
+*			while the firmware starts up
+*   @param [in]	arg
+*				Pointer to the Wi-Fi mode, same as nm_drv_init
+*	@return	M2M_SUCCESS in case of success and Negative error code in case of failure
+*/
+sint8 nm_drv_init_start(void * arg);
+
+/*
+*	@fn		nm_drv_init_finish
+*	@brief	Second half of nm_drv_init: waits for the firmware and enables interrupts
+*   @param [in]	arg
+*				Pointer to the Wi-Fi mode, same as given to nm_drv_init_start
+*	@return	M2M_SUCCESS in case of success and Negative error code in case of failure
+*/
+sint8 nm_drv_init_finish(void * arg);
+
 /**
 *	@fn		nm_drv_deinit
 *	@brief	Deinitialize NMC1000 driver
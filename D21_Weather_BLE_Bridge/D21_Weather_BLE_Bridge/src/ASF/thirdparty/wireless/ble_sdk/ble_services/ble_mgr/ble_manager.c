@@ -52,6 +52,7 @@
 #include "ble_manager.h"
 #include "ble_utils.h"
 #include "platform.h"
+#include "conf_serialdrv.h"
 
 #if BLE_DEVICE_ROLE == BLE_ROLE_ALL
 #ifndef ATT_DB_MEMORY
@@ -274,7 +275,7 @@ void ble_device_init(at_ble_addr_t *addr)
 
 	DBG_LOG("BTLC1000 XPro Module: BTLC1000-ZR");
 	#if ((UART_FLOWCONTROL_6WIRE_MODE == false) && (UART_FLOWCONTROL_4WIRE_MODE == true))
-		DBG_LOG("BTLC1000 Host Interface UART Mode:4-Wire, Baudrate:%d", (unsigned int)HOST_UART_BAUDRATE_CONFIG_VALUE);
+		DBG_LOG("BTLC1000 Host Interface UART Mode:4-Wire, Baudrate:%d", (unsigned int)platform_host_baudrate());
 	#else
 		DBG_LOG("Error: Invalid BTLC1000 Host Interface UART Mode, BTLC1000-ZR supports only 4-WIRE UART mode");
 		return;
@@ -285,10 +286,10 @@ void ble_device_init(at_ble_addr_t *addr)
 	DBG_LOG("BTLC1000 XPro Module: BTLC1000-MR");
 	#if ((UART_FLOWCONTROL_6WIRE_MODE == false) && (UART_FLOWCONTROL_4WIRE_MODE == true))
 		DBG_LOG("BTLC1000 Host Interface UART Mode:4-Wire(works only when eFuse enabled), Baudrate:%d", \
-															(unsigned int)HOST_UART_BAUDRATE_CONFIG_VALUE);
+															(unsigned int)platform_host_baudrate());
 	#elif ((UART_FLOWCONTROL_6WIRE_MODE == true) && (UART_FLOWCONTROL_4WIRE_MODE == false))
 		DBG_LOG("BTLC1000 Host Interface UART Mode:6-Wire(without Efuse Enabled), Baudrate:%d", \
-															(unsigned int)HOST_UART_BAUDRATE_CONFIG_VALUE);
+															(unsigned int)platform_host_baudrate());
 	#else
 		DBG_LOG("Error: Invalid BTLC1000 Host Interface UART Mode, BTLC1000-MR supports only 4-Wire or 6-Wire UART mode");
 		return;
@@ -312,7 +313,8 @@ void ble_device_init(at_ble_addr_t *addr)
 #endif
    
     /// UART baudrate value one of @ref at_ble_uart_baudrate_tag values
-	pf_cfg.bus_info.bus_baudrate = HOST_UART_BAUDRATE_CONFIG_VALUE;
+	/* HOST_UART_BAUDRATE_CONFIG_VALUE unless an earlier attempt fell back to a lower rate */
+	pf_cfg.bus_info.bus_baudrate = platform_host_baudrate();
 
 	pf_cfg.platform_api_list.at_ble_reconfigure_usart = pf_cfg.bus_info.btlc1000_uart_pinout_switch ? platform_configure_hw_fc_uart : platform_configure_primary_uart;
 	
@@ -368,28 +370,36 @@ at_ble_status_t ble_set_device_name(uint8_t *name, uint8_t name_len)
 /* Initialize the BLE */
 static void ble_init(at_ble_init_config_t * args)
 {
+	uint32_t chip_id = 0xFFFFFFFF;
+
 	/* Initialize the platform */
 	DBG_LOG("Initializing BTLC1000");
 
-	/* Init BLE device */
-	if(at_ble_init(args) != AT_BLE_SUCCESS)
+	/* Init BLE device, retrying the fast rate once and then the fallback rate */
+	while(at_ble_init(args) != AT_BLE_SUCCESS)
 	{
+		if(platform_host_baudrate_fallback())
+		{
+			DBG_LOG("BTLC1000 Initialization failed at %d baud, retrying at %d", \
+					(unsigned int)args->bus_info.bus_baudrate, (unsigned int)platform_host_baudrate());
+			args->bus_info.bus_baudrate = platform_host_baudrate();
+			/* The patch download always starts at the boot rate */
+			platform_configure_primary_uart(CONF_UART_BAUDRATE);
+			continue;
+		}
 		DBG_LOG("BTLC1000 Initialization failed");
 		DBG_LOG("Please check the configuration and connection / hardware connector");	
 		while(1);
 	}
+	
+	if (at_ble_chip_id_get(&chip_id) == AT_BLE_SUCCESS)
+	{
+		DBG_LOG("BTLC1000 Chip ID: 0x%6X", (unsigned int)chip_id);
+	}
 	else
 	{
-		uint32_t chip_id = 0xFFFFFFFF;
-		if (at_ble_chip_id_get(&chip_id) == AT_BLE_SUCCESS)
-		{
-			DBG_LOG("BTLC1000 Chip ID: 0x%6X", (unsigned int)chip_id);
-		}
-		else
-		{
-			DBG_LOG("BTLC1000 Chip identification failed");
-			while(1);
-		}
+		DBG_LOG("BTLC1000 Chip identification failed");
+		while(1);
 	}
 }
 
@@ -765,6 +775,11 @@ at_ble_status_t ble_scan_info_handler(void *params)
 {
 	at_ble_scan_info_t *scan_param;
 	scan_param = (at_ble_scan_info_t *)params;
+	/* Scans not started by gap_dev_scan() belong to another subscriber */
+	if (ble_device_current_state != CENTRAL_SCANNING_STATE)
+	{
+		return AT_BLE_SUCCESS;
+	}
 	#if BLE_DEVICE_ROLE == BLE_ROLE_OBSERVER
 		// store the advertising report data into scan_info[]
 		memcpy((uint8_t *)scan_info, scan_param, sizeof(at_ble_scan_info_t));
@@ -811,6 +826,10 @@ at_ble_status_t ble_scan_info_handler(void *params)
 at_ble_status_t ble_scan_report_handler(void *params)
 {
 	at_ble_scan_report_t *scan_report;
+	if (ble_device_current_state != CENTRAL_SCANNING_STATE)
+	{
+		return AT_BLE_SUCCESS;
+	}
 	ble_device_current_state = BLE_DEVICE_IDLE_STATE;
 	scan_report = (at_ble_scan_report_t *)params;
 	if (scan_report->status == AT_BLE_SUCCESS)
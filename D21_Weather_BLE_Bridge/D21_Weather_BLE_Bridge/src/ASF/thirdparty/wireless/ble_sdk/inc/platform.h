@@ -61,6 +61,16 @@ typedef struct os_signal
   uint32_t          signal_usage;
 } os_signal_t;
 
+/* Host link rate state, kept by the application across resets */
+typedef enum
+{
+	PLATFORM_BAUD_FAST = 0,
+	/* The fast rate failed once and gets one more initialization */
+	PLATFORM_BAUD_RETRY,
+	/* The fast rate failed again, CONF_BLE_UART_FALLBACK_BAUDRATE is used */
+	PLATFORM_BAUD_FALLBACK,
+} platform_baud_state_t;
+
  /**@ingroup platform_group_functions
   * @brief implements platform-specific initialization
   *
@@ -103,6 +113,46 @@ void platform_dma_process_rxdata(uint8_t *buf, uint16_t len);
 void platform_enter_sleep(void);
 void platform_host_set_sleep(bool sleep);
 
+ /**@ingroup platform_group_functions
+  * @brief Host link baud rate to request from the BTLC1000 after patch download
+  */
+uint32_t platform_host_baudrate(void);
+
+ /**@ingroup platform_group_functions
+  * @brief Records a failure of the fast host link before a new initialization
+  *
+  * The first failure only asks for a retry at the same rate; the next one
+  * lowers the rate to CONF_BLE_UART_FALLBACK_BAUDRATE.
+  *
+  * @return false if the link already runs at the fallback rate
+  */
+bool platform_host_baudrate_fallback(void);
+
+ /**@ingroup platform_group_functions
+  * @brief Current host link rate state, to be saved by the application
+  */
+platform_baud_state_t platform_host_baud_state(void);
+
+ /**@ingroup platform_group_functions
+  * @brief Restores a saved host link rate state. Call before platform_init().
+  */
+void platform_host_baud_state_restore(platform_baud_state_t state);
+
+ /**@ingroup platform_group_functions
+  * @brief Reports a framing, parity or overrun error on the host link
+  *
+  * Safe to call from interrupt context; it only counts the error.
+  */
+void platform_host_link_error(void);
+
+ /**@ingroup platform_group_functions
+  * @brief Tells whether the fast host link hit the error limit
+  *
+  * Returns true once per burst. The caller then records the failure with
+  * platform_host_baudrate_fallback() and initializes the BTLC1000 again.
+  */
+bool platform_host_link_failed(void);
+
  /* functions that should be called to help cooperative multitasking scheduler 
     to switch context to other tasks */
 void *platform_create_signal(void);
@@ -47,6 +47,7 @@
 #include "serial_fifo.h"
 #include "ble_utils.h"
 #include "conf_serialdrv.h"
+#include "platform.h"
 
 /* === TYPES =============================================================== */
 
@@ -55,6 +56,13 @@
 /* === PROTOTYPES ========================================================== */
 static void serial_drv_read_cb(struct usart_module *const usart_module);
 static void serial_drv_write_cb(struct usart_module *const usart_module);
+static void serial_drv_error_cb(struct usart_module *const usart_module);
+static void serial_drv_start_rx(void);
+#if (CONF_BLE_UART_RX_DMA == true)
+static void serial_rx_dma_start(void);
+static void serial_rx_dma_drain(bool block_done);
+static void serial_drv_rx_start_cb(struct usart_module *const usart_module);
+#endif
 
 
 /* === GLOBALS ========================================================== */
@@ -63,6 +71,26 @@ struct usart_module usart_instance;
 static uint16_t rx_data;
 volatile bool wakeup_pin_status = true;
 
+#if (CONF_BLE_UART_RX_DMA == true)
+#define SERIAL_RX_DMA_HALF			(CONF_BLE_UART_RX_DMA_BUF_SIZE / 2)
+/* Bytes handed to the stack per recv callback run in serial_drv_rx_poll() */
+#define SERIAL_RX_POLL_CHUNK		32
+
+/* Circular receive buffer filled by the DMAC */
+static uint8_t serial_rx_dma_buf[CONF_BLE_UART_RX_DMA_BUF_SIZE];
+/* Next byte of serial_rx_dma_buf to move into serial_rx_fifo */
+static volatile uint16_t serial_rx_dma_tail;
+/* Filled by the DMA interrupt only, emptied by serial_drv_rx_poll() only */
+static uint8_t serial_rx_fifo_buf[CONF_BLE_UART_RX_FIFO_SIZE];
+static ser_fifo_desc_t serial_rx_fifo;
+
+/* Descriptor and write-back sections; BASEADDR/WRBADDR need 128-bit alignment */
+COMPILER_ALIGNED(16) static DmacDescriptor serial_rx_dma_desc[CONF_BLE_UART_RX_DMA_CHANNEL + 1];
+COMPILER_ALIGNED(16) static DmacDescriptor serial_rx_dma_wb[CONF_BLE_UART_RX_DMA_CHANNEL + 1];
+/* Second half of the ring, linked back to the channel's base descriptor */
+COMPILER_ALIGNED(16) static DmacDescriptor serial_rx_dma_desc_hi;
+#endif
+
 /* === IMPLEMENTATION ====================================================== */
 static inline void usart_configure_flowcontrol(uint32_t baudrate)
 {
@@ -82,6 +110,10 @@ static inline void usart_configure_flowcontrol(uint32_t baudrate)
 	config_usart.pinmux_pad1 = CONF_FLCR_BLE_PINMUX_PAD1;
 	config_usart.pinmux_pad2 = CONF_FLCR_BLE_PINMUX_PAD2;
 	config_usart.pinmux_pad3 = CONF_FLCR_BLE_PINMUX_PAD3;
+#if (CONF_BLE_UART_RX_DMA == true)
+	/* RXS is used to wake up from sleep on the first byte of a burst */
+	config_usart.start_frame_detection_enable = true;
+#endif
 
 	while (usart_init(&usart_instance, CONF_FLCR_BLE_USART_MODULE, &config_usart) != STATUS_OK);
 
@@ -94,7 +126,10 @@ static inline void usart_configure_flowcontrol(uint32_t baudrate)
 	serial_drv_write_cb, USART_CALLBACK_BUFFER_TRANSMITTED);
 	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_RECEIVED);
 	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_TRANSMITTED);
-	serial_read_byte(&rx_data);
+	usart_register_callback(&usart_instance,
+	serial_drv_error_cb, USART_CALLBACK_ERROR);
+	usart_enable_callback(&usart_instance, USART_CALLBACK_ERROR);
+	serial_drv_start_rx();
 }
 
 uint8_t configure_serial_drv(uint32_t bus_baudrate)
@@ -104,21 +139,23 @@ uint8_t configure_serial_drv(uint32_t bus_baudrate)
 	#else
 	struct usart_config config_usart;
 
-#ifdef BTLC_REINIT_SUPPORT
+	/* Also called again by the stack to switch to the negotiated rate */
 	if(usart_instance.hw)
 	{
 		usart_reset(&usart_instance);
 	}
-#endif
 
 	usart_get_config_defaults(&config_usart);
-	config_usart.baudrate = CONF_UART_BAUDRATE;
+	config_usart.baudrate = bus_baudrate;
 	config_usart.generator_source = CONF_BLE_UART_CLOCK;
 	config_usart.mux_setting = CONF_BLE_MUX_SETTING;
 	config_usart.pinmux_pad0 = CONF_BLE_PINMUX_PAD0;
 	config_usart.pinmux_pad1 = CONF_BLE_PINMUX_PAD1;
 	config_usart.pinmux_pad2 = CONF_BLE_PINMUX_PAD2;
 	config_usart.pinmux_pad3 = CONF_BLE_PINMUX_PAD3;
+#if (CONF_BLE_UART_RX_DMA == true)
+	config_usart.start_frame_detection_enable = true;
+#endif
 
 	while (usart_init(&usart_instance, CONF_BLE_USART_MODULE, &config_usart) != STATUS_OK);
 
@@ -131,7 +168,10 @@ uint8_t configure_serial_drv(uint32_t bus_baudrate)
 		serial_drv_write_cb, USART_CALLBACK_BUFFER_TRANSMITTED);
 	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_RECEIVED);
 	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_TRANSMITTED);
-	serial_read_byte(&rx_data);
+	usart_register_callback(&usart_instance,
+	serial_drv_error_cb, USART_CALLBACK_ERROR);
+	usart_enable_callback(&usart_instance, USART_CALLBACK_ERROR);
+	serial_drv_start_rx();
 	#endif
 	
 	return STATUS_OK;
@@ -159,6 +199,15 @@ static void serial_drv_read_cb(struct usart_module *const module)
 	platform_process_rxdata((uint8_t)rx_data);
 }
 
+/* A read job ended on a line error; the byte is lost, keep receiving */
+static void serial_drv_error_cb(struct usart_module *const module)
+{
+	platform_host_link_error();
+#if (CONF_BLE_UART_RX_DMA != true)
+	serial_read_byte(&rx_data);
+#endif
+}
+
 uint8_t serial_read_data(uint8_t* data, uint16_t max_len)
 {
  return usart_read_buffer_job(&usart_instance, data, max_len);
@@ -178,7 +227,175 @@ void platform_set_ble_rts_low(void)
 
 void platform_start_rx(void)
 {
+#if (CONF_BLE_UART_RX_DMA == true)
+	/* The DMA channel runs continuously once the USART is configured */
+#else
+	serial_read_byte(&rx_data);
+#endif
+}
+
+static void serial_drv_start_rx(void)
+{
+#if (CONF_BLE_UART_RX_DMA == true)
+	serial_rx_dma_start();
+#else
 	serial_read_byte(&rx_data);
+#endif
+}
+
+#if (CONF_BLE_UART_RX_DMA == true)
+static void serial_rx_dma_start(void)
+{
+	uint8_t sercom_index = _sercom_get_sercom_inst_index((Sercom *)usart_instance.hw);
+	DmacDescriptor *desc_lo = &serial_rx_dma_desc[CONF_BLE_UART_RX_DMA_CHANNEL];
+	uint16_t btctrl = DMAC_BTCTRL_VALID | DMAC_BTCTRL_EVOSEL_DISABLE |
+			DMAC_BTCTRL_BLOCKACT_INT | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_DSTINC;
+
+	system_ahb_clock_set_mask(PM_AHBMASK_DMAC);
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBB, PM_APBBMASK_DMAC);
+
+	if (!(DMAC->CTRL.reg & DMAC_CTRL_DMAENABLE)) {
+		DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+		while (DMAC->CTRL.reg & DMAC_CTRL_SWRST);
+		DMAC->BASEADDR.reg = (uint32_t)serial_rx_dma_desc;
+		DMAC->WRBADDR.reg = (uint32_t)serial_rx_dma_wb;
+		DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+	}
+
+	/* Two half-buffer blocks in a ring; DSTADDR is the end of each block */
+	desc_lo->BTCTRL.reg = btctrl;
+	desc_lo->BTCNT.reg = SERIAL_RX_DMA_HALF;
+	desc_lo->SRCADDR.reg = (uint32_t)&usart_instance.hw->USART.DATA.reg;
+	desc_lo->DSTADDR.reg = (uint32_t)&serial_rx_dma_buf[SERIAL_RX_DMA_HALF];
+	desc_lo->DESCADDR.reg = (uint32_t)&serial_rx_dma_desc_hi;
+
+	serial_rx_dma_desc_hi.BTCTRL.reg = btctrl;
+	serial_rx_dma_desc_hi.BTCNT.reg = SERIAL_RX_DMA_HALF;
+	serial_rx_dma_desc_hi.SRCADDR.reg = desc_lo->SRCADDR.reg;
+	serial_rx_dma_desc_hi.DSTADDR.reg = (uint32_t)&serial_rx_dma_buf[CONF_BLE_UART_RX_DMA_BUF_SIZE];
+	serial_rx_dma_desc_hi.DESCADDR.reg = (uint32_t)desc_lo;
+
+	serial_rx_dma_tail = 0;
+	ser_fifo_init(&serial_rx_fifo, serial_rx_fifo_buf, CONF_BLE_UART_RX_FIFO_SIZE);
+
+	DMAC->CHID.reg = CONF_BLE_UART_RX_DMA_CHANNEL;
+	DMAC->CHCTRLA.reg = 0;
+	DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+	while (DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+	DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) |
+			DMAC_CHCTRLB_TRIGSRC(SERCOM0_DMAC_ID_RX + 2 * sercom_index) |
+			DMAC_CHCTRLB_TRIGACT_BEAT;
+	DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL;
+	DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+
+	system_interrupt_enable(SYSTEM_INTERRUPT_MODULE_DMA);
+
+	usart_register_callback(&usart_instance,
+		serial_drv_rx_start_cb, USART_CALLBACK_START_RECEIVED);
+	usart_enable_callback(&usart_instance, USART_CALLBACK_START_RECEIVED);
+}
+
+/* Offset in serial_rx_dma_buf the DMAC will write next */
+static uint16_t serial_rx_dma_head(void)
+{
+	volatile DmacDescriptor *wb = &serial_rx_dma_wb[CONF_BLE_UART_RX_DMA_CHANNEL];
+	uint32_t dstaddr;
+	uint32_t active;
+	uint16_t remaining;
+	uint16_t head;
+
+	/* The count and the block it belongs to are read apart; a descriptor switch
+	   in between would put the head half a ring off, so read until they agree */
+	do {
+		dstaddr = wb->DSTADDR.reg;
+		active = DMAC->ACTIVE.reg;
+		if ((active & DMAC_ACTIVE_ABUSY) &&
+			(((active & DMAC_ACTIVE_ID_Msk) >> DMAC_ACTIVE_ID_Pos) == CONF_BLE_UART_RX_DMA_CHANNEL)) {
+			remaining = (active & DMAC_ACTIVE_BTCNT_Msk) >> DMAC_ACTIVE_BTCNT_Pos;
+		} else {
+			remaining = wb->BTCNT.reg;
+		}
+	} while (dstaddr != wb->DSTADDR.reg);
+
+	head = (uint16_t)((uint8_t *)dstaddr - serial_rx_dma_buf) - remaining;
+	return (head >= CONF_BLE_UART_RX_DMA_BUF_SIZE) ? (head - CONF_BLE_UART_RX_DMA_BUF_SIZE) : head;
+}
+
+/* Move len bytes of the ring at tail into serial_rx_fifo; false if they did not fit */
+static bool serial_rx_dma_push(uint16_t tail, uint16_t len)
+{
+	return ser_fifo_push_block(&serial_rx_fifo, &serial_rx_dma_buf[tail], len) == SER_FIFO_OK;
+}
+
+/* Move everything between tail and head into serial_rx_fifo, at most two segments;
+   block_done tells that the DMAC finished a block since the last call */
+static void serial_rx_dma_drain(bool block_done)
+{
+	uint16_t head = serial_rx_dma_head();
+	uint16_t tail = serial_rx_dma_tail;
+	bool ok = true;
+	uint8_t status = usart_instance.hw->USART.STATUS.reg &
+			(SERCOM_USART_STATUS_FERR | SERCOM_USART_STATUS_BUFOVF | SERCOM_USART_STATUS_PERR);
+
+	/* No read job runs in DMA mode, so line errors are only visible here */
+	if (status) {
+		usart_instance.hw->USART.STATUS.reg = status;
+		platform_host_link_error();
+	}
+
+	/* After a block end the DMAC writes the other half than tail's, unless it went
+	   round once more and overwrote the bytes from tail on */
+	if (block_done && ((head ^ tail) < SERIAL_RX_DMA_HALF) && (head >= tail)) {
+		ok = false;
+	} else {
+		if (head < tail) {
+			ok = serial_rx_dma_push(tail, CONF_BLE_UART_RX_DMA_BUF_SIZE - tail);
+			tail = 0;
+		}
+		if (ok && (head > tail)) {
+			ok = serial_rx_dma_push(tail, head - tail);
+		}
+	}
+	/* The DMAC never waits, so bytes that could not be taken are lost; the
+	   ring is not left holding them, to be overwritten mid-frame later */
+	if (!ok) {
+		platform_host_link_error();
+	}
+	serial_rx_dma_tail = head;
+}
+
+/* Start of a frame seen on RxD while armed for sleep: waking up is all that's needed */
+static void serial_drv_rx_start_cb(struct usart_module *const module)
+{
+}
+
+void DMAC_Handler(void)
+{
+	bool block_done;
+
+	DMAC->CHID.reg = CONF_BLE_UART_RX_DMA_CHANNEL;
+	/* Not set when serial_drv_rx_poll() pended the interrupt */
+	block_done = (DMAC->CHINTFLAG.reg & DMAC_CHINTFLAG_TCMPL) != 0;
+	DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL;
+
+	serial_rx_dma_drain(block_done);
+}
+#endif
+
+void serial_drv_rx_poll(void)
+{
+#if (CONF_BLE_UART_RX_DMA == true)
+	uint8_t chunk[SERIAL_RX_POLL_CHUNK];
+	uint16_t len;
+
+	/* Let the interrupt collect what the DMAC stored short of a block end */
+	system_interrupt_set_pending(SYSTEM_INTERRUPT_MODULE_DMA);
+
+	/* The FIFO is lock-free, so the stack parses with interrupts enabled */
+	while ((len = ser_fifo_pull_block(&serial_rx_fifo, chunk, sizeof(chunk))) != 0) {
+		platform_dma_process_rxdata(chunk, len);
+	}
+#endif
 }
 
 uint8_t serial_read_byte(uint16_t* data)
@@ -218,9 +435,27 @@ void platform_restore_from_sleep(void)
 	
 }
 
+bool serial_drv_sleep_prepare(void)
+{
+#if (CONF_BLE_UART_RX_DMA == true)
+	/* The DMAC only interrupts on full half-buffers, so arm the receive
+	   start interrupt to wake on the first byte of the next burst. */
+	usart_instance.hw->USART.INTFLAG.reg = SERCOM_USART_INTFLAG_RXS;
+	usart_instance.hw->USART.INTENSET.reg = SERCOM_USART_INTFLAG_RXS;
+	if (serial_drive_rx_data_count()) {
+		usart_instance.hw->USART.INTENCLR.reg = SERCOM_USART_INTFLAG_RXS;
+		return false;
+	}
+#endif
+	return true;
+}
+
 /* Set the Host in sleep */
 void platform_set_hostsleep(void)
 {		
+	if (!serial_drv_sleep_prepare()) {
+		return;
+	}
 	system_set_sleepmode(HOST_SYSTEM_SLEEP_MODE);
 
 	system_sleep();
@@ -228,10 +463,16 @@ void platform_set_hostsleep(void)
 
 uint16_t serial_drive_rx_data_count(void)
 {
+#if (CONF_BLE_UART_RX_DMA == true)
+	/* Bytes the DMAC has stored that the stack has not seen yet */
+	return ((serial_rx_dma_head() - serial_rx_dma_tail) & (CONF_BLE_UART_RX_DMA_BUF_SIZE - 1)) +
+			ser_fifo_get_used_size(&serial_rx_fifo);
+#else
 	/*
 	This strategy is used in SAMG55/4S since pdc is used.
 	Since SAMD21/L21 returing zero
 	*/
 	return 0;
+#endif
 }
 /* EOF */
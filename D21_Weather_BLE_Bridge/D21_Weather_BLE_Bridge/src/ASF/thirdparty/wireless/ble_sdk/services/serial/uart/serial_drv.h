@@ -112,4 +112,19 @@ void platform_set_hostsleep(void);
 void platform_restore_from_sleep(void);
 void platform_configure_sleep_manager(void);
 uint16_t serial_drive_rx_data_count(void);
+
+/**
+ * \brief Arms the receiver to wake the host on the next byte
+ *
+ * \return false if received data is still waiting, so the host must not sleep
+ */
+bool serial_drv_sleep_prepare(void);
+
+/**
+ * \brief Hands any received but unprocessed data to the stack
+ *
+ * Only does work when reception is DMA based (CONF_BLE_UART_RX_DMA). The
+ * data is parsed with interrupts enabled.
+ */
+void serial_drv_rx_poll(void);
 #endif /* SIO2HOST_H */
@@ -44,6 +44,7 @@
  * Support and FAQ: visit <a href="http://www.atmel.com/design-support/">Atmel Support</a>
  */
 
+#include <string.h>
 #include "serial_fifo.h"
 
 int ser_fifo_init(ser_fifo_desc_t *fifo_desc, void *buffer, uint16_t size)
@@ -73,3 +74,53 @@ int ser_fifo_init(ser_fifo_desc_t *fifo_desc, void *buffer, uint16_t size)
 
 	return SER_FIFO_OK;
 }
+
+int ser_fifo_push_block(ser_fifo_desc_t *fifo_desc, const uint8_t *data, uint16_t len)
+{
+	uint16_t write_index;
+	uint16_t offset;
+	uint16_t first;
+
+	if (len > ser_fifo_get_free_size(fifo_desc)) {
+		return SER_FIFO_ERROR_OVERFLOW;
+	}
+
+	write_index = fifo_desc->write_index;
+	offset = write_index & (fifo_desc->mask >> 1);
+
+	// Up to the end of the buffer, then the remainder from the start.
+	first = Min(len, fifo_desc->size - offset);
+	memcpy(&fifo_desc->buffer.u8ptr[offset], data, first);
+	memcpy(fifo_desc->buffer.u8ptr, &data[first], len - first);
+
+	// Must be the last thing to do.
+	barrier();
+	fifo_desc->write_index = (write_index + len) & fifo_desc->mask;
+
+	return SER_FIFO_OK;
+}
+
+uint16_t ser_fifo_pull_block(ser_fifo_desc_t *fifo_desc, uint8_t *data, uint16_t len)
+{
+	uint16_t read_index;
+	uint16_t offset;
+	uint16_t first;
+
+	len = Min(len, ser_fifo_get_used_size(fifo_desc));
+	if (!len) {
+		return 0;
+	}
+
+	read_index = fifo_desc->read_index;
+	offset = read_index & (fifo_desc->mask >> 1);
+
+	first = Min(len, fifo_desc->size - offset);
+	memcpy(data, &fifo_desc->buffer.u8ptr[offset], first);
+	memcpy(&data[first], fifo_desc->buffer.u8ptr, len - first);
+
+	// Must be the last thing to do.
+	barrier();
+	fifo_desc->read_index = (read_index + len) & fifo_desc->mask;
+
+	return len;
+}
@@ -58,7 +58,7 @@
  * be 100% full thanks to a double-index range implementation. For example,
  * a FIFO of 4 elements can be implemented: the FIFO can really hold up to 4
  * elements. This is particularly well suited for any kind of application
- * needing a lot of small FIFO. The maximum fifo size is 128 items (uint8,
+ * needing a lot of small FIFO. The maximum fifo size is 32768 items (uint8,
  * uint16 or uint32). Note that the driver, thanks to its conception, does
  * not use interrupt protection.
  *
@@ -97,7 +97,7 @@ typedef struct ser_fifo_desc ser_fifo_desc_t;
  *  \param ser_fifo_desc  Pointer on the FIFO descriptor.
  *  \param buffer     Pointer on the FIFO buffer.
  *  \param size       Size of the buffer (unit is in number of 'elements').
- *                    It must be a 2-power and <= to 128.
+ *                    It must be a 2-power and <= to 32768.
  *
  *  \return Status
  *    \retval FIFO_OK when no error occurred.
@@ -126,7 +126,7 @@ static inline uint16_t ser_fifo_get_used_size(ser_fifo_desc_t *ser_fifo_desc)
  *
  *  \return The number of free elements.
  */
-static inline uint8_t ser_fifo_get_free_size(ser_fifo_desc_t *ser_fifo_desc)
+static inline uint16_t ser_fifo_get_free_size(ser_fifo_desc_t *ser_fifo_desc)
 {
 	return ser_fifo_desc->size - ser_fifo_get_used_size(ser_fifo_desc);
 }
@@ -176,7 +176,7 @@ static inline bool ser_fifo_is_full(ser_fifo_desc_t *ser_fifo_desc)
  */
 static inline void ser_fifo_push_uint8_nocheck(ser_fifo_desc_t *ser_fifo_desc, uint32_t item)
 {
-	uint8_t write_index;
+	uint16_t write_index;
 
 	write_index = ser_fifo_desc->write_index;
 	ser_fifo_desc->buffer.u8ptr[write_index & (ser_fifo_desc->mask >> 1)] = item;
@@ -225,7 +225,7 @@ static inline int ser_fifo_push_uint8(ser_fifo_desc_t *ser_fifo_desc, uint32_t i
  */
 static inline void ser_fifo_push_uint16_nocheck(ser_fifo_desc_t *ser_fifo_desc, uint32_t item)
 {
-	uint8_t write_index;
+	uint16_t write_index;
 
 	write_index = ser_fifo_desc->write_index;
 	ser_fifo_desc->buffer.u16ptr[write_index & (ser_fifo_desc->mask >> 1)] = item;
@@ -249,7 +249,7 @@ static inline void ser_fifo_push_uint16_nocheck(ser_fifo_desc_t *ser_fifo_desc,
  */
 static inline int ser_fifo_push_uint16(ser_fifo_desc_t *ser_fifo_desc, uint32_t item)
 {
-	uint8_t write_index;
+	uint16_t write_index;
 
 	if (ser_fifo_is_full(ser_fifo_desc)) {
 		return SER_FIFO_ERROR_OVERFLOW;
@@ -274,7 +274,7 @@ static inline int ser_fifo_push_uint16(ser_fifo_desc_t *ser_fifo_desc, uint32_t
  */
 static inline void ser_fifo_push_uint32_nocheck(ser_fifo_desc_t *ser_fifo_desc, uint32_t item)
 {
-	uint8_t write_index;
+	uint16_t write_index;
 
 	write_index = ser_fifo_desc->write_index;
 	ser_fifo_desc->buffer.u32ptr[write_index & (ser_fifo_desc->mask >> 1)] = item;
@@ -298,7 +298,7 @@ static inline void ser_fifo_push_uint32_nocheck(ser_fifo_desc_t *ser_fifo_desc,
  */
 static inline int ser_fifo_push_uint32(ser_fifo_desc_t *ser_fifo_desc, uint32_t item)
 {
-	uint8_t write_index;
+	uint16_t write_index;
 
 	if (ser_fifo_is_full(ser_fifo_desc)) {
 		return SER_FIFO_ERROR_OVERFLOW;
@@ -513,6 +513,36 @@ static inline uint8_t ser_fifo_peek_uint8(ser_fifo_desc_t *ser_fifo_desc)
 	return ser_fifo_desc->buffer.u8ptr[ser_fifo_desc->read_index & (ser_fifo_desc->mask >> 1)];
 }
 
+/**
+ *  \brief Puts a block of 8-bits elements into the FIFO.
+ *
+ *  The block is copied with at most two memcpy, split where the buffer
+ *  wraps. Nothing is written unless the whole block fits.
+ *
+ *  \param ser_fifo_desc  The FIFO descriptor.
+ *  \param data       Elements to push.
+ *  \param len        Number of elements to push.
+ *
+ *  \return Status
+ *    \retval SER_FIFO_OK when no error occurred.
+ *    \retval SER_FIFO_ERROR_OVERFLOW when the FIFO has less than len free elements.
+ */
+int ser_fifo_push_block(ser_fifo_desc_t *ser_fifo_desc, const uint8_t *data, uint16_t len);
+
+/**
+ *  \brief Gets up to len 8-bits elements from the FIFO.
+ *
+ *  The block is copied with at most two memcpy, split where the buffer
+ *  wraps.
+ *
+ *  \param ser_fifo_desc  The FIFO descriptor.
+ *  \param data       Destination of the extracted elements.
+ *  \param len        Maximum number of elements to extract.
+ *
+ *  \return The number of extracted elements, 0 when the FIFO was empty.
+ */
+uint16_t ser_fifo_pull_block(ser_fifo_desc_t *ser_fifo_desc, uint8_t *data, uint16_t len);
+
 /**
  *  \brief Flushes a software FIFO.
  *
@@ -51,6 +51,7 @@
 #include "ble_utils.h"
 #include "conf_serialdrv.h"
 #include "timer_hw.h"
+#include "systime.h"
 
 static void (*recv_async_cb)(uint8_t) = NULL;
 static volatile bool platform_timer_used = false;
@@ -58,6 +59,20 @@ static volatile bool host_sleep_flag = false;
 
 static os_signal_t platform_os_signals[MAX_PLATFORM_OS_SIGNAL];
 
+#ifndef HOST_UART_BAUDRATE_CONFIG_VALUE
+#define HOST_UART_BAUDRATE_CONFIG_VALUE CONF_UART_BAUDRATE
+#endif
+
+/* Fast rate, retry or fallback; restored by the application at boot */
+static platform_baud_state_t platform_baud_state = PLATFORM_BAUD_FAST;
+/* Rate the host UART was last switched to by the stack */
+static volatile uint32_t platform_bus_baudrate = CONF_UART_BAUDRATE;
+/* Link errors seen since platform_link_window_ms */
+static volatile uint16_t platform_link_errors;
+static volatile uint32_t platform_link_window_ms;
+/* Set by the interrupt handlers, taken by platform_host_link_failed() */
+static volatile bool platform_link_failed;
+
 /* This variable helpfull for only SAMG55 and SAM4S platforms
 	where the BTLC1000 wakeup time is just high before data send*/
 extern volatile bool wakeup_pin_status;
@@ -172,23 +187,110 @@ void platform_process_rxdata(uint8_t t_rx_data)
 
 void platform_dma_process_rxdata(uint8_t *buf, uint16_t len)
 {
-	uint16_t idx = 0;
-	while(idx < len)
+	void (*rx_cb)(uint8_t) = recv_async_cb;
+	uint8_t *end = buf + len;
+	
+	Assert((rx_cb != NULL));
+	while(buf < end)
 	{
-		recv_async_cb(buf[idx++]);
+		rx_cb(*buf++);
 	}
 }
 
 void platform_configure_primary_uart(uint32_t baudrate)
 {
-	 configure_serial_drv(baudrate);
+	platform_bus_baudrate = baudrate;
+	platform_link_errors = 0;
+	platform_link_window_ms = systime_ms();
+	platform_link_failed = false;
+	configure_serial_drv(baudrate);
 }
 
 void platform_configure_hw_fc_uart(uint32_t baudrate)
 {
+	platform_bus_baudrate = baudrate;
+	platform_link_errors = 0;
+	platform_link_window_ms = systime_ms();
+	platform_link_failed = false;
 	configure_usart_after_patch(baudrate);
 }
 
+uint32_t platform_host_baudrate(void)
+{
+	if (platform_baud_state == PLATFORM_BAUD_FALLBACK)
+	{
+		return CONF_BLE_UART_FALLBACK_BAUDRATE;
+	}
+	return HOST_UART_BAUDRATE_CONFIG_VALUE;
+}
+
+bool platform_host_baudrate_fallback(void)
+{
+	if (platform_host_baudrate() <= CONF_BLE_UART_FALLBACK_BAUDRATE)
+	{
+		return false;
+	}
+	/* The fast rate gets one more initialization before the fallback is latched */
+	if (platform_baud_state == PLATFORM_BAUD_FAST)
+	{
+		platform_baud_state = PLATFORM_BAUD_RETRY;
+	}
+	else
+	{
+		platform_baud_state = PLATFORM_BAUD_FALLBACK;
+	}
+	return true;
+}
+
+platform_baud_state_t platform_host_baud_state(void)
+{
+	return platform_baud_state;
+}
+
+void platform_host_baud_state_restore(platform_baud_state_t state)
+{
+	if (state <= PLATFORM_BAUD_FALLBACK)
+	{
+		platform_baud_state = state;
+	}
+}
+
+void platform_host_link_error(void)
+{
+#if (CONF_BLE_UART_ERROR_LIMIT > 0)
+	uint32_t now;
+
+	/* Errors while still at the boot rate are left to the stack's own recovery */
+	if (platform_bus_baudrate <= CONF_BLE_UART_FALLBACK_BAUDRATE)
+	{
+		return;
+	}
+	/* Only a burst of errors within one window counts, not their total since boot */
+	now = systime_ms();
+	if ((now - platform_link_window_ms) >= CONF_BLE_UART_ERROR_WINDOW_MS)
+	{
+		platform_link_window_ms = now;
+		platform_link_errors = 0;
+	}
+	if (++platform_link_errors >= CONF_BLE_UART_ERROR_LIMIT)
+	{
+		/* Interrupt context: the main loop does the recovery */
+		platform_link_errors = 0;
+		platform_link_failed = true;
+	}
+#endif
+}
+
+bool platform_host_link_failed(void)
+{
+	if (!platform_link_failed)
+	{
+		return false;
+	}
+	platform_link_failed = false;
+	return true;
+}
+
 void platform_host_set_sleep(bool sleep)
 {
 	host_sleep_flag = sleep;
@@ -289,6 +391,8 @@ void platform_wait_for_signal(uint32_t count, void **signal_handler_list)
 	{
 		do
 		{
+			/* Pick up bytes still sitting in the DMA receive buffer */
+			serial_drv_rx_poll();
 			for (idx = 0; idx < count; idx++)
 			{
 				if ((NULL != os_signal_list[idx]) &&
@@ -0,0 +1,125 @@
+/**
+ * \file
+ *
+ * \brief Connectionless weather broadcast in the scan response.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "transparent_uart.h"
+#include "weather_cache.h"
+#include "req_queue.h"
+#include "systime.h"
+#include "wifi_power.h"
+#include "idle.h"
+#include "broadcast.h"
+#include "trace.h"
+
+#if (CONF_BRIDGE_BROADCAST == true)
+
+/* AD structure header, company id and version */
+#define BROADCAST_HEADER_SIZE			5
+#define BROADCAST_RECORD_SIZE			5
+/* Scan response data is at most 31 bytes */
+#define BROADCAST_MAX_RECORDS			((31 - BROADCAST_HEADER_SIZE) / BROADCAST_RECORD_SIZE)
+#define BROADCAST_AD_TYPE_MANUFACTURER	0xFF
+
+static const char *const broadcast_cities[] = CONF_BRIDGE_BROADCAST_CITIES;
+#define BROADCAST_CITY_COUNT			(sizeof(broadcast_cities) / sizeof(broadcast_cities[0]))
+
+_Static_assert(BROADCAST_CITY_COUNT <= BROADCAST_MAX_RECORDS, "too many broadcast cities for the scan response");
+
+static uint8_t broadcast_data[BROADCAST_HEADER_SIZE + BROADCAST_CITY_COUNT * BROADCAST_RECORD_SIZE];
+static uint8_t broadcast_len;
+/* systime_ms() of the last fetch queued per city */
+static uint32_t broadcast_try_ms[BROADCAST_CITY_COUNT];
+static bool broadcast_tried[BROADCAST_CITY_COUNT];
+
+static uint8_t broadcast_encode(uint8_t *buf)
+{
+	uint8_t len = BROADCAST_HEADER_SIZE;
+
+	buf[2] = (uint8_t)CONF_BRIDGE_BROADCAST_COMPANY_ID;
+	buf[3] = (uint8_t)(CONF_BRIDGE_BROADCAST_COMPANY_ID >> 8);
+	buf[4] = BROADCAST_VERSION;
+
+	for (uint8_t i = 0; i < BROADCAST_CITY_COUNT; i++) {
+		const weather_cache_entry_t *entry = weather_cache_find(broadcast_cities[i]);
+		int32_t temperature;
+		uint16_t condition;
+
+		if (!entry) {
+			continue;
+		}
+		temperature = entry->temperature;
+		if (temperature > INT16_MAX) {
+			temperature = INT16_MAX;
+		} else if (temperature < INT16_MIN) {
+			temperature = INT16_MIN;
+		}
+		condition = entry->condition;
+
+		buf[len++] = i;
+		buf[len++] = (uint8_t)temperature;
+		buf[len++] = (uint8_t)((uint16_t)temperature >> 8);
+		buf[len++] = (uint8_t)condition;
+		buf[len++] = (uint8_t)(condition >> 8);
+	}
+
+	buf[0] = len - 1;
+	buf[1] = BROADCAST_AD_TYPE_MANUFACTURER;
+	return len;
+}
+
+static void broadcast_refresh(void)
+{
+	uint32_t now = systime_ms();
+
+	for (uint8_t i = 0; i < BROADCAST_CITY_COUNT; i++) {
+		const weather_cache_entry_t *entry = weather_cache_find(broadcast_cities[i]);
+
+		if (entry) {
+			/* Wake up, with the WINC ready, when it goes stale */
+			uint32_t stale_ms = entry->updated_ms + CONF_BRIDGE_CACHE_MAX_AGE_S * 1000ul;
+
+			idle_wake_at(stale_ms);
+			wifi_power_schedule(stale_ms);
+			continue;
+		}
+		if (broadcast_tried[i] && ((now - broadcast_try_ms[i]) < CONF_BRIDGE_BROADCAST_RETRY_S * 1000ul)) {
+			idle_wake_at(broadcast_try_ms[i] + CONF_BRIDGE_BROADCAST_RETRY_S * 1000ul);
+			continue;
+		}
+		if (req_queue_push(BROADCAST_CONN_HANDLE(i), broadcast_cities[i])) {
+			broadcast_tried[i] = true;
+			broadcast_try_ms[i] = now;
+		}
+	}
+}
+
+void broadcast_task(void)
+{
+	uint8_t buf[sizeof(broadcast_data)];
+	uint8_t len;
+
+	broadcast_refresh();
+
+	len = broadcast_encode(buf);
+	if ((len == broadcast_len) && !memcmp(buf, broadcast_data, len)) {
+		return;
+	}
+	if (ble_app_set_scan_resp(buf, len) == AT_BLE_SUCCESS) {
+		memcpy(broadcast_data, buf, len);
+		broadcast_len = len;
+		TRACE_DBG("broadcast updated, %d bytes", len);
+	}
+}
+
+#else
+
+void broadcast_task(void)
+{
+}
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * \file
+ *
+ * \brief Connectionless weather broadcast in the scan response.
+ *
+ * The weather of the cities in CONF_BRIDGE_BROADCAST_CITIES is kept fresh
+ * in the cache and carried in manufacturer specific data of the scan
+ * response, so any number of scanners get it without connecting.
+ *
+ * Scan response layout (little endian):
+ * \code
+ *   len | 0xFF | company id(2) | version | record...
+ *   record: city index | temperature(2) | condition(2)
+ * \endcode
+ * \c city index is the position in CONF_BRIDGE_BROADCAST_CITIES, the
+ * temperature is signed and scaled by 10^TEMPERATURE_DECIMALS in degrees
+ * Celsius, the condition is the server's numeric weather code. Cities
+ * without fresh weather are left out.
+ *
+ */
+
+#ifndef BROADCAST_H_INCLUDED
+#define BROADCAST_H_INCLUDED
+
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Payload format, bumped on incompatible changes */
+#define BROADCAST_VERSION				2
+
+/** Connection handle of fetches made for the broadcast; no client gets the reply */
+#define BROADCAST_CONN_HANDLE(index)	((uint16_t)(0xFF00 | (index)))
+
+/** @brief Refresh due cities and update the scan response. Call from the main loop. */
+void broadcast_task(void);
+
+#endif /* BROADCAST_H_INCLUDED */
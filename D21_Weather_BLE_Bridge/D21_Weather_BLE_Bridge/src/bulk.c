@@ -0,0 +1,411 @@
+/**
+ * \file
+ *
+ * \brief Bulk transfers over an LE credit based L2CAP channel.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "at_ble_api.h"
+#include "ble_manager.h"
+#include "strfmt.h"
+#include "systime.h"
+#include "wifi_link.h"
+#include "idle.h"
+#include "weather_cache.h"
+#include "tunnel.h"
+#include "quota.h"
+#include "bulk.h"
+#include "trace.h"
+
+/* SDU type and end SDU */
+#define BULK_DATA_HEADER				1
+#define BULK_END_SIZE					15
+
+_Static_assert(CONF_BRIDGE_BULK_SDU_MAX <= AT_BLE_LECB_MAX_PKT_SIZE, "SDU larger than the stack takes");
+_Static_assert(CONF_BRIDGE_BULK_SDU_MAX >= BULK_END_SIZE, "end SDU does not fit");
+
+typedef enum
+{
+	/* No channel offered */
+	BULK_OFF,
+	/* Channel offered on bulk_conn, no peer */
+	BULK_LISTENING,
+	BULK_CONNECTED,
+}bulk_state_t;
+
+static bulk_state_t bulk_state = BULK_OFF;
+static uint16_t bulk_conn;
+/* Peer channel, largest SDU it takes and its credits */
+static uint16_t bulk_dest_cid;
+static uint16_t bulk_peer_sdu;
+static uint16_t bulk_dest_credit;
+
+/* Transfer in progress */
+static bool xfer_active;
+static uint8_t xfer_cmd;
+static uint8_t xfer_status;
+/* Text answer, or NULL for the pattern */
+static char xfer_text[CONF_BRIDGE_BULK_TEXT_SIZE];
+static const char *xfer_src;
+static uint32_t xfer_left;
+static uint32_t xfer_bytes;
+static uint32_t xfer_start_ms;
+static uint8_t xfer_inflight;
+/* The stack refused an SDU; bulk_task() retries */
+static bool xfer_retry;
+
+static bulk_stats_t bulk_stat;
+
+static at_ble_status_t bulk_connected_event(void *param);
+static at_ble_status_t bulk_disconnected_event(void *param);
+static at_ble_status_t bulk_lecb_conn_req(void *param);
+static at_ble_status_t bulk_lecb_connected(void *param);
+static at_ble_status_t bulk_lecb_disconnected(void *param);
+static at_ble_status_t bulk_lecb_add_credit_ind(void *param);
+static at_ble_status_t bulk_lecb_send_resp(void *param);
+static at_ble_status_t bulk_lecb_data_received(void *param);
+
+static const ble_gap_event_cb_t bulk_gap_event = {
+	.connected = bulk_connected_event,
+	.disconnected = bulk_disconnected_event,
+};
+
+static const ble_l2cap_event_cb_t bulk_l2cap_event = {
+	.lecb_conn_req = bulk_lecb_conn_req,
+	.lecb_connected = bulk_lecb_connected,
+	.lecb_disconnected = bulk_lecb_disconnected,
+	.lecb_add_credit_ind = bulk_lecb_add_credit_ind,
+	.lecb_send_resp = bulk_lecb_send_resp,
+	.lecb_data_recieved = bulk_lecb_data_received,
+};
+
+uint32_t bulk_rate(uint32_t bytes, uint32_t ms)
+{
+	if (!ms) {
+		return 0;
+	}
+	/* bytes * 1000 / ms without overflowing 32 bits */
+	return (bytes / ms) * 1000 + ((bytes % ms) * 1000) / ms;
+}
+
+static void bulk_wr32(uint8_t *p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+static void bulk_diag_text(strfmt_t *sf)
+{
+	const wifi_link_stats_t *link = wifi_link_stats();
+	const idle_stats_t *idle = idle_stats();
+	const tunnel_stats_t *gatt = tunnel_stats();
+	const quota_stats_t *quota = quota_stats();
+	weather_cache_entry_t entries[CONF_BRIDGE_CACHE_ENTRIES];
+
+	strfmt_str(sf, "uptime_ms ");
+	strfmt_uint(sf, systime_ms());
+	strfmt_str(sf, "\r\nwifi attempts ");
+	strfmt_uint(sf, link->attempts);
+	strfmt_str(sf, " full_scans ");
+	strfmt_uint(sf, link->full_scans);
+	strfmt_str(sf, " connects ");
+	strfmt_uint(sf, link->connects);
+	strfmt_str(sf, " max_outage_ms ");
+	strfmt_uint(sf, link->max_outage_ms);
+	strfmt_str(sf, "\r\nidle sleeps ");
+	strfmt_uint(sf, idle->sleeps);
+	strfmt_str(sf, " asleep_ms ");
+	strfmt_uint(sf, idle->asleep_ms);
+	strfmt_str(sf, " max_dispatch_ms ");
+	strfmt_uint(sf, idle->max_dispatch_ms);
+	strfmt_str(sf, "\r\ngatt_bytes_per_s ");
+	strfmt_uint(sf, bulk_rate(gatt->bytes, gatt->busy_ms));
+	strfmt_str(sf, " l2cap_bytes_per_s ");
+	strfmt_uint(sf, bulk_stat.bytes_per_s);
+	strfmt_str(sf, "\r\nquota hits ");
+	strfmt_uint(sf, quota->hits);
+	strfmt_str(sf, " fetches ");
+	strfmt_uint(sf, quota->decisions[QUOTA_FETCH]);
+	strfmt_str(sf, " stale ");
+	strfmt_uint(sf, quota->decisions[QUOTA_STALE]);
+	strfmt_str(sf, " revalidated ");
+	strfmt_uint(sf, quota->decisions[QUOTA_STALE_REVALIDATE]);
+	strfmt_str(sf, " deferred ");
+	strfmt_uint(sf, quota->decisions[QUOTA_DEFER]);
+	strfmt_str(sf, " skipped ");
+	strfmt_uint(sf, quota->decisions[QUOTA_SKIP]);
+	strfmt_str(sf, "\r\n");
+
+	weather_cache_snapshot(entries, CONF_BRIDGE_CACHE_ENTRIES);
+	for (uint8_t i = 0; (i < CONF_BRIDGE_CACHE_ENTRIES) && entries[i].city[0]; i++) {
+		strfmt_str(sf, "cache ");
+		strfmt_str(sf, entries[i].city);
+		strfmt_str(sf, " ");
+		strfmt_fixed(sf, entries[i].temperature, TEMPERATURE_DECIMALS);
+		strfmt_str(sf, " ");
+		strfmt_str(sf, entries[i].weather);
+		strfmt_str(sf, "\r\n");
+	}
+}
+
+static void bulk_start(const uint8_t *req, uint16_t len)
+{
+	uint32_t arg = 0;
+
+	if (len >= 5) {
+		arg = (uint32_t)req[1] | ((uint32_t)req[2] << 8) | ((uint32_t)req[3] << 16) | ((uint32_t)req[4] << 24);
+	}
+
+	xfer_cmd = req[0];
+	xfer_status = BULK_OK;
+	xfer_src = NULL;
+	xfer_left = 0;
+	xfer_bytes = 0;
+
+	if (xfer_cmd == BULK_CMD_DIAG) {
+		strfmt_t sf;
+
+		strfmt_init(&sf, xfer_text, sizeof(xfer_text));
+		bulk_diag_text(&sf);
+		xfer_src = xfer_text;
+		xfer_left = sf.len;
+	} else if (xfer_cmd == BULK_CMD_PATTERN) {
+		xfer_left = arg;
+	} else {
+		xfer_status = BULK_UNKNOWN_CMD;
+	}
+
+	xfer_active = true;
+	xfer_start_ms = systime_ms();
+}
+
+/* Next SDU of the transfer, 0 if there is none yet */
+static uint16_t bulk_next_sdu(uint8_t *sdu, uint16_t size)
+{
+	if (xfer_left) {
+		uint16_t n = size - BULK_DATA_HEADER;
+
+		if (n > xfer_left) {
+			n = (uint16_t)xfer_left;
+		}
+		sdu[0] = BULK_SDU_DATA;
+		for (uint16_t i = 0; i < n; i++) {
+			sdu[BULK_DATA_HEADER + i] = xfer_src ? (uint8_t)*xfer_src++ : (uint8_t)(xfer_bytes + i);
+		}
+		return n + BULK_DATA_HEADER;
+	}
+	/* Time the transfer once the stack took all data */
+	if (!xfer_inflight) {
+		uint32_t ms = systime_ms() - xfer_start_ms;
+
+		bulk_stat.bytes = xfer_bytes;
+		bulk_stat.ms = ms;
+		bulk_stat.bytes_per_s = bulk_rate(xfer_bytes, ms);
+
+		sdu[0] = BULK_SDU_END;
+		sdu[1] = xfer_cmd;
+		sdu[2] = xfer_status;
+		bulk_wr32(&sdu[3], bulk_stat.bytes);
+		bulk_wr32(&sdu[7], bulk_stat.ms);
+		bulk_wr32(&sdu[11], bulk_stat.bytes_per_s);
+		return BULK_END_SIZE;
+	}
+	return 0;
+}
+
+static void bulk_pump(void)
+{
+	uint8_t sdu[CONF_BRIDGE_BULK_SDU_MAX];
+	uint16_t size = sizeof(sdu);
+	uint16_t len;
+
+	if (bulk_peer_sdu < size) {
+		size = bulk_peer_sdu;
+	}
+
+	xfer_retry = false;
+	while ((bulk_state == BULK_CONNECTED) && xfer_active && bulk_dest_credit &&
+			(xfer_inflight < CONF_BRIDGE_BULK_TX_WINDOW)) {
+		const char *src = xfer_src;
+
+		len = bulk_next_sdu(sdu, size);
+		if (!len) {
+			break;
+		}
+		if (at_ble_lecb_send(bulk_conn, bulk_dest_cid, len, sdu) != AT_BLE_SUCCESS) {
+			/* Sent again from the same place */
+			xfer_src = src;
+			xfer_retry = true;
+			break;
+		}
+		if (sdu[0] == BULK_SDU_END) {
+			TRACE_INFO("bulk: %lu bytes in %lu ms, %lu B/s (gatt %lu B/s)", bulk_stat.bytes, bulk_stat.ms,
+					bulk_stat.bytes_per_s, bulk_rate(tunnel_stats()->bytes, tunnel_stats()->busy_ms));
+			xfer_active = false;
+		} else {
+			xfer_left -= len - BULK_DATA_HEADER;
+			xfer_bytes += len - BULK_DATA_HEADER;
+		}
+		xfer_inflight++;
+	}
+}
+
+static void bulk_offer(uint16_t conn_handle)
+{
+	at_ble_status_t status;
+
+	status = at_ble_lecb_create(conn_handle, AT_BLE_LECB_DISABLE, CONF_BRIDGE_BULK_PSM, CONF_BRIDGE_BULK_CID,
+			CONF_BRIDGE_BULK_RX_CREDITS);
+	if (status == AT_BLE_SUCCESS) {
+		bulk_conn = conn_handle;
+		bulk_state = BULK_LISTENING;
+	} else {
+		TRACE_WARN("bulk: channel not offered (%x)", status);
+		bulk_state = BULK_OFF;
+	}
+}
+
+static void bulk_end_channel(void)
+{
+	xfer_active = false;
+	xfer_inflight = 0;
+	xfer_retry = false;
+	bulk_dest_credit = 0;
+}
+
+static at_ble_status_t bulk_connected_event(void *param)
+{
+	at_ble_connected_t *conn_param = (at_ble_connected_t *)param;
+
+	if ((conn_param->conn_status == AT_BLE_SUCCESS) && (bulk_state == BULK_OFF)) {
+		bulk_offer(conn_param->handle);
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t bulk_disconnected_event(void *param)
+{
+	at_ble_disconnected_t *disconnected = (at_ble_disconnected_t *)param;
+
+	if ((bulk_state != BULK_OFF) && (disconnected->handle == bulk_conn)) {
+		/* Offered again on the next connection */
+		bulk_end_channel();
+		bulk_state = BULK_OFF;
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t bulk_lecb_conn_req(void *param)
+{
+	at_ble_lecb_conn_req_t *req = (at_ble_lecb_conn_req_t *)param;
+
+	if ((bulk_state != BULK_LISTENING) || (req->le_psm != CONF_BRIDGE_BULK_PSM)) {
+		return AT_BLE_SUCCESS;
+	}
+	bulk_dest_cid = req->dest_cid;
+	bulk_dest_credit = req->dest_credit;
+	bulk_peer_sdu = req->max_sdu;
+	return at_ble_lecb_cfm(bulk_conn, CONF_BRIDGE_BULK_PSM, AT_BLE_LECB_SUCCESS);
+}
+
+static at_ble_status_t bulk_lecb_connected(void *param)
+{
+	at_ble_lecb_connected_t *connected = (at_ble_lecb_connected_t *)param;
+
+	if ((bulk_state == BULK_LISTENING) && (connected->le_psm == CONF_BRIDGE_BULK_PSM) &&
+			(connected->status == AT_BLE_LECB_SUCCESS)) {
+		bulk_dest_cid = connected->dest_cid;
+		bulk_dest_credit = connected->dest_credit;
+		bulk_peer_sdu = connected->max_sdu;
+		bulk_state = BULK_CONNECTED;
+		TRACE_INFO("bulk: channel open, sdu %u credit %u", bulk_peer_sdu, bulk_dest_credit);
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t bulk_lecb_disconnected(void *param)
+{
+	at_ble_lecb_disconnected_t *disconnected = (at_ble_lecb_disconnected_t *)param;
+
+	if ((bulk_state == BULK_CONNECTED) && (disconnected->le_psm == CONF_BRIDGE_BULK_PSM)) {
+		bulk_end_channel();
+		/* Let the same client open it again */
+		bulk_offer(bulk_conn);
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t bulk_lecb_add_credit_ind(void *param)
+{
+	at_ble_lecb_add_credit_ind_t *credit = (at_ble_lecb_add_credit_ind_t *)param;
+
+	if ((bulk_state == BULK_CONNECTED) && (credit->le_psm == CONF_BRIDGE_BULK_PSM)) {
+		bulk_dest_credit = credit->dest_credit;
+		bulk_pump();
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t bulk_lecb_send_resp(void *param)
+{
+	at_ble_lecb_send_rsp_t *resp = (at_ble_lecb_send_rsp_t *)param;
+
+	if ((bulk_state == BULK_CONNECTED) && (resp->dest_cid == bulk_dest_cid)) {
+		bulk_dest_credit = resp->dest_credit;
+		if (xfer_inflight) {
+			xfer_inflight--;
+		}
+		bulk_pump();
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t bulk_lecb_data_received(void *param)
+{
+	at_ble_lecb_data_recv_t *data = (at_ble_lecb_data_recv_t *)param;
+
+	if (bulk_state != BULK_CONNECTED) {
+		return AT_BLE_SUCCESS;
+	}
+	/* Top up before the peer runs dry */
+	if (data->src_credit < CONF_BRIDGE_BULK_RX_CREDITS / 2) {
+		at_ble_lecb_add_credit(bulk_conn, CONF_BRIDGE_BULK_PSM, CONF_BRIDGE_BULK_RX_CREDITS - data->src_credit);
+	}
+	if (!data->len) {
+		return AT_BLE_SUCCESS;
+	}
+	if (xfer_active) {
+		TRACE_WARN("bulk: busy, request %u dropped", data->data[0]);
+		return AT_BLE_SUCCESS;
+	}
+	bulk_start(data->data, data->len);
+	bulk_pump();
+	return AT_BLE_SUCCESS;
+}
+
+void bulk_init(void)
+{
+	ble_mgr_events_callback_handler(REGISTER_CALL_BACK, BLE_GAP_EVENT_TYPE, &bulk_gap_event);
+	ble_mgr_events_callback_handler(REGISTER_CALL_BACK, BLE_L2CAP_EVENT_TYPE, &bulk_l2cap_event);
+}
+
+void bulk_task(void)
+{
+	if (xfer_retry) {
+		bulk_pump();
+	}
+}
+
+bool bulk_pending(void)
+{
+	return xfer_retry;
+}
+
+const bulk_stats_t *bulk_stats(void)
+{
+	return &bulk_stat;
+}
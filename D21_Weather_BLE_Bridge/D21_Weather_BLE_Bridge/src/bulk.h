@@ -0,0 +1,77 @@
+/**
+ * \file
+ *
+ * \brief Bulk transfers over an LE credit based L2CAP channel.
+ *
+ * Large answers go over a connection oriented channel on
+ * CONF_BRIDGE_BULK_PSM instead of GATT notifications, which saves the ATT
+ * overhead per packet and lets the stack segment SDUs of up to
+ * CONF_BRIDGE_BULK_SDU_MAX bytes. The channel is offered on the first
+ * BLE connection made while no connection holds it.
+ *
+ * The client sends one request SDU and gets the answer as data SDUs
+ * followed by an end SDU (little endian):
+ * \code
+ *   request: cmd | arg(4)
+ *   data:    0x01 | bytes...
+ *   end:     0x02 | cmd | status | bytes(4) | ms(4) | bytes per s(4)
+ * \endcode
+ * \c bytes counts the data SDU payload, \c ms runs from the first data SDU
+ * until the stack took the last one. Commands:
+ * - @ref BULK_CMD_DIAG: text dump of link, sleep and throughput statistics
+ *   and the weather cache.
+ * - @ref BULK_CMD_PATTERN: \c arg bytes of a counting pattern, to measure
+ *   throughput.
+ *
+ * Up to CONF_BRIDGE_BULK_TX_WINDOW SDUs are handed to the stack while the
+ * peer has credits, and receive credits are topped up as soon as half are
+ * used, so neither side waits on the other. Every transfer's rate is
+ * traced next to the rate of the GATT tunnel, see tunnel.h.
+ *
+ */
+
+#ifndef BULK_H_INCLUDED
+#define BULK_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Request commands */
+#define BULK_CMD_DIAG					0x01
+#define BULK_CMD_PATTERN				0x02
+
+/** SDU types */
+#define BULK_SDU_DATA					0x01
+#define BULK_SDU_END					0x02
+
+/** End status */
+#define BULK_OK							0
+#define BULK_UNKNOWN_CMD				1
+
+typedef struct
+{
+	/* Data bytes of the last transfer */
+	uint32_t bytes;
+	/* Duration of the last transfer, in ms */
+	uint32_t ms;
+	/* Rate of the last transfer, in bytes per second */
+	uint32_t bytes_per_s;
+}bulk_stats_t;
+
+/** @brief Register the BLE event handlers. Call after ble_device_init(). */
+void bulk_init(void);
+
+/** @brief Retry what the stack refused from the events. Call from the main loop. */
+void bulk_task(void);
+
+/** @brief bulk_task() has something to retry */
+bool bulk_pending(void);
+
+/** @brief Throughput of the last transfer */
+const bulk_stats_t *bulk_stats(void);
+
+/** @brief Bytes per second, 0 if no time elapsed */
+uint32_t bulk_rate(uint32_t bytes, uint32_t ms);
+
+#endif /* BULK_H_INCLUDED */
@@ -0,0 +1,248 @@
+/**
+ * \file
+ *
+ * \brief Weather bridge application configuration.
+ *
+ */
+
+#ifndef CONF_BRIDGE_H_INCLUDED
+#define CONF_BRIDGE_H_INCLUDED
+
+/** Longest city name accepted from a GATT client, including the NUL. */
+#define CONF_BRIDGE_CITY_SIZE			(20)
+
+/**
+ * Weather requests held while the uplink is not ready or busy, from BLE
+ * and HTTP clients and broadcast cities. Asking again replaces the
+ * pending entry of the connection.
+ */
+#define CONF_BRIDGE_REQ_QUEUE_DEPTH		(8)
+
+/** Cities whose weather is kept, broadcast cities included. */
+#define CONF_BRIDGE_CACHE_ENTRIES		(6)
+
+/** Age after which a cached answer is fetched again, in seconds. */
+#define CONF_BRIDGE_CACHE_MAX_AGE_S		(600)
+
+/** Age up to which cached weather is still answered when the quota is short, in seconds. */
+#define CONF_BRIDGE_CACHE_STALE_S		(3600)
+
+/** Units of clients that don't choose theirs, see weather_units.h. */
+#define CONF_BRIDGE_DEFAULT_UNITS		WEATHER_UNITS_IMPERIAL
+
+/** Newest cache entries saved in flash for a warm start. */
+#define CONF_BRIDGE_PERSIST_CACHE_ENTRIES	(2)
+
+/**
+ * Minimum time between flash saves caused by new weather only, in
+ * seconds. Changes of the Wi-Fi link, lease or server address are saved
+ * right away.
+ */
+#define CONF_BRIDGE_PERSIST_INTERVAL_S	(300)
+
+/**
+ * Quota of the API key in MAIN_POST_BUFFER, in requests per minute and
+ * per day, and the share of each that can be used in a burst.
+ */
+#define CONF_BRIDGE_QUOTA_PER_MIN		(60)
+#define CONF_BRIDGE_QUOTA_MIN_BURST		(10)
+#define CONF_BRIDGE_QUOTA_PER_DAY		(1000)
+#define CONF_BRIDGE_QUOTA_DAY_BURST		(50)
+
+/** Tokens kept for requests without stale weather; refreshes and revalidations leave them. */
+#define CONF_BRIDGE_QUOTA_RESERVE		(3)
+
+/** Tokens at or below which clients are answered with stale weather instead of waiting for a fetch. */
+#define CONF_BRIDGE_QUOTA_LOW_WATER		(6)
+
+/** Failed attempts on the last known channel before scanning all channels. */
+#define CONF_BRIDGE_WIFI_CHANNEL_RETRIES	(3)
+
+/** Wait after the first failed Wi-Fi attempt, doubled on each further failure, in ms. */
+#define CONF_BRIDGE_WIFI_BACKOFF_MIN_MS	(250)
+
+/** Longest wait between Wi-Fi attempts, in ms. */
+#define CONF_BRIDGE_WIFI_BACKOFF_MAX_MS	(8000)
+
+/** IPv4 address in the network byte order used by the WINC driver. */
+#define BRIDGE_IPV4(a, b, c, d)			((uint32_t)(a) | ((uint32_t)(b) << 8) | \
+										((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+/** Station addressing, see net_addr.h. */
+#define BRIDGE_IP_DHCP					0
+#define BRIDGE_IP_STATIC				1
+#define BRIDGE_IP_REUSE_LEASE			2
+
+#define CONF_BRIDGE_IP_MODE				BRIDGE_IP_DHCP
+
+/** Addresses used with BRIDGE_IP_STATIC. */
+#define CONF_BRIDGE_STATIC_IP			BRIDGE_IPV4(192, 168, 1, 200)
+#define CONF_BRIDGE_STATIC_GATEWAY		BRIDGE_IPV4(192, 168, 1, 1)
+#define CONF_BRIDGE_STATIC_NETMASK		BRIDGE_IPV4(255, 255, 255, 0)
+#define CONF_BRIDGE_STATIC_DNS			BRIDGE_IPV4(192, 168, 1, 1)
+
+/** Time without BLE activity before the WINC enters deep power save, in ms. */
+#define CONF_BRIDGE_PS_LINGER_MS		(5000)
+
+/** Beacon periods between WINC wake-ups in deep power save. */
+#define CONF_BRIDGE_PS_LISTEN_INTERVAL	(10)
+
+/** Lead time for leaving power save before a planned fetch, in ms. */
+#define CONF_BRIDGE_PS_PREWAKE_MS		(500)
+
+/**
+ * Sleep mode of the main loop when idle. SYSTEM_SLEEPMODE_STANDBY saves
+ * more, but the UART clock stops and the BTLC1000 is held off with RTS
+ * until it raises the host wake line.
+ */
+#define CONF_BRIDGE_IDLE_SLEEP_MODE		SYSTEM_SLEEPMODE_IDLE_2
+
+/** Broadcast weather in the scan response, see broadcast.h. */
+#define CONF_BRIDGE_BROADCAST			true
+
+/** Cities kept fresh and broadcast; at most 5 fit the scan response. */
+#define CONF_BRIDGE_BROADCAST_CITIES	{"paris", "london"}
+
+/** Bluetooth SIG company identifier in the manufacturer data (0xFFFF: testing). */
+#define CONF_BRIDGE_BROADCAST_COMPANY_ID	0xFFFF
+
+/** Wait before fetching a broadcast city again after a failed fetch, in seconds. */
+#define CONF_BRIDGE_BROADCAST_RETRY_S	(60)
+
+/** Let clients subscribe to a city, see subscribe.h. */
+#define CONF_BRIDGE_SUB					true
+
+/**
+ * Age after which a subscribed city is fetched again, in seconds; at most
+ * CONF_BRIDGE_CACHE_MAX_AGE_S. The refresh bypasses the cache, so it is
+ * not answered by the weather it replaces.
+ */
+#define CONF_BRIDGE_SUB_REFRESH_S		(300)
+
+/** Wait before fetching a subscribed city again after a failed fetch, in seconds. */
+#define CONF_BRIDGE_SUB_RETRY_S			(60)
+
+/** Temperature change that is notified to subscribers, in degrees Celsius scaled by 10^TEMPERATURE_DECIMALS. */
+#define CONF_BRIDGE_SUB_TEMP_DELTA		(50)
+
+/** Bytes from the BLE client buffered for the tunnel socket, see tunnel.h. */
+#define CONF_BRIDGE_TUNNEL_TX_BUF_SIZE	(1024)
+
+/** Bytes from the tunnel socket buffered for the BLE client; at least one recv(). */
+#define CONF_BRIDGE_TUNNEL_RX_BUF_SIZE	(1536)
+
+/** Tunnel notifications in flight. */
+#define CONF_BRIDGE_TUNNEL_NOTIFY_WINDOW	(4)
+
+/** Longest tunnel frame; 244 fills one link layer packet with data length extension. */
+#define CONF_BRIDGE_TUNNEL_VALUE_MAX	(244)
+
+/** Credit returned to the client once this many bytes were sent on. */
+#define CONF_BRIDGE_TUNNEL_CREDIT_BATCH	(256)
+
+/** L2CAP PSM of the bulk channel, from the dynamic range. */
+#define CONF_BRIDGE_BULK_PSM			(0x0080)
+
+/** Local channel ID of the bulk channel, from the dynamic range. */
+#define CONF_BRIDGE_BULK_CID			(0x0040)
+
+/** Longest bulk SDU sent; at most AT_BLE_LECB_MAX_PKT_SIZE. */
+#define CONF_BRIDGE_BULK_SDU_MAX		(496)
+
+/** Bulk SDUs handed to the stack and not yet confirmed. */
+#define CONF_BRIDGE_BULK_TX_WINDOW		(4)
+
+/** Credits granted to the bulk client. */
+#define CONF_BRIDGE_BULK_RX_CREDITS		(8)
+
+/** Longest diagnostics text sent over the bulk channel. */
+#define CONF_BRIDGE_BULK_TEXT_SIZE		(1024)
+
+/** Collect BLE temperature tags and upload them, see observer.h. Set the server address before enabling. */
+#define CONF_BRIDGE_OBSERVER			false
+
+/** Bluetooth SIG company identifier in the tag advertisements (0xFFFF: testing). */
+#define CONF_BRIDGE_OBSERVER_COMPANY_ID	0xFFFF
+
+/** Tags tracked at a time; a power of two. */
+#define CONF_BRIDGE_OBSERVER_TAGS		(16)
+
+/** Observer scan interval and window, in 625 us units; 20 ms out of every 100 ms. */
+#define CONF_BRIDGE_OBSERVER_SCAN_INTERVAL	(160)
+#define CONF_BRIDGE_OBSERVER_SCAN_WINDOW	(32)
+
+/** Time between uploads, in seconds. */
+#define CONF_BRIDGE_OBSERVER_UPLOAD_S	(60)
+
+/** Scan only this long before each upload, in seconds; less than CONF_BRIDGE_OBSERVER_UPLOAD_S. */
+#define CONF_BRIDGE_OBSERVER_SCAN_S		(10)
+
+/** Time after which a tag not heard is forgotten, in seconds. */
+#define CONF_BRIDGE_OBSERVER_TAG_TTL_S	(300)
+
+/** Server the tags are posted to; also sent as the Host header. */
+#define CONF_BRIDGE_OBSERVER_HOST_IP	BRIDGE_IPV4(192, 168, 1, 10)
+#define CONF_BRIDGE_OBSERVER_PORT		(80)
+#define CONF_BRIDGE_OBSERVER_PATH		"/tags"
+
+/** Size of one POST; all tags must fit, see observer.c. */
+#define CONF_BRIDGE_OBSERVER_POST_SIZE	(1024)
+
+/** Wait for the server's answer, in ms. */
+#define CONF_BRIDGE_OBSERVER_TIMEOUT_MS	(5000)
+
+/** Serve cached weather over HTTP on the LAN, see httpd.h. */
+#define CONF_BRIDGE_HTTPD				true
+
+/** HTTP server port. */
+#define CONF_BRIDGE_HTTPD_PORT			(80)
+
+/** HTTP connections served at a time; the WINC has TCP sockets for 2. */
+#define CONF_BRIDGE_HTTPD_CLIENTS		(2)
+
+/** Longest HTTP request kept; the rest of longer requests is ignored. */
+#define CONF_BRIDGE_HTTPD_REQUEST_SIZE	(256)
+
+/** Wait for the request of a new HTTP connection, in ms. */
+#define CONF_BRIDGE_HTTPD_TIMEOUT_MS	(5000)
+
+/** Wait for weather that is not cached before answering 504, in ms. */
+#define CONF_BRIDGE_HTTPD_WAIT_MS		(10000)
+
+/** Push every weather update to the LAN over UDP, see publish.h. */
+#define CONF_BRIDGE_PUBLISH				true
+
+/** Destination of the updates: a multicast group, or BRIDGE_IPV4(255, 255, 255, 255). */
+#define CONF_BRIDGE_PUBLISH_ADDR		BRIDGE_IPV4(239, 255, 87, 66)
+#define CONF_BRIDGE_PUBLISH_PORT		(5087)
+
+/** Publish telemetry to an MQTT broker, see mqtt.h. Set the broker address before enabling. */
+#define CONF_BRIDGE_MQTT				false
+
+/** Broker address and port. */
+#define CONF_BRIDGE_MQTT_BROKER_IP		BRIDGE_IPV4(192, 168, 1, 10)
+#define CONF_BRIDGE_MQTT_BROKER_PORT	(1883)
+
+/** Client identifier, and the prefix of every topic published. */
+#define CONF_BRIDGE_MQTT_CLIENT_ID		"weather-bridge"
+#define CONF_BRIDGE_MQTT_TOPIC_PREFIX	"bridge/"
+
+/** Keep-alive interval, in seconds. */
+#define CONF_BRIDGE_MQTT_KEEPALIVE_S	(60)
+
+/** Publishes are held this long to go out together, in ms. */
+#define CONF_BRIDGE_MQTT_BATCH_MS		(200)
+
+/** Bytes of publishes held; at most one TCP segment. */
+#define CONF_BRIDGE_MQTT_TX_BUF_SIZE	(1024)
+
+/** Wait after the first failed connection, doubled on each further failure, in ms. */
+#define CONF_BRIDGE_MQTT_RETRY_MIN_MS	(1000)
+
+/** Longest wait between connection attempts, in ms. */
+#define CONF_BRIDGE_MQTT_RETRY_MAX_MS	(60000)
+
+/** Time between metrics publishes, in seconds. */
+#define CONF_BRIDGE_MQTT_METRICS_S		(60)
+
+#endif /* CONF_BRIDGE_H_INCLUDED */
@@ -0,0 +1,18 @@
+/**
+ * \file
+ *
+ * \brief Persistent record store configuration.
+ *
+ */
+
+#ifndef CONF_PSTORE_H_INCLUDED
+#define CONF_PSTORE_H_INCLUDED
+
+/**
+ * Flash rows at the top of the NVM used for records. Each save goes to the
+ * next row, so every row is erased once per CONF_PSTORE_ROWS saves. The
+ * rom region in samd21j18a_flash.ld is shortened by the same amount.
+ */
+#define CONF_PSTORE_ROWS				(8)
+
+#endif /* CONF_PSTORE_H_INCLUDED */
@@ -62,6 +62,28 @@
 #define CONF_FLCR_BLE_BAUDRATE      115200
 #define CONF_FLCR_BLE_UART_CLOCK	GCLK_GENERATOR_0
 
+/* After patch download the host link is switched to HOST_UART_BAUDRATE_CONFIG_VALUE
+   with RTS/CTS. If initialization fails at that rate, or
+   CONF_BLE_UART_ERROR_LIMIT framing/overrun errors are seen on the fast link
+   within CONF_BLE_UART_ERROR_WINDOW_MS, the BTLC1000 is initialized again at
+   the fast rate. A second failure falls back to CONF_BLE_UART_FALLBACK_BAUDRATE
+   for good; the application keeps that decision in its warm state. */
+#define CONF_BLE_UART_FALLBACK_BAUDRATE	115200
+/* 0 disables the runtime fallback */
+#define CONF_BLE_UART_ERROR_LIMIT		16
+#define CONF_BLE_UART_ERROR_WINDOW_MS	10000
+
+/* Receive BTLC1000 data by DMA into a circular buffer instead of taking one
+   interrupt per byte. The DMA interrupt moves it into a FIFO on every
+   half/full block; the stack reads the FIFO whenever the platform polls
+   while waiting for an event. */
+#define CONF_BLE_UART_RX_DMA			true
+#define CONF_BLE_UART_RX_DMA_CHANNEL	0
+/* Power of two; each half raises one interrupt */
+#define CONF_BLE_UART_RX_DMA_BUF_SIZE	256
+/* Power of two; holds received bytes until the stack polls */
+#define CONF_BLE_UART_RX_FIFO_SIZE		512
+
 
 /* BTLC1000 Wakeup Pin */
 #if (BLE_MODULE == BTLC1000_ZR)
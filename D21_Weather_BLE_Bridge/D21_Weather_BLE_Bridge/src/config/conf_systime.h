@@ -0,0 +1,17 @@
+/**
+ * \file
+ *
+ * \brief System time base configuration.
+ *
+ */
+
+#ifndef CONF_SYSTIME_H_INCLUDED
+#define CONF_SYSTIME_H_INCLUDED
+
+/**
+ * 32.768 kHz generator clocking the RTC (GCLK1 runs from XOSC32K). It
+ * must run in standby for the RTC alarm to wake the core from it.
+ */
+#define CONF_SYSTIME_GCLK_GENERATOR		GCLK_GENERATOR_1
+
+#endif /* CONF_SYSTIME_H_INCLUDED */
@@ -0,0 +1,24 @@
+/**
+ * \file
+ *
+ * \brief Trace logging configuration.
+ *
+ */
+
+#ifndef CONF_TRACE_H_INCLUDED
+#define CONF_TRACE_H_INCLUDED
+
+/** Lowest level that is compiled in; anything below expands to nothing. */
+#define CONF_TRACE_LEVEL				TRACE_LEVEL_INFO
+
+/**
+ * 1: emit binary frames (format id + raw arguments) decoded on the host by
+ *    tools/trace_decode.py against the ELF image.
+ * 0: format on target with printf, for use with a plain terminal.
+ */
+#define CONF_TRACE_BINARY				(1)
+
+/** Longest string argument copied into a binary frame. */
+#define CONF_TRACE_STR_MAX				(24)
+
+#endif /* CONF_TRACE_H_INCLUDED */
@@ -97,6 +97,9 @@ extern "C" {
 #define CONF_WINC_DEBUG					(1)
 #define CONF_WINC_PRINTF				printf
 
+/** Send driver logs through trace.h (binary, level filtered) instead of printf. */
+#define CONF_WINC_USE_TRACE				(1)
+
 #ifdef __cplusplus
 }
 #endif
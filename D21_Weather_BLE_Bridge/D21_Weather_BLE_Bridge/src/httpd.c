@@ -0,0 +1,453 @@
+/**
+ * \file
+ *
+ * \brief HTTP server on the Wi-Fi side, serving cached weather.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "socket/include/socket.h"
+#include "strfmt.h"
+#include "systime.h"
+#include "idle.h"
+#include "req_queue.h"
+#include "quota.h"
+#include "weather_units.h"
+#include "weather_cache.h"
+#include "httpd.h"
+#include "trace.h"
+
+#if (CONF_BRIDGE_HTTPD == true)
+
+/* Weather client, tunnel, observer, MQTT and listening sockets */
+#define HTTPD_OTHER_TCP_SOCKETS			5
+/* Wait before listening again after bind() or listen() failed, in ms */
+#define HTTPD_LISTEN_RETRY_MS			(5000)
+/* Longest answer header and body */
+#define HTTPD_HEADER_MAX				(128)
+#define HTTPD_BODY_SIZE					(100)
+
+_Static_assert(CONF_BRIDGE_HTTPD_CLIENTS + HTTPD_OTHER_TCP_SOCKETS <= TCP_SOCK_MAX, "not enough TCP sockets");
+_Static_assert(CONF_BRIDGE_HTTPD_CLIENTS <= 0xFF, "client index must fit the connection handle");
+
+typedef enum
+{
+	HTTPD_FREE,
+	/* recv() of the request issued */
+	HTTPD_RECEIVING,
+	/* City queued, waiting for the cache */
+	HTTPD_WAITING,
+	/* Answer handed to send() */
+	HTTPD_SENDING,
+}httpd_client_state_t;
+
+typedef struct
+{
+	httpd_client_state_t state;
+	SOCKET sock;
+	char request[CONF_BRIDGE_HTTPD_REQUEST_SIZE];
+	uint16_t request_len;
+	char city[CONF_BRIDGE_CITY_SIZE];
+	/* Units of the answer, see weather_units_t */
+	uint8_t units;
+	/* systime_ms() when the city was queued */
+	uint32_t waiting_ms;
+}httpd_client_t;
+
+static httpd_client_t httpd_clients[CONF_BRIDGE_HTTPD_CLIENTS];
+
+static SOCKET listen_sock = -1;
+static uint32_t listen_try_ms;
+static bool listen_tried;
+
+/* The WINC takes a copy on send(), one buffer serves all clients */
+static char httpd_tx[HTTPD_HEADER_MAX + HTTPD_BODY_SIZE];
+
+static void httpd_free(uint8_t index)
+{
+	httpd_client_t *client = &httpd_clients[index];
+
+	if (client->state == HTTPD_WAITING) {
+		req_queue_drop(HTTPD_CONN_HANDLE(index));
+	}
+	if (client->sock >= 0) {
+		close(client->sock);
+	}
+	client->sock = -1;
+	client->state = HTTPD_FREE;
+}
+
+static void httpd_respond(uint8_t index, const char *status, const char *body, uint16_t len)
+{
+	httpd_client_t *client = &httpd_clients[index];
+	strfmt_t resp;
+
+	/* Served from the cache after all */
+	if (client->state == HTTPD_WAITING) {
+		req_queue_drop(HTTPD_CONN_HANDLE(index));
+		client->state = HTTPD_RECEIVING;
+	}
+	strfmt_init(&resp, httpd_tx, sizeof(httpd_tx));
+	strfmt_str(&resp, "HTTP/1.1 ");
+	strfmt_str(&resp, status);
+	strfmt_str(&resp, "\r\nContent-Type: text/plain\r\nContent-Length: ");
+	strfmt_uint(&resp, len);
+	strfmt_str(&resp, "\r\nConnection: close\r\n\r\n");
+	strfmt_mem(&resp, body, len);
+
+	if (!resp.overflow && (send(client->sock, httpd_tx, resp.len, 0) == SOCK_ERR_NO_ERROR)) {
+		client->state = HTTPD_SENDING;
+	} else {
+		httpd_free(index);
+	}
+}
+
+static void httpd_respond_status(uint8_t index, const char *status)
+{
+	httpd_respond(index, status, status, strlen(status));
+}
+
+/* Answer from the cache; false if the city is not there */
+static bool httpd_respond_cached(uint8_t index)
+{
+	char body[HTTPD_BODY_SIZE];
+	uint16_t len = weather_cached_text(httpd_clients[index].city, httpd_clients[index].units, body, sizeof(body));
+
+	if (!len) {
+		return false;
+	}
+	httpd_respond(index, "200 OK", body, len);
+	return true;
+}
+
+static uint8_t httpd_hex(char c)
+{
+	if ((c >= '0') && (c <= '9')) {
+		return c - '0';
+	}
+	c |= 0x20;
+	if ((c >= 'a') && (c <= 'f')) {
+		return c - 'a' + 10;
+	}
+	return 0xFF;
+}
+
+/* Decoded value of a query parameter; false if missing or empty */
+static bool httpd_query_param(const char *query, const char *name, char *value, uint8_t size)
+{
+	const char *p = query;
+	uint8_t name_len = strlen(name);
+	uint8_t len = 0;
+
+	/* "name=" at the start of a parameter */
+	while (*p && (*p != ' ')) {
+		if (!strncmp(p, name, name_len) && (p[name_len] == '=') && ((p == query) || (p[-1] == '&'))) {
+			break;
+		}
+		p++;
+	}
+	if (!*p || (*p == ' ')) {
+		return false;
+	}
+	for (p += name_len + 1; *p && (*p != ' ') && (*p != '&') && (len < size - 1); p++) {
+		char c = *p;
+
+		if (c == '+') {
+			c = ' ';
+		} else if ((c == '%') && (httpd_hex(p[1]) < 16) && (httpd_hex(p[2]) < 16)) {
+			c = (char)((httpd_hex(p[1]) << 4) | httpd_hex(p[2]));
+			p += 2;
+		}
+		value[len++] = c;
+	}
+	value[len] = '\0';
+	return len != 0;
+}
+
+static void httpd_serve(uint8_t index)
+{
+	httpd_client_t *client = &httpd_clients[index];
+	const char *target;
+	char units[10];
+
+	if (strncmp(client->request, "GET ", 4)) {
+		httpd_respond_status(index, "405 Method Not Allowed");
+		return;
+	}
+	target = &client->request[4];
+	if (strncmp(target, "/weather", 8) || ((target[8] != '?') && (target[8] != ' '))) {
+		httpd_respond_status(index, "404 Not Found");
+		return;
+	}
+	if ((target[8] != '?') || !httpd_query_param(&target[9], "city", client->city, sizeof(client->city))) {
+		httpd_respond_status(index, "400 Bad Request");
+		return;
+	}
+	client->units = CONF_BRIDGE_DEFAULT_UNITS;
+	if (httpd_query_param(&target[9], "units", units, sizeof(units)) &&
+			!weather_units_parse(units, strlen(units), &client->units)) {
+		httpd_respond_status(index, "400 Bad Request");
+		return;
+	}
+	TRACE_DBG("httpd: %s", client->city);
+	if (httpd_respond_cached(index)) {
+		quota_hit();
+		return;
+	}
+	/* Fetched from the main loop, shared with BLE requests for the city */
+	if (req_queue_push(HTTPD_CONN_HANDLE(index), client->city)) {
+		client->state = HTTPD_WAITING;
+		client->waiting_ms = systime_ms();
+	} else {
+		httpd_respond_status(index, "503 Service Unavailable");
+	}
+}
+
+static void httpd_receive(uint8_t index)
+{
+	httpd_client_t *client = &httpd_clients[index];
+	uint16_t room = sizeof(client->request) - 1 - client->request_len;
+
+	client->request[client->request_len] = '\0';
+	/* Serve once the headers ended, or with what fits */
+	if (strstr(client->request, "\r\n\r\n") || !room) {
+		httpd_serve(index);
+	} else if (recv(client->sock, &client->request[client->request_len], room, CONF_BRIDGE_HTTPD_TIMEOUT_MS)
+			!= SOCK_ERR_NO_ERROR) {
+		httpd_free(index);
+	}
+}
+
+static void httpd_accept(SOCKET sock)
+{
+	for (uint8_t i = 0; i < CONF_BRIDGE_HTTPD_CLIENTS; i++) {
+		httpd_client_t *client = &httpd_clients[i];
+
+		if (client->state == HTTPD_FREE) {
+			client->state = HTTPD_RECEIVING;
+			client->sock = sock;
+			client->request_len = 0;
+			httpd_receive(i);
+			return;
+		}
+	}
+	TRACE_WARN("httpd: busy, connection refused");
+	close(sock);
+}
+
+static void httpd_stop(void)
+{
+	for (uint8_t i = 0; i < CONF_BRIDGE_HTTPD_CLIENTS; i++) {
+		if (httpd_clients[i].state != HTTPD_FREE) {
+			httpd_free(i);
+		}
+	}
+	if (listen_sock >= 0) {
+		close(listen_sock);
+		listen_sock = -1;
+	}
+}
+
+static void httpd_listen(void)
+{
+	struct sockaddr_in addr_in;
+	uint32_t now = systime_ms();
+
+	if (listen_tried && ((now - listen_try_ms) < HTTPD_LISTEN_RETRY_MS)) {
+		idle_wake_at(listen_try_ms + HTTPD_LISTEN_RETRY_MS);
+		return;
+	}
+	listen_tried = true;
+	listen_try_ms = now;
+
+	if ((listen_sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		TRACE_WARN("httpd: no socket");
+		return;
+	}
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_port = _htons(CONF_BRIDGE_HTTPD_PORT);
+	addr_in.sin_addr.s_addr = 0;
+	/* listen() follows SOCKET_MSG_BIND */
+	if (bind(listen_sock, (struct sockaddr *)&addr_in, sizeof(addr_in)) != SOCK_ERR_NO_ERROR) {
+		TRACE_WARN("httpd: bind failed");
+		httpd_stop();
+	}
+}
+
+static int8_t httpd_client_index(SOCKET sock)
+{
+	for (uint8_t i = 0; i < CONF_BRIDGE_HTTPD_CLIENTS; i++) {
+		if ((httpd_clients[i].state != HTTPD_FREE) && (httpd_clients[i].sock == sock)) {
+			return (int8_t)i;
+		}
+	}
+	return -1;
+}
+
+bool httpd_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	int8_t index;
+
+	if ((listen_sock >= 0) && (sock == listen_sock)) {
+		switch (msg) {
+		case SOCKET_MSG_BIND:
+			if ((((tstrSocketBindMsg *)msg_data)->status != 0) || (listen(listen_sock, 0) != SOCK_ERR_NO_ERROR)) {
+				TRACE_WARN("httpd: bind error");
+				httpd_stop();
+			}
+			break;
+
+		case SOCKET_MSG_LISTEN:
+			if (((tstrSocketListenMsg *)msg_data)->status != 0) {
+				TRACE_WARN("httpd: listen error");
+				httpd_stop();
+			} else {
+				TRACE_INFO("httpd: listening on port %u", CONF_BRIDGE_HTTPD_PORT);
+			}
+			break;
+
+		case SOCKET_MSG_ACCEPT:
+		{
+			tstrSocketAcceptMsg *accept_msg = (tstrSocketAcceptMsg *)msg_data;
+
+			if (accept_msg && (accept_msg->sock >= 0)) {
+				httpd_accept(accept_msg->sock);
+			}
+		}
+		break;
+
+		default:
+			break;
+		}
+		return true;
+	}
+
+	if ((index = httpd_client_index(sock)) < 0) {
+		return false;
+	}
+
+	switch (msg) {
+	case SOCKET_MSG_RECV:
+	{
+		tstrSocketRecvMsg *recv_msg = (tstrSocketRecvMsg *)msg_data;
+		httpd_client_t *client = &httpd_clients[index];
+
+		if (client->state != HTTPD_RECEIVING) {
+			/* Rest of an over long request */
+			break;
+		}
+		if (recv_msg->s16BufferSize <= 0) {
+			/* Gone or too slow */
+			httpd_free(index);
+			break;
+		}
+		client->request_len += recv_msg->s16BufferSize;
+		if (recv_msg->u16RemainingSize) {
+			/* The buffer is full; the rest would land on it again */
+			client->request[client->request_len] = '\0';
+			httpd_serve(index);
+		} else {
+			httpd_receive(index);
+		}
+	}
+	break;
+
+	case SOCKET_MSG_SEND:
+		/* One answer per connection */
+		httpd_free(index);
+		break;
+
+	default:
+		break;
+	}
+	return true;
+}
+
+void httpd_task(bool uplink)
+{
+	uint32_t now = systime_ms();
+
+	if (!uplink) {
+		if (listen_sock >= 0) {
+			httpd_stop();
+		}
+		return;
+	}
+	if (listen_sock < 0) {
+		httpd_listen();
+	}
+
+	for (uint8_t i = 0; i < CONF_BRIDGE_HTTPD_CLIENTS; i++) {
+		httpd_client_t *client = &httpd_clients[i];
+
+		if (client->state != HTTPD_WAITING) {
+			continue;
+		}
+		if (httpd_respond_cached(i)) {
+			continue;
+		}
+		if ((now - client->waiting_ms) >= CONF_BRIDGE_HTTPD_WAIT_MS) {
+			httpd_respond_status(i, "504 Gateway Timeout");
+		} else {
+			idle_wake_at(client->waiting_ms + CONF_BRIDGE_HTTPD_WAIT_MS);
+		}
+	}
+}
+
+void httpd_reply(uint16_t conn_handle, const weather_cache_entry_t *entry)
+{
+	uint8_t index = conn_handle & 0xFF;
+	char body[HTTPD_BODY_SIZE];
+
+	if ((conn_handle == HTTPD_CONN_HANDLE(index)) && (index < CONF_BRIDGE_HTTPD_CLIENTS) &&
+			(httpd_clients[index].state == HTTPD_WAITING)) {
+		httpd_respond(index, "200 OK", body, weather_format(entry, httpd_clients[index].units, body, sizeof(body)));
+	}
+}
+
+void httpd_reply_error(uint16_t conn_handle)
+{
+	uint8_t index = conn_handle & 0xFF;
+
+	if ((conn_handle == HTTPD_CONN_HANDLE(index)) && (index < CONF_BRIDGE_HTTPD_CLIENTS) &&
+			(httpd_clients[index].state == HTTPD_WAITING)) {
+		httpd_respond_status(index, "502 Bad Gateway");
+	}
+}
+
+bool httpd_busy(void)
+{
+	for (uint8_t i = 0; i < CONF_BRIDGE_HTTPD_CLIENTS; i++) {
+		if (httpd_clients[i].state != HTTPD_FREE) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#else
+
+void httpd_task(bool uplink)
+{
+}
+
+bool httpd_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	return false;
+}
+
+void httpd_reply(uint16_t conn_handle, const weather_cache_entry_t *entry)
+{
+}
+
+void httpd_reply_error(uint16_t conn_handle)
+{
+}
+
+bool httpd_busy(void)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * \file
+ *
+ * \brief HTTP server on the Wi-Fi side, serving cached weather.
+ *
+ * Clients on the bridge's LAN ask for weather without BLE:
+ * \code
+ *   GET /weather?city=paris HTTP/1.1
+ * \endcode
+ * The answer is the text BLE clients get, as text/plain, in the units of
+ * an optional \c units parameter, see weather_units.h. Cities missing
+ * from the cache go through the request queue like BLE requests, so a
+ * single fetch serves both. Up to CONF_BRIDGE_HTTPD_CLIENTS connections
+ * are served at a time, on TCP sockets the rest of the bridge leaves
+ * free; each gets one answer and is closed.
+ *
+ * Status codes: 200 with the weather, 400 without a city or with unknown
+ * units, 404 for other paths, 405 for other methods, 502 if the weather
+ * server failed, 503 if the request queue is full and 504 if no weather
+ * came within CONF_BRIDGE_HTTPD_WAIT_MS.
+ *
+ */
+
+#ifndef HTTPD_H_INCLUDED
+#define HTTPD_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+#include "weather_cache.h"
+
+/** Connection handle of requests queued for HTTP clients; no BLE client gets the reply */
+#define HTTPD_CONN_HANDLE(index)		((uint16_t)(0xFE00 | (index)))
+
+/** @brief Listen while the uplink is ready and answer waiting clients. Call from the main loop.
+  *
+  * @param[in] uplink	The Wi-Fi uplink is ready
+  */
+void httpd_task(bool uplink);
+
+/** @brief Socket event, from the socket callback
+  *
+  * @return false if the socket is not the server's
+  */
+bool httpd_socket_cb(int8_t sock, uint8_t msg, void *msg_data);
+
+/** @brief Answer a waiting client with weather from the main loop
+  *
+  * @param[in] conn_handle	Handle the request was queued with; others are ignored
+  * @param[in] entry		Weather, formatted in the client's units
+  */
+void httpd_reply(uint16_t conn_handle, const weather_cache_entry_t *entry);
+
+/** @brief Answer a waiting client with 502 Bad Gateway, the weather server failed
+  *
+  * @param[in] conn_handle	Handle the request was queued with; others are ignored
+  */
+void httpd_reply_error(uint16_t conn_handle);
+
+/** @brief A client is connected */
+bool httpd_busy(void);
+
+#endif /* HTTPD_H_INCLUDED */
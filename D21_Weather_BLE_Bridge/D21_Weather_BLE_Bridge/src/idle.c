@@ -0,0 +1,112 @@
+/**
+ * \file
+ *
+ * \brief Tickless idle for the main loop.
+ *
+ */
+
+#include <asf.h>
+#include "driver/source/m2m_hif.h"
+#include "conf_serialdrv.h"
+#include "serial_drv.h"
+#include "systime.h"
+#include "idle.h"
+
+static idle_stats_t idle_stat;
+
+/* Earliest time requested with idle_wake_at() */
+static bool idle_wake_set;
+static uint32_t idle_wake_ms;
+
+/* Woke up and the main loop has not dispatched yet */
+static bool idle_woke;
+static uint32_t idle_woke_ms;
+
+void idle_wake_at(uint32_t at_ms)
+{
+	if (!idle_wake_set || ((int32_t)(at_ms - idle_wake_ms) < 0)) {
+		idle_wake_ms = at_ms;
+		idle_wake_set = true;
+	}
+}
+
+/* Interrupts are masked: anything raised from here on still ends WFI */
+static bool idle_can_sleep(void)
+{
+	/* WINC interrupt not handled yet */
+	if (hif_irq_pending()) {
+		return false;
+	}
+	/* BTLC1000 has an event ready, or the host is talking to it */
+	if (!host_event_data_ready_pin_level() || ble_wakeup_pin_level()) {
+		return false;
+	}
+	if (idle_wake_set && ((int32_t)(systime_ms() - idle_wake_ms) >= 0)) {
+		return false;
+	}
+	/* Arms the receive start wake-up; fails if bytes are waiting */
+	return serial_drv_sleep_prepare();
+}
+
+bool idle_enter(bool busy)
+{
+	uint32_t start;
+	bool standby = (CONF_BRIDGE_IDLE_SLEEP_MODE == SYSTEM_SLEEPMODE_STANDBY);
+
+	if (busy) {
+		idle_wake_set = false;
+		return false;
+	}
+
+	cpu_irq_disable();
+	if (!idle_can_sleep()) {
+		cpu_irq_enable();
+		idle_wake_set = false;
+		return false;
+	}
+
+	if (idle_wake_set) {
+		systime_alarm(idle_wake_ms);
+	}
+	if (standby) {
+		/* The UART clock stops; hold the BTLC1000 off so it signals on the host wake line */
+		platform_set_ble_rts_high();
+	}
+
+	start = systime_ms();
+	system_set_sleepmode(CONF_BRIDGE_IDLE_SLEEP_MODE);
+	system_sleep();
+	idle_woke_ms = systime_ms();
+
+	if (standby) {
+		platform_set_ble_rts_low();
+	}
+	systime_alarm_cancel();
+	cpu_irq_enable();
+
+	idle_stat.sleeps++;
+	idle_stat.asleep_ms += idle_woke_ms - start;
+	idle_woke = true;
+	idle_wake_set = false;
+	return true;
+}
+
+void idle_dispatched(void)
+{
+	uint32_t latency;
+
+	if (!idle_woke) {
+		return;
+	}
+	idle_woke = false;
+	latency = systime_ms() - idle_woke_ms;
+	idle_stat.last_dispatch_ms = latency;
+	if (latency > idle_stat.max_dispatch_ms) {
+		idle_stat.max_dispatch_ms = latency;
+	}
+}
+
+const idle_stats_t *idle_stats(void)
+{
+	return &idle_stat;
+}
@@ -0,0 +1,56 @@
+/**
+ * \file
+ *
+ * \brief Tickless idle for the main loop.
+ *
+ * At the end of every main loop pass the core sleeps until the next
+ * interrupt, unless there is still something to do. Wake sources:
+ * - the WINC1500 interrupt line (EIC);
+ * - the BTLC1000 host wake line (EIC) and the first received UART byte;
+ * - the BLE bus timer;
+ * - the RTC alarm, set to the earliest time requested with idle_wake_at().
+ *
+ */
+
+#ifndef IDLE_H_INCLUDED
+#define IDLE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+typedef struct
+{
+	/* Times the core went to sleep */
+	uint32_t sleeps;
+	/* Time spent asleep, in ms */
+	uint32_t asleep_ms;
+	/* From wake-up until the main loop dispatched WINC and BLE events, last and worst, in ms */
+	uint32_t last_dispatch_ms;
+	uint32_t max_dispatch_ms;
+}idle_stats_t;
+
+/** @brief Make sure the core is awake at a time
+  *
+  * Called by tasks with a deadline on every main loop pass; the earliest
+  * one is kept until the next idle_enter().
+  *
+  * @param[in] at_ms	systime_ms() value
+  */
+void idle_wake_at(uint32_t at_ms);
+
+/** @brief Sleep until the next wake source fires
+  *
+  * @param[in] busy	The application still has work; stay awake
+  *
+  * @return true if the core slept
+  */
+bool idle_enter(bool busy);
+
+/** @brief Mark the point in the main loop where events have been dispatched */
+void idle_dispatched(void);
+
+/** @brief Sleep statistics */
+const idle_stats_t *idle_stats(void);
+
+#endif /* IDLE_H_INCLUDED */
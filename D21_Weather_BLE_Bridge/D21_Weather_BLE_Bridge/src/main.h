@@ -70,7 +70,7 @@ extern "C" {
 
 /** Send buffer of TCP socket. */
 #define MAIN_PREFIX_BUFFER                  "GET /data/2.5/weather?q="
-#define MAIN_POST_BUFFER                    "&appid=c592e14137c3471fa9627b44f6649db4&mode=xml&units=imperial HTTP/1.1\r\nHost: api.openweathermap.org\r\nAccept: */*\r\n\r\n"
+#define MAIN_POST_BUFFER                    "&appid=c592e14137c3471fa9627b44f6649db4&mode=xml&units=metric HTTP/1.1\r\nHost: api.openweathermap.org\r\nAccept: */*\r\n\r\n"
 
 /** Weather information provider server. */
 #define MAIN_WEATHER_SERVER_NAME            "api.openweathermap.org"
@@ -93,12 +93,8 @@ static uint8_t gau8MacAddr[] = MAIN_MAC_ADDRESS;
 static int8_t gacDeviceName[] = MAIN_M2M_DEVICE_NAME;
 
 /* Stock quote response labels */
-#define CITY_NAME						    ("\r\nCity Name   : ")
-#define TEMPERATURE_VALUE					("\r\nTemperature : ")
-#define WEATHER_VALUE					    ("\r\nWeather     : ")
 //#define STOCK_SERVER_ERROR					("\r\nServer ERROR.\r\nTry again!!!")
 #define WEATHER_SERVER_ERROR					("\r\nServer ERROR.\r\nTry again!!!")
-#define NEW_LINE							("\r\n")
 
 #ifdef __cplusplus
 }
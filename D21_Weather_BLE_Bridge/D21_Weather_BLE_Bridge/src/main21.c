@@ -97,9 +97,29 @@
 #include "transparent_uart.h"
 #include "ble_manager.h"
 #include "at_ble_api.h"
+#include "platform.h"
 #include "ble_utils.h"
+#include "trace.h"
+#include "strfmt.h"
+#include "req_queue.h"
+#include "systime.h"
+#include "weather_cache.h"
+#include "warm_state.h"
+#include "wifi_link.h"
+#include "net_addr.h"
+#include "wifi_power.h"
+#include "idle.h"
+#include "broadcast.h"
+#include "tunnel.h"
+#include "bulk.h"
+#include "observer.h"
+#include "httpd.h"
+#include "publish.h"
+#include "mqtt.h"
+#include "subscribe.h"
+#include "quota.h"
+#include "weather_parse.h"
 
-#define CITY_NAME_SIZE 20
 #define STRING_EOL    "\r\n"
 #define STRING_HEADER "-- WINC1500/BTLC1000 weather client bridge --"STRING_EOL	\
 	"-- "BOARD_NAME " --"STRING_EOL	\
@@ -126,27 +146,15 @@ static bool gbHostIpByName = false;
 /** TCP Connection status variable. */
 static bool gbTcpConnection = false;
 
-/**City Name to find*/
-static char city[CITY_NAME_SIZE];
+/** Request being served by the TCP client socket */
+static req_queue_entry_t cur_req;
 
-/** Tells whether to request weather*/
-static bool req_weather = false;
-
-/**City name*/
-static char city_name_ble[CITY_NAME_SIZE];
-
-/**Temperature*/
-static char curTemperature[10];
-
-/**Weather Conditions*/
-static char curWeather[20];
+/** Weather parsed from the current response */
+static weather_cache_entry_t cur_weather;
 
 /**weather response message to GATT Client*/
 static char weather_resp[100];
 
-/** Weather response length*/
-static uint8_t weather_resp_len = 0;
-
 /**
  * \brief Configure UART console.
  */
@@ -176,14 +184,109 @@ static void configure_console(void)
  */
 static void resolve_cb(uint8_t *hostName, uint32_t hostIp)
 {
+	if (hostIp == 0) {
+		TRACE_WARN("resolve_cb: %s not resolved", hostName);
+		net_addr_uplink_failed();
+		return;
+	}
 	gu32HostIp = hostIp;
 	gbHostIpByName = true;
-	printf("resolve_cb: %s IP address is %d.%d.%d.%d\r\n\r\n", hostName,
+	warm_state_set_host(hostIp);
+	TRACE_INFO("resolve_cb: %s IP address is %d.%d.%d.%d", hostName,
 			(int)IPV4_BYTE(hostIp, 0), (int)IPV4_BYTE(hostIp, 1),
 			(int)IPV4_BYTE(hostIp, 2), (int)IPV4_BYTE(hostIp, 3));
-			
-	/* Start BLE advertisement */
-	ble_app_state_set_start_adv();
+	if (req_queue_count()) {
+		TRACE_INFO("uplink ready, %d queued requests", req_queue_count());
+	}
+}
+
+/**
+ * \brief Send weather to a client.
+ *
+ * \param[in] conn_handle Connection that asked.
+ * \param[in] entry Weather to send.
+ */
+static void weather_reply(uint16_t conn_handle, const weather_cache_entry_t *entry)
+{
+	uint16_t len = weather_format(entry, ble_app_units(conn_handle), weather_resp, sizeof(weather_resp));
+
+	ble_app_send_weather_data(conn_handle, (uint8_t *)weather_resp, len);
+	httpd_reply(conn_handle, entry);
+}
+
+/**
+ * \brief Whether a request refreshes a broadcast or subscribed city.
+ *
+ * These are queued once the weather is due for a refresh, which may be
+ * before it is too old for weather_cache_find(), so they always fetch.
+ *
+ * \param[in] conn_handle Connection the request was queued for.
+ */
+static bool weather_refresh(uint16_t conn_handle)
+{
+	return ((conn_handle & 0xFF00) == (BROADCAST_CONN_HANDLE(0) & 0xFF00)) ||
+			((conn_handle & 0xFF00) == (SUBSCRIBE_CONN_HANDLE(0) & 0xFF00));
+}
+
+/**
+ * \brief Whether no client waits for the answer to a request.
+ *
+ * \param[in] conn_handle Connection the request was queued for.
+ */
+static bool weather_background(uint16_t conn_handle)
+{
+	return (conn_handle == QUOTA_CONN_HANDLE) || weather_refresh(conn_handle);
+}
+
+/**
+ * \brief Whether weather can be fetched from the server.
+ */
+static bool weather_uplink_ready(void)
+{
+	return gbConnectedWifi && gbHostIpByName;
+}
+
+/**
+ * \brief Whether a queued request can be served.
+ *
+ * Without quota, each queued request is looked at once, to answer those
+ * with stale weather, then the deferred rest wait for a token.
+ */
+static bool weather_request_ready(void)
+{
+	return weather_uplink_ready() && !gbTcpConnection && req_queue_count() &&
+			(quota_ready() || (req_queue_deferred() < req_queue_count()));
+}
+
+/**
+ * \brief Tell the client of the current request that it failed.
+ */
+static void weather_reply_error(void)
+{
+	memcpy(weather_resp, WEATHER_SERVER_ERROR, sizeof(WEATHER_SERVER_ERROR));
+	ble_app_send_weather_data(cur_req.conn_handle, (uint8_t *)weather_resp, sizeof(WEATHER_SERVER_ERROR));
+	httpd_reply_error(cur_req.conn_handle);
+}
+
+/**
+ * \brief Keep the weather parsed from an answer and send it to the client.
+ */
+static void weather_fetched(void)
+{
+	if (!weather_parse_valid()) {
+		TRACE_WARN("weather server error");
+		weather_reply_error();
+		return;
+	}
+	TRACE_DBG("found %s: %ld, condition %u", cur_weather.name, cur_weather.temperature, cur_weather.condition);
+
+	/* Keep it for later requests, then send it to the GATT client */
+	memcpy(cur_weather.city, cur_req.city, sizeof(cur_weather.city));
+	weather_cache_store(&cur_weather);
+	publish_weather(&cur_weather);
+	mqtt_publish_weather(&cur_weather);
+	TRACE_DBG("sending weather to GATT client");
+	weather_reply(cur_req.conn_handle, &cur_weather);
 }
 
 /**
@@ -204,24 +307,29 @@ static void socket_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
 		case SOCKET_MSG_CONNECT:
 		{
 			if (gbTcpConnection) {
-				memset(gau8ReceivedBuffer, 0, sizeof(gau8ReceivedBuffer));
+				strfmt_t request;
 				
 //				printf("Enter City Name: ");
 //				scanf("%s", cityName);
 //				printf("\r\n%s\r\n\r\n\r\n", cityName);
-				printf("Requesting %s weather\r\n", city);
-				sprintf((char *)gau8ReceivedBuffer, "%s%s%s", MAIN_PREFIX_BUFFER, (char *)city, MAIN_POST_BUFFER);
-				//sprintf((char *)gau8ReceivedBuffer, "%s%s%s", MAIN_PREFIX_BUFFER, (char *)MAIN_CITY_NAME, MAIN_POST_BUFFER);
+				TRACE_INFO("Requesting %s weather", cur_req.city);
+				strfmt_init(&request, (char *)gau8ReceivedBuffer, sizeof(gau8ReceivedBuffer));
+				strfmt_str(&request, MAIN_PREFIX_BUFFER);
+				strfmt_str(&request, cur_req.city);
+				strfmt_str(&request, MAIN_POST_BUFFER);
 
 				tstrSocketConnectMsg *pstrConnect = (tstrSocketConnectMsg *)pvMsg;
 				/* Check if Connection to the server is successful */
-				if (pstrConnect && pstrConnect->s8Error >= SOCK_ERR_NO_ERROR) {
-					send(tcp_client_socket, gau8ReceivedBuffer, strlen((char *)gau8ReceivedBuffer), 0);
+				if (pstrConnect && pstrConnect->s8Error >= SOCK_ERR_NO_ERROR && !request.overflow) {
+					send(tcp_client_socket, gau8ReceivedBuffer, request.len, 0);
 
+					weather_parse_start(&cur_weather);
 					memset(gau8ReceivedBuffer, 0, MAIN_WIFI_M2M_BUFFER_SIZE);
 					recv(tcp_client_socket, &gau8ReceivedBuffer[0], MAIN_WIFI_M2M_BUFFER_SIZE, 0);
 				} else {
-					printf("socket_cb: connect error!\r\n");
+					TRACE_ERR("socket_cb: connect error!");
+					weather_reply_error();
+					net_addr_uplink_failed();
 					gbTcpConnection = false;
 					close(tcp_client_socket);
 					tcp_client_socket = -1;
@@ -232,114 +340,32 @@ static void socket_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
 
 		case SOCKET_MSG_RECV:
 		{
-			char *pcIndxPtr;
-			char *pcEndPtr;
-//			printf("received weather info\r\n");
 			tstrSocketRecvMsg *pstrRecv = (tstrSocketRecvMsg *)pvMsg;
 			if (pstrRecv && pstrRecv->s16BufferSize > 0) {
-				
-				/*Get City Name*/
-//				printf("searching for weather data\r\n");
-				pcIndxPtr = strstr((char *)pstrRecv->pu8Buffer, "name=");
-				if(pcIndxPtr)
-				{
-					pcIndxPtr = pcIndxPtr + strlen("name=") + 1;
-					pcEndPtr = strstr(pcIndxPtr, "\">");
-					
-					if(pcEndPtr)
-					{
-						//make sure we don't write outsize of the array...
-						if((pcEndPtr - pcIndxPtr)>sizeof(city_name_ble)) 
-						{
-							pcEndPtr = pcIndxPtr + sizeof(city_name_ble);
-						}
-						memset(city_name_ble, 0, sizeof(city_name_ble));
-						memcpy(city_name_ble, pcIndxPtr, (pcEndPtr - pcIndxPtr));
-						printf("found city name: %s\r\n", city_name_ble);
-						weather_resp_len = (pcEndPtr - pcIndxPtr);
+				/* Parsed as it arrives; wait for more until the end of the weather */
+				if (!weather_parse_feed((char *)pstrRecv->pu8Buffer, pstrRecv->s16BufferSize)) {
+					if (!pstrRecv->u16RemainingSize) {
+						recv(tcp_client_socket, &gau8ReceivedBuffer[0], MAIN_WIFI_M2M_BUFFER_SIZE, 0);
 					}
-					
-					/* Get temperature value */
-					pcIndxPtr = strstr(pcEndPtr + 1, "temperature value");
-					if(pcIndxPtr)
-					{
-						pcIndxPtr = pcIndxPtr + strlen("temperature value") + 2;
-						pcEndPtr = strstr(pcIndxPtr, "\" ");
-						
-						if(pcEndPtr)
-						{
-							//make sure we don't write outsize of the array...
-							if((pcEndPtr - pcIndxPtr)>sizeof(curTemperature))
-							{
-								pcEndPtr = pcIndxPtr + sizeof(curTemperature);
-							}
-							memset(curTemperature, 0, sizeof(curTemperature));
-							memcpy(curTemperature, pcIndxPtr, (pcEndPtr - pcIndxPtr));
-							printf("found temperature: %s\r\n", curTemperature);
-							weather_resp_len += (pcEndPtr - pcIndxPtr);
-							
-						}
-					}
-					
-					/* Get weather conditions */
-					pcIndxPtr = strstr(pcEndPtr + 1, "weather number");
-					if(pcIndxPtr)
-					{
-						pcIndxPtr = pcIndxPtr + strlen("weather number") + 14;
-						pcEndPtr = strstr(pcIndxPtr, "\" ");
-						if(pcEndPtr)
-						{
-							//make sure we don't write outsize of the array...
-							if((pcEndPtr - pcIndxPtr)>sizeof(curWeather))
-							{
-								pcEndPtr = pcIndxPtr + sizeof(curWeather);
-							}
-							memset(curWeather, 0, sizeof(curWeather));
-							memcpy(curWeather, pcIndxPtr, (pcEndPtr - pcIndxPtr));
-							printf("found weather number: %s\r\n", curWeather);
-							weather_resp_len += (pcEndPtr - pcIndxPtr);
-						}
-					}
-					
-					/* Construct stock quote
-					Stock Symbol : 
-					Latest Value :
-					Change       : */
-					memset(weather_resp, 0, sizeof(weather_resp));
-					sprintf((char *)weather_resp, "%s%s%s%s%s%s%s", CITY_NAME, city_name_ble, TEMPERATURE_VALUE, curTemperature, WEATHER_VALUE, curWeather, NEW_LINE);
-					/* Send a weather data to GATT-Client */
-					printf("sending weather to GATT client\r\n");
-					ble_app_send_weather_data((uint8_t *)weather_resp, weather_resp_len + sizeof(CITY_NAME) + sizeof(TEMPERATURE_VALUE) + sizeof(WEATHER_VALUE) + sizeof(NEW_LINE));
-				}
-				else
-				{
-					/* Construct error message */
-					memcpy(weather_resp, WEATHER_SERVER_ERROR, sizeof(WEATHER_SERVER_ERROR));
-					/* Send a stock quote to GATT-Client */
-					printf("weather server error\r\n");
-					ble_app_send_weather_data((uint8_t *)weather_resp, sizeof(WEATHER_SERVER_ERROR));
+					break;
 				}
+				weather_fetched();
 				
-				printf("closing socket\r\n");
+				TRACE_DBG("closing socket");
 				close(tcp_client_socket);
 				tcp_client_socket = -1;
 				gbTcpConnection =false;
-				///* Request user to enter another stock ticker name */
-				//printf("\r\nEnter Stock Ticker Name : ");
-				//scanf("%s",ticker);
-				//sprintf((char *)gau8ReceivedBuffer, "%s%s%s", MAIN_PREFIX_BUFFER, (char *)ticker, MAIN_POST_BUFFER);
-				//tcp_client_socket = socket()
-				///* Send the new stock ticker request to Yahoo */
-				//send(tcp_client_socket, gau8ReceivedBuffer, strlen((char *)gau8ReceivedBuffer), 0);
-				///* Clear the receive buffer and add a receive request to WINC to get the response from Yahoo */
-				//memset(gau8ReceivedBuffer, 0, MAIN_WIFI_M2M_BUFFER_SIZE);
-				//recv(tcp_client_socket, &gau8ReceivedBuffer[0], MAIN_WIFI_M2M_BUFFER_SIZE, 0);
-				break;
 			} else {
-				/* Receive Error! */
-				printf("socket_cb: recv error!\r\n");
+				/* Closed by the server, possibly after the whole answer */
+				if (weather_parse_valid()) {
+					weather_fetched();
+				} else {
+					TRACE_ERR("socket_cb: recv error!");
+					weather_reply_error();
+				}
 				close(tcp_client_socket);
 				tcp_client_socket = -1;
+				gbTcpConnection = false;
 			}
 		}
 		break;
@@ -347,6 +373,9 @@ static void socket_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
 		default:
 			break;
 		}
+	} else if (!tunnel_socket_cb(sock, u8Msg, pvMsg) && !observer_socket_cb(sock, u8Msg, pvMsg) &&
+			!httpd_socket_cb(sock, u8Msg, pvMsg) && !publish_socket_cb(sock, u8Msg, pvMsg)) {
+		mqtt_socket_cb(sock, u8Msg, pvMsg);
 	}
 }
 
@@ -364,6 +393,27 @@ static void set_dev_name_to_mac(uint8_t *name, uint8_t *mac_addr)
 	}
 }
 
+/**
+ * \brief Mark the uplink usable and look up the weather server.
+ */
+static void wifi_ip_ready(void)
+{
+	gbConnectedWifi = true;
+	/* Obtain the IP Address by network name */
+	gethostbyname((uint8_t *)MAIN_WEATHER_SERVER_NAME);
+}
+
+/**
+ * \brief Start a connection attempt to the configured AP.
+ *
+ * \param[in] channel Channel to try, or M2M_WIFI_CH_ALL to scan.
+ */
+static void wifi_connect(uint8_t channel)
+{
+	net_addr_prepare();
+	m2m_wifi_connect(MAIN_M2M_SSID, sizeof(MAIN_M2M_SSID), MAIN_M2M_SEC, MAIN_M2M_PASSWORD, channel);
+}
+
 /**
  * \brief Callback to get the Wi-Fi status update.
  *
@@ -379,39 +429,52 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 	{
 		tstrM2mWifiStateChanged *pstrWifiState = (tstrM2mWifiStateChanged *)pvMsg;
 		if (pstrWifiState->u8CurrState == M2M_WIFI_CONNECTED) {
-			printf("wifi_cb: M2M_WIFI_CONNECTED\r\n");
-			m2m_wifi_request_dhcp_client();
+			TRACE_INFO("wifi_cb: M2M_WIFI_CONNECTED");
+			wifi_link_up();
+			/* Channel and BSSID for the next warm start */
+			m2m_wifi_get_connection_info();
+			/* Static or reused address: no need to wait for DHCP */
+			if (net_addr_link_up()) {
+				wifi_ip_ready();
+			}
 		} else if (pstrWifiState->u8CurrState == M2M_WIFI_DISCONNECTED) {
-			printf("wifi_cb: M2M_WIFI_DISCONNECTED\r\n");
+			TRACE_INFO("wifi_cb: M2M_WIFI_DISCONNECTED");
 			gbConnectedWifi = false;
-			printf("reconnecting");
-			m2m_wifi_connect(MAIN_M2M_SSID, sizeof(MAIN_M2M_SSID),MAIN_M2M_SEC,MAIN_M2M_PASSWORD, M2M_WIFI_CH_ALL);
+			wifi_link_down();
 		}
 
 		break;
 	}
 
+	case M2M_WIFI_RESP_CONN_INFO:
+	{
+		tstrM2MConnInfo *pstrConnInfo = (tstrM2MConnInfo *)pvMsg;
+		warm_state_set_link(pstrConnInfo->u8CurrChannel, pstrConnInfo->au8MACAddress);
+		break;
+	}
+
 	case M2M_WIFI_REQ_DHCP_CONF:
 	{
 		uint8_t *pu8IPAddress = (uint8_t *)pvMsg;
-		printf("wifi_cb: IP address is %u.%u.%u.%u\r\n",
+		TRACE_INFO("wifi_cb: IP address is %u.%u.%u.%u",
 				pu8IPAddress[0], pu8IPAddress[1], pu8IPAddress[2], pu8IPAddress[3]);
-		gbConnectedWifi = true;
-		/* Obtain the IP Address by network name */
-		gethostbyname((uint8_t *)MAIN_WEATHER_SERVER_NAME);
+		net_addr_lease((tstrM2MIPConfig *)pvMsg);
+		if (!gbConnectedWifi) {
+			wifi_ip_ready();
+		}
 		break;
 	}
 
 	case M2M_WIFI_RESP_PROVISION_INFO:
 	{
 		tstrM2MProvisionInfo *pstrProvInfo = (tstrM2MProvisionInfo *)pvMsg;
-		printf("wifi_cb: M2M_WIFI_RESP_PROVISION_INFO\r\n");
+		TRACE_INFO("wifi_cb: M2M_WIFI_RESP_PROVISION_INFO");
 
 		if (pstrProvInfo->u8Status == M2M_SUCCESS) {
 			m2m_wifi_connect((char *)pstrProvInfo->au8SSID, strlen((char *)pstrProvInfo->au8SSID), pstrProvInfo->u8SecType,
 					pstrProvInfo->au8Password, M2M_WIFI_CH_ALL);
 		} else {
-			printf("wifi_cb: provision failed!\r\n");
+			TRACE_ERR("wifi_cb: provision failed!");
 		}
 	}
 	break;
@@ -423,14 +486,33 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 	}
 }
 
-void request_weather(char *symbol){
+bool request_weather(uint16_t conn_handle, char *symbol){
 	if(symbol)
 	{
-		memset(city, 0, sizeof(city));
-		memcpy(city, symbol, strlen(symbol));
-		/*set a flag to request stock quote */
-		req_weather = true;
+		const weather_cache_entry_t *cached = weather_cache_find(symbol);
+
+		if (cached) {
+			TRACE_DBG("%s answered from cache", symbol);
+			quota_hit();
+			weather_reply(conn_handle, cached);
+			return true;
+		}
+		/* Without uplink, e.g. right after a reset, stale weather beats waiting;
+		   fresh weather is fetched behind it once the uplink is back */
+		cached = weather_uplink_ready() ? NULL : weather_cache_find_stale(symbol);
+		if (cached) {
+			TRACE_DBG("%s answered stale, no uplink", symbol);
+			weather_reply(conn_handle, cached);
+			req_queue_push(QUOTA_CONN_HANDLE, symbol);
+			return true;
+		}
+		/* Served from the main loop once the uplink is ready */
+		if (req_queue_push(conn_handle, symbol)) {
+			return true;
+		}
+		TRACE_WARN("request queue full, dropping %s", symbol);
 	}
+	return false;
 }
 
 /**
@@ -450,6 +532,7 @@ int main(void)
 
 	/* Initialize the board. */
 	system_init();
+	systime_init();
 	
 	/* Initialize the UART console. */
 //	configure_console();
@@ -458,15 +541,39 @@ int main(void)
 
 	/* Initialize the BSP. */
 	nm_bsp_init();
+	quota_init();
 
 	/* Initialize Wi-Fi parameters structure. */
 	memset((uint8_t *)&param, 0, sizeof(tstrWifiInitParam));
 
-	/* Initialize Wi-Fi driver with data and status callbacks. */
+	/* Last channel, server address and weather from before the reset */
+	if (warm_state_restore() && warm_state_net()->host_ip) {
+		gu32HostIp = warm_state_net()->host_ip;
+		gbHostIpByName = true;
+	}
+
+	/* Release the WINC1500 firmware. It boots on its own while the
+	   BTLC1000 patch is downloaded below. */
 	param.pfAppWifiCb = wifi_cb;
-	ret = m2m_wifi_init(&param);
+	ret = m2m_wifi_init_start(&param);
 	if (M2M_SUCCESS != ret) {
-		printf("main: m2m_wifi_init call error!(%d)\r\n", ret);
+		TRACE_ERR("main: m2m_wifi_init_start call error!(%d)", ret);
+		while (1) {
+		}
+	}
+
+	ble_device_init(NULL);
+	bulk_init();
+	observer_init();
+
+	/* Advertise right away; weather requests are queued until the uplink is ready. */
+	ble_app_state_set_start_adv();
+	ble_app_process();
+
+	/* Finish the Wi-Fi driver initialization with data and status callbacks. */
+	ret = m2m_wifi_init_finish();
+	if (M2M_SUCCESS != ret) {
+		TRACE_ERR("main: m2m_wifi_init call error!(%d)", ret);
 		while (1) {
 		}
 	}
@@ -492,42 +599,97 @@ int main(void)
 
 	/* Start web provisioning mode. */
 	//m2m_wifi_start_provision_mode((tstrM2MAPConfig *)&gstrM2MAPConfig, (char *)gacHttpProvDomainName, 1);
-	m2m_wifi_connect(MAIN_M2M_SSID, sizeof(MAIN_M2M_SSID),MAIN_M2M_SEC,MAIN_M2M_PASSWORD, M2M_WIFI_CH_ALL);
-	printf("connecting to %c\r\n", MAIN_M2M_SSID);
+	TRACE_INFO("connecting to %s", MAIN_M2M_SSID);
+	wifi_link_start(wifi_connect);
 	//printf("\r\nProvision Mode started.\r\nConnect to [%s] via AP[%s] and fill up the page.\r\n\r\n",
 	//		MAIN_HTTP_PROV_SERVER_DOMAIN_NAME, gstrM2MAPConfig.au8SSID);
 
-	ble_device_init(NULL);
-	
 	while (1) {
 		m2m_wifi_handle_events(NULL);
 		/* Handle BLE application states and process events */
 		ble_app_process();
+		idle_dispatched();
+
+		/* Serve queued requests one at a time once the uplink is ready */
+		if (weather_request_ready() && req_queue_pop(&cur_req, quota_ready())) {
+			const weather_cache_entry_t *cached = weather_refresh(cur_req.conn_handle) ?
+					NULL : weather_cache_find(cur_req.city);
+
+			/* Fetched meanwhile for another client, BLE or HTTP */
+			if (cached) {
+				quota_hit();
+				weather_reply(cur_req.conn_handle, cached);
+				continue;
+			}
 
-		if (gbConnectedWifi && !gbTcpConnection && req_weather) {
-			if (gbHostIpByName) {
-				req_weather = false;
-				/* Open TCP client socket. */
-				if (tcp_client_socket < 0) {
-					if ((tcp_client_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-						printf("main: failed to create TCP client socket error!\r\n");
-						continue;
-					}
-				}
+			cached = weather_cache_find_stale(cur_req.city);
+			switch (quota_decide(weather_background(cur_req.conn_handle), cached != NULL)) {
+			case QUOTA_DEFER:
+				req_queue_defer(&cur_req);
+				continue;
+
+			case QUOTA_SKIP:
+				continue;
 
-				/* Connect TCP client socket. */
-				addr_in.sin_family = AF_INET;
-				addr_in.sin_port = _htons(MAIN_SERVER_PORT);
-				addr_in.sin_addr.s_addr = gu32HostIp;
-				if (connect(tcp_client_socket, (struct sockaddr *)&addr_in, sizeof(struct sockaddr_in)) != SOCK_ERR_NO_ERROR) {
-					printf("main: failed to connect socket error!\r\n");
+			case QUOTA_STALE:
+				weather_reply(cur_req.conn_handle, cached);
+				continue;
+
+			case QUOTA_STALE_REVALIDATE:
+				/* The client has its answer; the fetch only updates the cache */
+				weather_reply(cur_req.conn_handle, cached);
+				cur_req.conn_handle = QUOTA_CONN_HANDLE;
+				break;
+
+			default:
+				break;
+			}
+
+			/* Open TCP client socket. */
+			if (tcp_client_socket < 0) {
+				if ((tcp_client_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+					TRACE_ERR("main: failed to create TCP client socket error!");
+					weather_reply_error();
 					continue;
 				}
+			}
 
-				gbTcpConnection = true;
+			/* Connect TCP client socket. */
+			addr_in.sin_family = AF_INET;
+			addr_in.sin_port = _htons(MAIN_SERVER_PORT);
+			addr_in.sin_addr.s_addr = gu32HostIp;
+			if (connect(tcp_client_socket, (struct sockaddr *)&addr_in, sizeof(struct sockaddr_in)) != SOCK_ERR_NO_ERROR) {
+				TRACE_ERR("main: failed to connect socket error!");
+				weather_reply_error();
+				continue;
 			}
+
+			gbTcpConnection = true;
 		}
-		
+
+		broadcast_task();
+		subscribe_task();
+		wifi_link_task();
+		tunnel_task();
+		bulk_task();
+		observer_task(gbConnectedWifi);
+		httpd_task(gbConnectedWifi);
+		publish_task(gbConnectedWifi);
+		mqtt_task(gbConnectedWifi);
+		quota_task(req_queue_deferred() != 0);
+
+		/* The BTLC1000 rate can only be renegotiated by a fresh initialization */
+		if (platform_host_link_failed() && platform_host_baudrate_fallback()) {
+			TRACE_WARN("main: BLE link errors, restarting at %d baud", (int)platform_host_baudrate());
+			warm_state_flush();
+			system_reset();
+		}
+		wifi_power_task(gbTcpConnection || tunnel_is_open() || observer_uploading() || httpd_busy());
+		warm_state_task();
+
+		/* Sleep until an interrupt or the next deadline unless a request can be served */
+		idle_enter(weather_request_ready() ||
+				!ble_app_is_idle() || tunnel_pending() || bulk_pending());
 	}
 
 	return 0;
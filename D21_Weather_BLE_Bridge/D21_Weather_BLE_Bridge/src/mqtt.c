@@ -0,0 +1,488 @@
+/**
+ * \file
+ *
+ * \brief MQTT 3.1.1 client publishing the bridge's telemetry.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "socket/include/socket.h"
+#include "strfmt.h"
+#include "systime.h"
+#include "idle.h"
+#include "wifi_link.h"
+#include "mqtt.h"
+#include "trace.h"
+
+#if (CONF_BRIDGE_MQTT == true)
+
+/* Control packet types, in the high nibble of the first byte */
+#define MQTT_CONNECT					0x10
+#define MQTT_CONNACK					0x20
+#define MQTT_PUBLISH					0x30
+#define MQTT_PINGREQ					0xC0
+#define MQTT_PINGRESP					0xD0
+/* Protocol level of 3.1.1 */
+#define MQTT_LEVEL						4
+#define MQTT_CLEAN_SESSION				0x02
+/* Longest fixed header: type and a 2 byte remaining length */
+#define MQTT_FIXED_HEADER_MAX			3
+
+_Static_assert(CONF_BRIDGE_MQTT_TX_BUF_SIZE <= SOCKET_BUFFER_MAX_LENGTH, "a batch is sent with one send()");
+_Static_assert(CONF_BRIDGE_MQTT_TX_BUF_SIZE < 16384, "remaining length is encoded in 2 bytes");
+
+typedef enum
+{
+	MQTT_OFF,
+	/* connect() issued */
+	MQTT_CONNECTING,
+	/* CONNECT sent, waiting for CONNACK */
+	MQTT_HANDSHAKE,
+	MQTT_UP,
+}mqtt_state_t;
+
+typedef enum
+{
+	MQTT_RX_TYPE,
+	MQTT_RX_LENGTH,
+	MQTT_RX_BODY,
+}mqtt_rx_stage_t;
+
+static mqtt_state_t mqtt_state = MQTT_OFF;
+static SOCKET mqtt_sock = -1;
+static uint32_t retry_ms;
+static uint32_t backoff_ms;
+
+/* Packed publishes not yet handed to the WINC */
+static uint8_t tx_buf[CONF_BRIDGE_MQTT_TX_BUF_SIZE];
+static uint16_t tx_len;
+static uint32_t tx_first_ms;
+/* A send() waits for SOCKET_MSG_SEND */
+static bool tx_sending;
+/* systime_ms() of the last PINGREQ */
+static uint32_t ping_ms;
+static uint32_t dropped;
+
+static uint8_t rx_buf[16];
+static mqtt_rx_stage_t rx_stage;
+static uint8_t rx_type;
+static uint16_t rx_len;
+static uint8_t rx_shift;
+static uint16_t rx_pos;
+/* First body bytes, enough for CONNACK */
+static uint8_t rx_body[2];
+static uint32_t last_rx_ms;
+
+static uint32_t metrics_ms;
+
+static uint16_t mqtt_put_str(uint8_t *p, const char *str, uint16_t len)
+{
+	p[0] = (uint8_t)(len >> 8);
+	p[1] = (uint8_t)len;
+	memcpy(&p[2], str, len);
+	return len + 2;
+}
+
+/* Fixed header; returns its length */
+static uint8_t mqtt_put_header(uint8_t *p, uint8_t type, uint16_t remaining)
+{
+	p[0] = type;
+	if (remaining < 128) {
+		p[1] = (uint8_t)remaining;
+		return 2;
+	}
+	p[1] = (uint8_t)(remaining | 0x80);
+	p[2] = (uint8_t)(remaining >> 7);
+	return 3;
+}
+
+static void mqtt_close(void)
+{
+	if (mqtt_sock >= 0) {
+		close(mqtt_sock);
+		mqtt_sock = -1;
+	}
+	mqtt_state = MQTT_OFF;
+	tx_sending = false;
+}
+
+/* Give up on the connection and try again after the backoff */
+static void mqtt_fail(const char *why)
+{
+	TRACE_WARN("mqtt: %s", why);
+	mqtt_close();
+	backoff_ms = backoff_ms ? backoff_ms * 2 : CONF_BRIDGE_MQTT_RETRY_MIN_MS;
+	if (backoff_ms > CONF_BRIDGE_MQTT_RETRY_MAX_MS) {
+		backoff_ms = CONF_BRIDGE_MQTT_RETRY_MAX_MS;
+	}
+	retry_ms = systime_ms() + backoff_ms;
+}
+
+static bool mqtt_send(const uint8_t *data, uint16_t len)
+{
+	if (send(mqtt_sock, (void *)data, len, 0) != SOCK_ERR_NO_ERROR) {
+		mqtt_fail("send failed");
+		return false;
+	}
+	tx_sending = true;
+	return true;
+}
+
+static void mqtt_flush(void)
+{
+	/* The WINC copied the data once send() returns */
+	if ((mqtt_state == MQTT_UP) && !tx_sending && tx_len && mqtt_send(tx_buf, tx_len)) {
+		tx_len = 0;
+	}
+}
+
+static void mqtt_send_connect(void)
+{
+	uint8_t packet[MQTT_FIXED_HEADER_MAX + 12 + sizeof(CONF_BRIDGE_MQTT_CLIENT_ID)];
+	uint16_t id_len = sizeof(CONF_BRIDGE_MQTT_CLIENT_ID) - 1;
+	uint16_t len;
+
+	len = mqtt_put_header(packet, MQTT_CONNECT, 10 + 2 + id_len);
+	len += mqtt_put_str(&packet[len], "MQTT", 4);
+	packet[len++] = MQTT_LEVEL;
+	packet[len++] = MQTT_CLEAN_SESSION;
+	packet[len++] = (uint8_t)(CONF_BRIDGE_MQTT_KEEPALIVE_S >> 8);
+	packet[len++] = (uint8_t)CONF_BRIDGE_MQTT_KEEPALIVE_S;
+	len += mqtt_put_str(&packet[len], CONF_BRIDGE_MQTT_CLIENT_ID, id_len);
+
+	if (mqtt_send(packet, len)) {
+		mqtt_state = MQTT_HANDSHAKE;
+	}
+}
+
+static void mqtt_packet(void)
+{
+	switch (rx_type & 0xF0) {
+	case MQTT_CONNACK:
+		if ((mqtt_state != MQTT_HANDSHAKE) || (rx_len != 2) || rx_body[1]) {
+			mqtt_fail("connection refused");
+			return;
+		}
+		mqtt_state = MQTT_UP;
+		backoff_ms = 0;
+		TRACE_INFO("mqtt: connected");
+		break;
+
+	case MQTT_PINGRESP:
+		break;
+
+	default:
+		/* Nothing is subscribed; anything else is dropped */
+		break;
+	}
+}
+
+static void mqtt_rx(const uint8_t *data, uint16_t len)
+{
+	last_rx_ms = systime_ms();
+	for (uint16_t i = 0; (i < len) && (mqtt_state != MQTT_OFF); i++) {
+		uint8_t b = data[i];
+
+		switch (rx_stage) {
+		case MQTT_RX_TYPE:
+			rx_type = b;
+			rx_len = 0;
+			rx_shift = 0;
+			rx_stage = MQTT_RX_LENGTH;
+			break;
+
+		case MQTT_RX_LENGTH:
+			if (rx_shift > 7) {
+				/* Longer than anything a broker sends us */
+				mqtt_fail("packet too long");
+				return;
+			}
+			rx_len |= (uint16_t)(b & 0x7F) << rx_shift;
+			rx_shift += 7;
+			if (!(b & 0x80)) {
+				rx_pos = 0;
+				if (rx_len) {
+					rx_stage = MQTT_RX_BODY;
+				} else {
+					rx_stage = MQTT_RX_TYPE;
+					mqtt_packet();
+				}
+			}
+			break;
+
+		default:
+			if (rx_pos < sizeof(rx_body)) {
+				rx_body[rx_pos] = b;
+			}
+			if (++rx_pos == rx_len) {
+				rx_stage = MQTT_RX_TYPE;
+				mqtt_packet();
+			}
+			break;
+		}
+	}
+}
+
+static void mqtt_connect(void)
+{
+	struct sockaddr_in addr_in;
+
+	if ((mqtt_sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		mqtt_fail("no socket");
+		return;
+	}
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_port = _htons(CONF_BRIDGE_MQTT_BROKER_PORT);
+	addr_in.sin_addr.s_addr = CONF_BRIDGE_MQTT_BROKER_IP;
+	if (connect(mqtt_sock, (struct sockaddr *)&addr_in, sizeof(addr_in)) != SOCK_ERR_NO_ERROR) {
+		mqtt_fail("connect failed");
+		return;
+	}
+	mqtt_state = MQTT_CONNECTING;
+	rx_stage = MQTT_RX_TYPE;
+	last_rx_ms = systime_ms();
+	ping_ms = last_rx_ms;
+}
+
+bool mqtt_publish(const char *topic, const uint8_t *payload, uint16_t len)
+{
+	uint16_t prefix_len = sizeof(CONF_BRIDGE_MQTT_TOPIC_PREFIX) - 1;
+	uint16_t topic_len = (uint16_t)strlen(topic);
+	uint16_t remaining = 2 + prefix_len + topic_len + len;
+	uint8_t *p;
+
+	if (MQTT_FIXED_HEADER_MAX + remaining > sizeof(tx_buf) - tx_len) {
+		/* Make room for the next one */
+		mqtt_flush();
+		if (MQTT_FIXED_HEADER_MAX + remaining > sizeof(tx_buf) - tx_len) {
+			dropped++;
+			return false;
+		}
+	}
+	if (!tx_len) {
+		tx_first_ms = systime_ms();
+	}
+
+	p = &tx_buf[tx_len];
+	p += mqtt_put_header(p, MQTT_PUBLISH, remaining);
+	*p++ = (uint8_t)((prefix_len + topic_len) >> 8);
+	*p++ = (uint8_t)(prefix_len + topic_len);
+	memcpy(p, CONF_BRIDGE_MQTT_TOPIC_PREFIX, prefix_len);
+	p += prefix_len;
+	memcpy(p, topic, topic_len);
+	p += topic_len;
+	memcpy(p, payload, len);
+	p += len;
+	tx_len = (uint16_t)(p - tx_buf);
+	return true;
+}
+
+/* Append text as one topic level, characters that don't belong there replaced by '_' */
+static void mqtt_topic_level(strfmt_t *sf, const char *level)
+{
+	for (; *level; level++) {
+		char c = *level;
+
+		/* Wildcards and level separators; controls and non-ASCII, as the text
+		   is not known to be valid UTF-8 and the broker would drop us for it */
+		if ((c == '+') || (c == '#') || (c == '/') || ((uint8_t)c < 0x20) || ((uint8_t)c >= 0x7f)) {
+			c = '_';
+		}
+		strfmt_mem(sf, &c, 1);
+	}
+}
+
+void mqtt_publish_weather(const weather_cache_entry_t *entry)
+{
+	char topic[8 + CONF_BRIDGE_CITY_SIZE];
+	char payload[48];
+	strfmt_t sf;
+
+	strfmt_init(&sf, topic, sizeof(topic));
+	strfmt_str(&sf, "weather/");
+	mqtt_topic_level(&sf, entry->city);
+
+	strfmt_init(&sf, payload, sizeof(payload));
+	strfmt_fixed(&sf, entry->temperature, TEMPERATURE_DECIMALS);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, entry->condition);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, entry->humidity);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, entry->pressure);
+	strfmt_str(&sf, ",");
+	strfmt_fixed(&sf, entry->wind_speed, WIND_SPEED_DECIMALS);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, entry->sunrise);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, entry->sunset);
+	mqtt_publish(topic, (const uint8_t *)payload, sf.len);
+}
+
+static void mqtt_publish_metrics(void)
+{
+	const wifi_link_stats_t *link = wifi_link_stats();
+	const idle_stats_t *idle = idle_stats();
+	char payload[64];
+	strfmt_t sf;
+
+	strfmt_init(&sf, payload, sizeof(payload));
+	strfmt_uint(&sf, systime_ms() / 1000);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, link->connects);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, link->max_outage_ms);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, idle->sleeps);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, idle->asleep_ms);
+	strfmt_str(&sf, ",");
+	strfmt_uint(&sf, dropped);
+	mqtt_publish("metrics", (const uint8_t *)payload, sf.len);
+}
+
+bool mqtt_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	if ((mqtt_sock < 0) || (sock != mqtt_sock)) {
+		return false;
+	}
+
+	switch (msg) {
+	case SOCKET_MSG_CONNECT:
+	{
+		tstrSocketConnectMsg *connect_msg = (tstrSocketConnectMsg *)msg_data;
+
+		if (!connect_msg || (connect_msg->s8Error < SOCK_ERR_NO_ERROR)) {
+			mqtt_fail("connect error");
+			break;
+		}
+		if (recv(mqtt_sock, rx_buf, sizeof(rx_buf), 0) != SOCK_ERR_NO_ERROR) {
+			mqtt_fail("recv failed");
+			break;
+		}
+		mqtt_send_connect();
+	}
+	break;
+
+	case SOCKET_MSG_SEND:
+		if (*(int16_t *)msg_data <= 0) {
+			mqtt_fail("send error");
+			break;
+		}
+		tx_sending = false;
+		break;
+
+	case SOCKET_MSG_RECV:
+	{
+		tstrSocketRecvMsg *recv_msg = (tstrSocketRecvMsg *)msg_data;
+
+		if (recv_msg->s16BufferSize <= 0) {
+			mqtt_fail("connection lost");
+			break;
+		}
+		mqtt_rx(recv_msg->pu8Buffer, recv_msg->s16BufferSize);
+		/* Read on once the last piece of this recv() is in */
+		if ((mqtt_state != MQTT_OFF) && !recv_msg->u16RemainingSize &&
+				(recv(mqtt_sock, rx_buf, sizeof(rx_buf), 0) != SOCK_ERR_NO_ERROR)) {
+			mqtt_fail("recv failed");
+		}
+	}
+	break;
+
+	default:
+		break;
+	}
+	return true;
+}
+
+void mqtt_task(bool uplink)
+{
+	uint32_t now = systime_ms();
+
+	if ((int32_t)(now - metrics_ms) >= 0) {
+		metrics_ms = now + CONF_BRIDGE_MQTT_METRICS_S * 1000ul;
+		mqtt_publish_metrics();
+	}
+	idle_wake_at(metrics_ms);
+
+	if (!uplink) {
+		if (mqtt_state != MQTT_OFF) {
+			mqtt_close();
+		}
+		return;
+	}
+
+	switch (mqtt_state) {
+	case MQTT_OFF:
+		if (!backoff_ms || ((int32_t)(now - retry_ms) >= 0)) {
+			mqtt_connect();
+		} else {
+			idle_wake_at(retry_ms);
+		}
+		break;
+
+	case MQTT_UP:
+		if ((now - last_rx_ms) >= CONF_BRIDGE_MQTT_KEEPALIVE_S * 1000ul) {
+			/* Not even a ping answered */
+			mqtt_fail("broker timed out");
+			break;
+		}
+		/* Ping half a keep-alive after the broker was last heard, publishes
+		   or not: QoS 0 publishes get no answer to keep last_rx_ms going */
+		if (((now - last_rx_ms) >= CONF_BRIDGE_MQTT_KEEPALIVE_S * 500ul) &&
+				((now - ping_ms) >= CONF_BRIDGE_MQTT_KEEPALIVE_S * 500ul)) {
+			if (tx_len) {
+				/* Drain the batch first, the ping follows once it is sent */
+				mqtt_flush();
+			} else if (!tx_sending) {
+				static const uint8_t pingreq[] = {MQTT_PINGREQ, 0};
+
+				if (mqtt_send(pingreq, sizeof(pingreq))) {
+					ping_ms = now;
+				}
+			}
+		}
+		if (tx_len && ((now - tx_first_ms) >= CONF_BRIDGE_MQTT_BATCH_MS)) {
+			mqtt_flush();
+		}
+		if (tx_len) {
+			idle_wake_at(tx_first_ms + CONF_BRIDGE_MQTT_BATCH_MS);
+		}
+		idle_wake_at((((int32_t)(ping_ms - last_rx_ms) > 0) ? ping_ms : last_rx_ms) +
+				CONF_BRIDGE_MQTT_KEEPALIVE_S * 500ul);
+		idle_wake_at(last_rx_ms + CONF_BRIDGE_MQTT_KEEPALIVE_S * 1000ul);
+		break;
+
+	default:
+		/* Waiting for the broker */
+		if ((now - last_rx_ms) >= CONF_BRIDGE_MQTT_KEEPALIVE_S * 1000ul) {
+			mqtt_fail("no answer");
+		} else {
+			idle_wake_at(last_rx_ms + CONF_BRIDGE_MQTT_KEEPALIVE_S * 1000ul);
+		}
+		break;
+	}
+}
+
+#else
+
+void mqtt_task(bool uplink)
+{
+}
+
+bool mqtt_publish(const char *topic, const uint8_t *payload, uint16_t len)
+{
+	return false;
+}
+
+void mqtt_publish_weather(const weather_cache_entry_t *entry)
+{
+}
+
+bool mqtt_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * \file
+ *
+ * \brief MQTT 3.1.1 client publishing the bridge's telemetry.
+ *
+ * Keeps one connection to CONF_BRIDGE_MQTT_BROKER_IP while the uplink is
+ * ready, with a clean session and keep-alive pings, and reconnects with
+ * a doubling backoff when it is lost. Only QoS 0 PUBLISH is sent. Point
+ * the broker address at any broker on the LAN, e.g. a mosquitto stand-in
+ * on a PC, to watch the traffic.
+ *
+ * Publishes are packed into one buffer and handed to the WINC with one
+ * send() once CONF_BRIDGE_MQTT_BATCH_MS passed or the buffer is full, so
+ * a burst of updates costs one TCP segment instead of one each. Payloads
+ * are short comma separated numbers in metric units: temperature in
+ * degrees Celsius, humidity in %, pressure in hPa, wind speed in m/s,
+ * sunrise and sunset in minutes after midnight UTC.
+ * \code
+ *   <prefix>weather/<city>   temperature,condition,humidity,pressure,wind speed,sunrise,sunset
+ *   <prefix>metrics          uptime s,wifi connects,max outage ms,sleeps,asleep ms,dropped publishes
+ * \endcode
+ * The city is the one asked by the client, with '+', '#', '/', control
+ * and non-ASCII characters replaced by '_' so it stays a single level.
+ * Publishes made while the broker is unreachable are kept until the
+ * buffer is full, then dropped.
+ *
+ * Checking the client against mosquitto on a PC of the same LAN:
+ * -# mosquitto 2 only listens on localhost by default; start it with
+ *    \c mosquitto -v -c bridge.conf and this bridge.conf:
+ *    \code
+ *      listener 1883 0.0.0.0
+ *      allow_anonymous true
+ *    \endcode
+ * -# Set CONF_BRIDGE_MQTT to true and CONF_BRIDGE_MQTT_BROKER_IP to the
+ *    PC's address, keep the port at 1883, build and flash.
+ * -# Watch every topic of the bridge:
+ *    \code
+ *      mosquitto_sub -h <pc> -v -t 'bridge/#'
+ *    \endcode
+ * -# Ask for a city over BLE, or over HTTP with
+ *    \c curl \c 'http://<bridge>/weather?city=paris'.
+ *
+ * The mosquitto log shows a CONNECT from \c weather-bridge with clean
+ * session and keep-alive 60, then a PINGREQ every 30 s, publishes or not.
+ * Within CONF_BRIDGE_MQTT_BATCH_MS of the answer, and every
+ * CONF_BRIDGE_MQTT_METRICS_S, mosquitto_sub prints lines like:
+ * \code
+ *   bridge/weather/paris 14.25,803,72,1016,4.1,375,1176
+ *   bridge/metrics 120,1,0,57,110342,0
+ * \endcode
+ * Stopping mosquitto makes the bridge reconnect with a growing delay;
+ * publishes made meanwhile arrive after the reconnect.
+ *
+ */
+
+#ifndef MQTT_H_INCLUDED
+#define MQTT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+#include "weather_cache.h"
+
+/** @brief Keep the connection and flush publishes when due. Call from the main loop.
+  *
+  * @param[in] uplink	The Wi-Fi uplink is ready
+  */
+void mqtt_task(bool uplink);
+
+/** @brief Queue a QoS 0 publish
+  *
+  * @param[in] topic	Topic below CONF_BRIDGE_MQTT_TOPIC_PREFIX
+  * @param[in] payload	Payload
+  * @param[in] len		Payload length
+  *
+  * @return false if it was dropped for lack of room
+  */
+bool mqtt_publish(const char *topic, const uint8_t *payload, uint16_t len);
+
+/** @brief Publish fresh weather of a city */
+void mqtt_publish_weather(const weather_cache_entry_t *entry);
+
+/** @brief Socket event, from the socket callback
+  *
+  * @return false if the socket is not the client's
+  */
+bool mqtt_socket_cb(int8_t sock, uint8_t msg, void *msg_data);
+
+#endif /* MQTT_H_INCLUDED */
@@ -0,0 +1,93 @@
+/**
+ * \file
+ *
+ * \brief Station IP addressing: DHCP, static, or reuse of the saved lease.
+ *
+ */
+
+#include <asf.h>
+#include "warm_state.h"
+#include "net_addr.h"
+#include "trace.h"
+
+/* Address applied without DHCP for the current association */
+static bool net_addr_assumed;
+
+#if (CONF_BRIDGE_IP_MODE == BRIDGE_IP_REUSE_LEASE)
+/* The saved lease failed; use DHCP until a new one is granted */
+static bool net_addr_reuse_failed;
+
+static bool net_addr_reuse_allowed(void)
+{
+	const tstrM2MIPConfig *lease = &warm_state_net()->lease;
+
+	if (net_addr_reuse_failed || (lease->u32StaticIP == 0)) {
+		return false;
+	}
+	/* Renew at half the lease time, as a DHCP client would */
+	return warm_state_lease_age_s() < (lease->u32DhcpLeaseTime / 2);
+}
+#endif
+
+void net_addr_prepare(void)
+{
+#if (CONF_BRIDGE_IP_MODE == BRIDGE_IP_STATIC)
+	net_addr_assumed = true;
+#elif (CONF_BRIDGE_IP_MODE == BRIDGE_IP_REUSE_LEASE)
+	net_addr_assumed = net_addr_reuse_allowed();
+#else
+	net_addr_assumed = false;
+#endif
+	m2m_wifi_enable_dhcp(net_addr_assumed ? 0 : 1);
+}
+
+bool net_addr_link_up(void)
+{
+	tstrM2MIPConfig conf;
+
+	if (!net_addr_assumed) {
+		return false;
+	}
+
+#if (CONF_BRIDGE_IP_MODE == BRIDGE_IP_STATIC)
+	conf.u32StaticIP = CONF_BRIDGE_STATIC_IP;
+	conf.u32Gateway = CONF_BRIDGE_STATIC_GATEWAY;
+	conf.u32SubnetMask = CONF_BRIDGE_STATIC_NETMASK;
+	conf.u32DNS = CONF_BRIDGE_STATIC_DNS;
+	conf.u32AlternateDNS = 0;
+	conf.u32DhcpLeaseTime = 0;
+#else
+	conf = warm_state_net()->lease;
+#endif
+	TRACE_INFO("using address %d.%d.%d.%d without DHCP",
+			(int)(conf.u32StaticIP & 0xFF), (int)((conf.u32StaticIP >> 8) & 0xFF),
+			(int)((conf.u32StaticIP >> 16) & 0xFF), (int)(conf.u32StaticIP >> 24));
+	/* Byte-swapped in place on big endian hosts, hence the copy */
+	m2m_wifi_set_static_ip(&conf);
+	return true;
+}
+
+void net_addr_lease(const tstrM2MIPConfig *lease)
+{
+	if (net_addr_assumed) {
+		/* Echo of the address applied in net_addr_link_up() */
+		return;
+	}
+	warm_state_set_lease(lease);
+#if (CONF_BRIDGE_IP_MODE == BRIDGE_IP_REUSE_LEASE)
+	net_addr_reuse_failed = false;
+#endif
+}
+
+void net_addr_uplink_failed(void)
+{
+#if (CONF_BRIDGE_IP_MODE == BRIDGE_IP_REUSE_LEASE)
+	if (net_addr_assumed) {
+		TRACE_WARN("saved lease failed, falling back to DHCP");
+		net_addr_reuse_failed = true;
+		net_addr_assumed = false;
+		/* The disconnect event makes wifi_link associate again */
+		m2m_wifi_disconnect();
+	}
+#endif
+}
@@ -0,0 +1,45 @@
+/**
+ * \file
+ *
+ * \brief Station IP addressing: DHCP, static, or reuse of the saved lease.
+ *
+ * With CONF_BRIDGE_IP_MODE set to BRIDGE_IP_STATIC or BRIDGE_IP_REUSE_LEASE
+ * the WINC DHCP client is turned off and an address is applied as soon as
+ * the link comes up, so sockets can be opened without waiting for DHCP.
+ *
+ * A reused lease is only trusted until half its lease time has passed, and
+ * only until the uplink fails while using it. After that the next
+ * association runs DHCP again. The age of a lease kept over a warm reset
+ * is saved with it; after a power cycle the time off is unknown, so the
+ * first association runs DHCP.
+ *
+ */
+
+#ifndef NET_ADDR_H_INCLUDED
+#define NET_ADDR_H_INCLUDED
+
+#include <stdbool.h>
+#include "driver/include/m2m_wifi.h"
+#include "conf_bridge.h"
+
+/** @brief Select DHCP or not for the next association. Call before every m2m_wifi_connect(). */
+void net_addr_prepare(void);
+
+/** @brief Apply the address once M2M_WIFI_CONNECTED is reported
+  *
+  * @return true if an address is in place and sockets can be used now,
+  *         false if M2M_WIFI_REQ_DHCP_CONF has to be waited for
+  */
+bool net_addr_link_up(void);
+
+/** @brief Record a lease from M2M_WIFI_REQ_DHCP_CONF */
+void net_addr_lease(const tstrM2MIPConfig *lease);
+
+/** @brief Report that the uplink failed
+  *
+  * If a reused lease is in place, it is dropped and the link is
+  * re-associated with DHCP.
+  */
+void net_addr_uplink_failed(void);
+
+#endif /* NET_ADDR_H_INCLUDED */
@@ -0,0 +1,527 @@
+/**
+ * \file
+ *
+ * \brief Collect readings of nearby BLE temperature tags and upload them.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "socket/include/socket.h"
+#include "at_ble_api.h"
+#include "ble_manager.h"
+#include "strfmt.h"
+#include "systime.h"
+#include "idle.h"
+#include "wifi_power.h"
+#include "weather_cache.h"
+#include "observer.h"
+#include "trace.h"
+
+#if (CONF_BRIDGE_OBSERVER == true)
+
+#define OBSERVER_AD_TYPE_MANUFACTURER	0xFF
+/* type | company id(2) | format | temperature(2) | battery */
+#define OBSERVER_TAG_AD_LEN				7
+#define OBSERVER_NO_TAG					0xFF
+#define OBSERVER_TAG_MASK				(CONF_BRIDGE_OBSERVER_TAGS - 1)
+/* Longest header and body line of the POST */
+#define OBSERVER_HEADER_MAX				(192)
+#define OBSERVER_LINE_MAX				(48)
+/* Wait before starting the scan again after it failed or ended, in ms */
+#define OBSERVER_SCAN_RETRY_MS			(2000)
+/* Only the status line of the response is read */
+#define OBSERVER_RESPONSE_SIZE			(16)
+
+_Static_assert(!(CONF_BRIDGE_OBSERVER_TAGS & OBSERVER_TAG_MASK), "tag set size must be a power of two");
+_Static_assert(CONF_BRIDGE_OBSERVER_TAGS < OBSERVER_NO_TAG, "tag index must fit a byte");
+_Static_assert(OBSERVER_HEADER_MAX + CONF_BRIDGE_OBSERVER_TAGS * OBSERVER_LINE_MAX <= CONF_BRIDGE_OBSERVER_POST_SIZE,
+		"every tag must fit one POST");
+_Static_assert(CONF_BRIDGE_OBSERVER_POST_SIZE <= SOCKET_BUFFER_MAX_LENGTH, "a POST is sent with one send()");
+_Static_assert(CONF_BRIDGE_OBSERVER_SCAN_S < CONF_BRIDGE_OBSERVER_UPLOAD_S, "the scan must end before the next one starts");
+
+typedef struct
+{
+	uint8_t addr[AT_BLE_ADDR_LEN];
+	bool used;
+	/* Heard since it was last put in a batch */
+	bool dirty;
+	/* In the batch being uploaded */
+	bool in_batch;
+	int8_t rssi;
+	uint8_t battery;
+	int16_t temperature;
+	/* systime_ms() of the latest reading */
+	uint32_t heard_ms;
+}observer_tag_t;
+
+typedef enum
+{
+	OBSERVER_IDLE,
+	/* connect() issued */
+	OBSERVER_CONNECTING,
+	/* POST handed to send() */
+	OBSERVER_SENDING,
+	/* recv() of the status line issued */
+	OBSERVER_RECEIVING,
+}observer_state_t;
+
+/* Open addressing set keyed by address, linear probing */
+static observer_tag_t observer_tags[CONF_BRIDGE_OBSERVER_TAGS];
+
+static bool observer_scanning;
+static uint32_t scan_try_ms;
+static bool scan_tried;
+
+static observer_state_t observer_state = OBSERVER_IDLE;
+static SOCKET observer_sock = -1;
+static uint32_t last_upload_ms;
+static char post_buf[CONF_BRIDGE_OBSERVER_POST_SIZE];
+static uint8_t response[OBSERVER_RESPONSE_SIZE];
+
+static observer_stats_t observer_stat;
+
+static at_ble_status_t observer_scan_info(void *param);
+static at_ble_status_t observer_scan_report(void *param);
+
+static const ble_gap_event_cb_t observer_gap_event = {
+	.scan_info = observer_scan_info,
+	.scan_report = observer_scan_report,
+};
+
+static uint8_t observer_hash(const uint8_t *addr)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261ul;
+
+	for (uint8_t i = 0; i < AT_BLE_ADDR_LEN; i++) {
+		hash ^= addr[i];
+		hash *= 16777619ul;
+	}
+	return (uint8_t)(hash & OBSERVER_TAG_MASK);
+}
+
+/* Slot of a tag, added if asked and there is room; OBSERVER_NO_TAG otherwise */
+static uint8_t observer_slot(const uint8_t *addr, bool add)
+{
+	uint8_t i = observer_hash(addr);
+
+	for (uint8_t n = 0; n < CONF_BRIDGE_OBSERVER_TAGS; n++) {
+		observer_tag_t *tag = &observer_tags[i];
+
+		if (!tag->used) {
+			if (!add) {
+				break;
+			}
+			memset(tag, 0, sizeof(*tag));
+			memcpy(tag->addr, addr, AT_BLE_ADDR_LEN);
+			tag->used = true;
+			return i;
+		}
+		if (!memcmp(tag->addr, addr, AT_BLE_ADDR_LEN)) {
+			return i;
+		}
+		i = (i + 1) & OBSERVER_TAG_MASK;
+	}
+	return OBSERVER_NO_TAG;
+}
+
+/* Free a slot, moving later tags of the probe run into the hole */
+static void observer_remove(uint8_t hole)
+{
+	uint8_t i = hole;
+
+	observer_tags[hole].used = false;
+	for (;;) {
+		uint8_t home;
+
+		i = (i + 1) & OBSERVER_TAG_MASK;
+		if (!observer_tags[i].used) {
+			break;
+		}
+		home = observer_hash(observer_tags[i].addr);
+		/* Movable unless its home lies between the hole and itself */
+		if (((i - home) & OBSERVER_TAG_MASK) >= ((i - hole) & OBSERVER_TAG_MASK)) {
+			observer_tags[hole] = observer_tags[i];
+			observer_tags[i].used = false;
+			hole = i;
+		}
+	}
+}
+
+static void observer_expire(uint32_t now)
+{
+	for (uint8_t i = 0; i < CONF_BRIDGE_OBSERVER_TAGS; i++) {
+		/* A removal may move a later tag here; look at the slot again */
+		while (observer_tags[i].used &&
+				((now - observer_tags[i].heard_ms) >= CONF_BRIDGE_OBSERVER_TAG_TTL_S * 1000ul)) {
+			observer_remove(i);
+		}
+	}
+}
+
+/* Tag manufacturer data of an advertisement, NULL if there is none */
+static const uint8_t *observer_tag_data(const at_ble_scan_info_t *info)
+{
+	uint8_t index = 0;
+
+	while ((index + 1) < info->adv_data_len) {
+		uint8_t len = info->adv_data[index];
+		const uint8_t *ad = &info->adv_data[index + 1];
+
+		if (!len || ((index + 1 + len) > info->adv_data_len)) {
+			break;
+		}
+		if ((len >= OBSERVER_TAG_AD_LEN) && (ad[0] == OBSERVER_AD_TYPE_MANUFACTURER) &&
+				(ad[1] == (uint8_t)CONF_BRIDGE_OBSERVER_COMPANY_ID) &&
+				(ad[2] == (uint8_t)(CONF_BRIDGE_OBSERVER_COMPANY_ID >> 8)) &&
+				(ad[3] == OBSERVER_TAG_FORMAT)) {
+			return &ad[4];
+		}
+		index += len + 1;
+	}
+	return NULL;
+}
+
+static at_ble_status_t observer_scan_info(void *param)
+{
+	at_ble_scan_info_t *info = (at_ble_scan_info_t *)param;
+	const uint8_t *data = observer_tag_data(info);
+	observer_tag_t *tag;
+	uint8_t slot;
+
+	if (!data) {
+		return AT_BLE_SUCCESS;
+	}
+	slot = observer_slot(info->dev_addr.addr, true);
+	if (slot == OBSERVER_NO_TAG) {
+		observer_stat.dropped++;
+		return AT_BLE_SUCCESS;
+	}
+	/* Only the latest reading is kept */
+	tag = &observer_tags[slot];
+	tag->temperature = (int16_t)(data[0] | (data[1] << 8));
+	tag->battery = data[2];
+	tag->rssi = info->rssi;
+	tag->heard_ms = systime_ms();
+	tag->dirty = true;
+	observer_stat.reports++;
+	return AT_BLE_SUCCESS;
+}
+
+static at_ble_status_t observer_scan_report(void *param)
+{
+	at_ble_scan_report_t *report = (at_ble_scan_report_t *)param;
+
+	/* The scan ended; observer_task() starts it again */
+	if (observer_scanning) {
+		TRACE_WARN("observer: scan ended (%x)", report->status);
+		observer_scanning = false;
+	}
+	return AT_BLE_SUCCESS;
+}
+
+static void observer_scan(uint32_t now)
+{
+	at_ble_status_t status;
+
+	if (observer_scanning) {
+		return;
+	}
+	if (scan_tried && ((now - scan_try_ms) < OBSERVER_SCAN_RETRY_MS)) {
+		idle_wake_at(scan_try_ms + OBSERVER_SCAN_RETRY_MS);
+		return;
+	}
+	scan_tried = true;
+	scan_try_ms = now;
+	/* Passive: tags are not asked for scan responses */
+	status = at_ble_scan_start(CONF_BRIDGE_OBSERVER_SCAN_INTERVAL, CONF_BRIDGE_OBSERVER_SCAN_WINDOW, 0,
+			AT_BLE_SCAN_PASSIVE, AT_BLE_SCAN_OBSERVER_MODE, false, false);
+	if (status == AT_BLE_SUCCESS) {
+		observer_scanning = true;
+	} else {
+		TRACE_WARN("observer: scan not started (%x)", status);
+		idle_wake_at(scan_try_ms + OBSERVER_SCAN_RETRY_MS);
+	}
+}
+
+static void observer_scan_stop(void)
+{
+	at_ble_status_t status;
+
+	if (!observer_scanning) {
+		return;
+	}
+	/* Cleared first, so the scan report that follows is not taken for a failure */
+	observer_scanning = false;
+	scan_tried = false;
+	status = at_ble_scan_stop();
+	if (status != AT_BLE_SUCCESS) {
+		TRACE_WARN("observer: scan not stopped (%x)", status);
+	}
+}
+
+static void observer_line(strfmt_t *sf, const observer_tag_t *tag, uint32_t now)
+{
+	static const char hex[] = "0123456789abcdef";
+	char addr[3 * AT_BLE_ADDR_LEN];
+
+	/* Most significant byte first, as printed on the tag */
+	for (uint8_t i = 0; i < AT_BLE_ADDR_LEN; i++) {
+		uint8_t byte = tag->addr[AT_BLE_ADDR_LEN - 1 - i];
+
+		addr[3 * i] = hex[byte >> 4];
+		addr[3 * i + 1] = hex[byte & 0x0f];
+		addr[3 * i + 2] = ':';
+	}
+	strfmt_mem(sf, addr, sizeof(addr) - 1);
+	strfmt_str(sf, ",");
+	strfmt_fixed(sf, tag->temperature, TEMPERATURE_DECIMALS);
+	strfmt_str(sf, ",");
+	strfmt_uint(sf, tag->battery);
+	strfmt_str(sf, ",");
+	strfmt_fixed(sf, tag->rssi, 0);
+	strfmt_str(sf, ",");
+	strfmt_uint(sf, (now - tag->heard_ms) / 1000);
+	strfmt_str(sf, "\r\n");
+}
+
+/* Put every tag heard since the last batch in one POST; returns its length, 0 if none */
+static uint16_t observer_build(uint8_t *count)
+{
+	strfmt_t head;
+	strfmt_t body;
+	uint32_t now = systime_ms();
+	uint32_t host = CONF_BRIDGE_OBSERVER_HOST_IP;
+
+	*count = 0;
+	/* Body first, behind the room kept for the header */
+	strfmt_init(&body, &post_buf[OBSERVER_HEADER_MAX], sizeof(post_buf) - OBSERVER_HEADER_MAX);
+	for (uint8_t i = 0; i < CONF_BRIDGE_OBSERVER_TAGS; i++) {
+		observer_tag_t *tag = &observer_tags[i];
+
+		if (tag->used && tag->dirty) {
+			observer_line(&body, tag, now);
+			tag->dirty = false;
+			tag->in_batch = true;
+			(*count)++;
+		}
+	}
+	if (!*count) {
+		return 0;
+	}
+
+	strfmt_init(&head, post_buf, OBSERVER_HEADER_MAX);
+	strfmt_str(&head, "POST " CONF_BRIDGE_OBSERVER_PATH " HTTP/1.1\r\n"
+			"Host: ");
+	/* Dotted quad of the address, lowest byte first */
+	for (uint8_t i = 0; i < 4; i++) {
+		strfmt_uint(&head, (host >> (8 * i)) & 0xff);
+		strfmt_str(&head, (i < 3) ? "." : "\r\n");
+	}
+	strfmt_str(&head, "Content-Type: text/csv\r\n"
+			"Connection: close\r\n"
+			"Content-Length: ");
+	strfmt_uint(&head, body.len);
+	strfmt_str(&head, "\r\n\r\n");
+	if (head.overflow || body.overflow) {
+		TRACE_ERR("observer: POST too long");
+		return 0;
+	}
+	memmove(&post_buf[head.len], &post_buf[OBSERVER_HEADER_MAX], body.len);
+	return head.len + body.len;
+}
+
+/* End the upload; tags of a failed batch go in the next one */
+static void observer_finish(bool ok)
+{
+	uint8_t count = 0;
+
+	for (uint8_t i = 0; i < CONF_BRIDGE_OBSERVER_TAGS; i++) {
+		observer_tag_t *tag = &observer_tags[i];
+
+		if (tag->used && tag->in_batch) {
+			tag->in_batch = false;
+			if (!ok) {
+				tag->dirty = true;
+			}
+			count++;
+		}
+	}
+	if (ok) {
+		observer_stat.uploads++;
+		observer_stat.uploaded_tags += count;
+	} else {
+		observer_stat.failures++;
+	}
+	TRACE_INFO("observer: %u tags %s", count, ok ? "uploaded" : "kept for the next upload");
+
+	if (observer_sock >= 0) {
+		close(observer_sock);
+		observer_sock = -1;
+	}
+	observer_state = OBSERVER_IDLE;
+}
+
+static void observer_upload(void)
+{
+	struct sockaddr_in addr_in;
+
+	if ((observer_sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		TRACE_WARN("observer: no socket");
+		return;
+	}
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_port = _htons(CONF_BRIDGE_OBSERVER_PORT);
+	addr_in.sin_addr.s_addr = CONF_BRIDGE_OBSERVER_HOST_IP;
+	if (connect(observer_sock, (struct sockaddr *)&addr_in, sizeof(addr_in)) != SOCK_ERR_NO_ERROR) {
+		TRACE_WARN("observer: connect failed");
+		close(observer_sock);
+		observer_sock = -1;
+		return;
+	}
+	observer_state = OBSERVER_CONNECTING;
+}
+
+bool observer_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	if ((observer_sock < 0) || (sock != observer_sock)) {
+		return false;
+	}
+
+	switch (msg) {
+	case SOCKET_MSG_CONNECT:
+	{
+		tstrSocketConnectMsg *connect_msg = (tstrSocketConnectMsg *)msg_data;
+		uint8_t count;
+		uint16_t len;
+
+		if (!connect_msg || (connect_msg->s8Error < SOCK_ERR_NO_ERROR)) {
+			TRACE_WARN("observer: connect error");
+			/* Nothing was taken from the tags yet */
+			close(observer_sock);
+			observer_sock = -1;
+			observer_state = OBSERVER_IDLE;
+			observer_stat.failures++;
+			break;
+		}
+		/* Built now so that readings heard while connecting go along */
+		len = observer_build(&count);
+		if (!len || (send(observer_sock, post_buf, len, 0) != SOCK_ERR_NO_ERROR)) {
+			observer_finish(false);
+			break;
+		}
+		observer_state = OBSERVER_SENDING;
+	}
+	break;
+
+	case SOCKET_MSG_SEND:
+		if (*(int16_t *)msg_data <= 0) {
+			observer_finish(false);
+		} else if (recv(observer_sock, response, sizeof(response), CONF_BRIDGE_OBSERVER_TIMEOUT_MS) == SOCK_ERR_NO_ERROR) {
+			observer_state = OBSERVER_RECEIVING;
+		} else {
+			observer_finish(false);
+		}
+		break;
+
+	case SOCKET_MSG_RECV:
+	{
+		tstrSocketRecvMsg *recv_msg = (tstrSocketRecvMsg *)msg_data;
+
+		if (observer_state != OBSERVER_RECEIVING) {
+			break;
+		}
+		/* "HTTP/1.1 2xx"; the rest of the response is dropped with the socket */
+		observer_finish((recv_msg->s16BufferSize >= 10) && !memcmp(recv_msg->pu8Buffer, "HTTP/1.", 7) &&
+				(recv_msg->pu8Buffer[9] == '2'));
+	}
+	break;
+
+	default:
+		break;
+	}
+	return true;
+}
+
+void observer_init(void)
+{
+	ble_mgr_events_callback_handler(REGISTER_CALL_BACK, BLE_GAP_EVENT_TYPE, &observer_gap_event);
+}
+
+void observer_task(bool uplink)
+{
+	uint32_t now = systime_ms();
+	uint32_t due_ms = last_upload_ms + CONF_BRIDGE_OBSERVER_UPLOAD_S * 1000ul;
+	uint32_t scan_ms = due_ms - CONF_BRIDGE_OBSERVER_SCAN_S * 1000ul;
+
+	/* Scan from shortly before an upload until it starts */
+	if ((int32_t)(now - scan_ms) >= 0) {
+		observer_scan(now);
+	} else {
+		observer_scan_stop();
+		idle_wake_at(scan_ms);
+	}
+
+	if (observer_state != OBSERVER_IDLE) {
+		return;
+	}
+	observer_expire(now);
+
+	if ((int32_t)(now - due_ms) < 0) {
+		/* Wake up, with the WINC ready, for the next upload */
+		idle_wake_at(due_ms);
+		wifi_power_schedule(due_ms);
+		return;
+	}
+	/* The Wi-Fi events wake the loop once the uplink is back */
+	if (!uplink) {
+		return;
+	}
+	last_upload_ms = now;
+	for (uint8_t i = 0; i < CONF_BRIDGE_OBSERVER_TAGS; i++) {
+		if (observer_tags[i].used && observer_tags[i].dirty) {
+			observer_upload();
+			break;
+		}
+	}
+}
+
+bool observer_uploading(void)
+{
+	return observer_state != OBSERVER_IDLE;
+}
+
+const observer_stats_t *observer_stats(void)
+{
+	return &observer_stat;
+}
+
+#else
+
+void observer_init(void)
+{
+}
+
+void observer_task(bool uplink)
+{
+}
+
+bool observer_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	return false;
+}
+
+bool observer_uploading(void)
+{
+	return false;
+}
+
+const observer_stats_t *observer_stats(void)
+{
+	static const observer_stats_t none;
+
+	return &none;
+}
+
+#endif
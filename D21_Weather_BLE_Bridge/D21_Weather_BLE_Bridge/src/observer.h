@@ -0,0 +1,77 @@
+/**
+ * \file
+ *
+ * \brief Collect readings of nearby BLE temperature tags and upload them.
+ *
+ * The bridge scans passively next to its peripheral role and picks the
+ * readings of temperature tags out of their advertisements. The scan only
+ * runs for CONF_BRIDGE_OBSERVER_SCAN_S before each upload, so the BTLC1000
+ * and the core can sleep the rest of the time. Reports are
+ * deduplicated by address in a small hash set that keeps the latest
+ * reading per tag, so the cost of a tag does not depend on how often it
+ * advertises. Every CONF_BRIDGE_OBSERVER_UPLOAD_S all tags heard since the
+ * last upload go to CONF_BRIDGE_OBSERVER_HOST_IP in one HTTP POST on one
+ * connection, however many tags there are.
+ *
+ * Tag advertisement, manufacturer specific data (little endian):
+ * \code
+ *   len | 0xFF | company id(2) | format | temperature(2) | battery
+ * \endcode
+ * \c company id is CONF_BRIDGE_OBSERVER_COMPANY_ID, \c format is
+ * @ref OBSERVER_TAG_FORMAT, the temperature is signed and scaled by
+ * 10^TEMPERATURE_DECIMALS in degrees Celsius, the battery is in percent.
+ *
+ * POST body, one line per tag:
+ * \code
+ *   address,temperature,battery,rssi,age in s
+ *   c0:11:22:33:44:55,21.50,87,-71,4
+ * \endcode
+ * Tags not heard for CONF_BRIDGE_OBSERVER_TAG_TTL_S are forgotten.
+ *
+ */
+
+#ifndef OBSERVER_H_INCLUDED
+#define OBSERVER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Tag payload format; other formats with the same company id are ignored */
+#define OBSERVER_TAG_FORMAT				0x10
+
+typedef struct
+{
+	/* Advertisements from tags taken */
+	uint32_t reports;
+	/* New tags refused because the set was full */
+	uint32_t dropped;
+	/* Batches accepted by the server, and tag readings in them */
+	uint32_t uploads;
+	uint32_t uploaded_tags;
+	/* Batches that failed and were kept for the next upload */
+	uint32_t failures;
+}observer_stats_t;
+
+/** @brief Register the scan event handlers. Call after ble_device_init(). */
+void observer_init(void);
+
+/** @brief Keep the scan running and upload when due. Call from the main loop.
+  *
+  * @param[in] uplink	The Wi-Fi uplink is ready
+  */
+void observer_task(bool uplink);
+
+/** @brief Socket event, from the socket callback
+  *
+  * @return false if the socket is not the observer's
+  */
+bool observer_socket_cb(int8_t sock, uint8_t msg, void *msg_data);
+
+/** @brief An upload is in flight */
+bool observer_uploading(void);
+
+/** @brief Tags, uploads and failures so far */
+const observer_stats_t *observer_stats(void);
+
+#endif /* OBSERVER_H_INCLUDED */
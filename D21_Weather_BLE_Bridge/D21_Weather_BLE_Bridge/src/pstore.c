@@ -0,0 +1,158 @@
+/**
+ * \file
+ *
+ * \brief Wear-levelled, CRC-protected record store in internal flash.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "pstore.h"
+
+#define PSTORE_BASE				(FLASH_ADDR + FLASH_SIZE - CONF_PSTORE_ROWS * PSTORE_ROW_SIZE)
+#define PSTORE_MAGIC			0x5053
+
+/* Row holding the newest record, CONF_PSTORE_ROWS if there is none */
+static uint8_t pstore_row = CONF_PSTORE_ROWS;
+static uint32_t pstore_seq;
+
+static inline const pstore_hdr_t *pstore_hdr(uint8_t row)
+{
+	return (const pstore_hdr_t *)(PSTORE_BASE + (uint32_t)row * PSTORE_ROW_SIZE);
+}
+
+static uint16_t pstore_crc(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+	while (len--) {
+		crc ^= (uint16_t)*data++ << 8;
+		for (uint8_t bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static uint16_t pstore_record_crc(uint16_t len, uint32_t seq, const void *data)
+{
+	uint16_t crc = pstore_crc(0xFFFF, (const uint8_t *)&len, sizeof(len));
+
+	crc = pstore_crc(crc, (const uint8_t *)&seq, sizeof(seq));
+	return pstore_crc(crc, (const uint8_t *)data, len);
+}
+
+static bool pstore_row_valid(uint8_t row)
+{
+	const pstore_hdr_t *hdr = pstore_hdr(row);
+
+	return (hdr->magic == PSTORE_MAGIC) && (hdr->len <= PSTORE_DATA_MAX) &&
+			(hdr->crc == pstore_record_crc(hdr->len, hdr->seq, hdr + 1));
+}
+
+/* Find the newest valid row once */
+static void pstore_scan(void)
+{
+	static bool scanned = false;
+
+	if (scanned) {
+		return;
+	}
+	scanned = true;
+
+	for (uint8_t row = 0; row < CONF_PSTORE_ROWS; row++) {
+		if (!pstore_row_valid(row)) {
+			continue;
+		}
+		if ((pstore_row == CONF_PSTORE_ROWS) || ((int32_t)(pstore_hdr(row)->seq - pstore_seq) > 0)) {
+			pstore_row = row;
+			pstore_seq = pstore_hdr(row)->seq;
+		}
+	}
+}
+
+static bool pstore_nvm_command(uint32_t addr, uint32_t cmd)
+{
+	while (!(NVMCTRL->INTFLAG.reg & NVMCTRL_INTFLAG_READY));
+	NVMCTRL->STATUS.reg = NVMCTRL_STATUS_MASK;
+	/* ADDR is in 16-bit words */
+	NVMCTRL->ADDR.reg = addr / 2;
+	NVMCTRL->CTRLA.reg = cmd | NVMCTRL_CTRLA_CMDEX_KEY;
+	while (!(NVMCTRL->INTFLAG.reg & NVMCTRL_INTFLAG_READY));
+
+	return !(NVMCTRL->STATUS.reg & (NVMCTRL_STATUS_PROGE | NVMCTRL_STATUS_LOCKE | NVMCTRL_STATUS_NVME));
+}
+
+/* Program len bytes of a word aligned image into an erased row */
+static bool pstore_nvm_write(uint32_t addr, const uint32_t *image, uint16_t len)
+{
+	bool ok = true;
+
+	NVMCTRL->CTRLB.reg |= NVMCTRL_CTRLB_MANW;
+
+	for (uint16_t off = 0; ok && (off < len); off += FLASH_PAGE_SIZE) {
+		volatile uint32_t *page = (volatile uint32_t *)(addr + off);
+
+		ok = pstore_nvm_command(addr + off, NVMCTRL_CTRLA_CMD_PBC);
+		/* The page buffer only takes 16 or 32-bit writes */
+		for (uint8_t i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+			page[i] = image[(off / 4) + i];
+		}
+		ok = ok && pstore_nvm_command(addr + off, NVMCTRL_CTRLA_CMD_WP);
+	}
+
+	return ok;
+}
+
+bool pstore_load(void *data, uint16_t len)
+{
+	pstore_scan();
+
+	if ((pstore_row == CONF_PSTORE_ROWS) || (pstore_hdr(pstore_row)->len != len)) {
+		return false;
+	}
+	memcpy(data, pstore_hdr(pstore_row) + 1, len);
+	return true;
+}
+
+bool pstore_save(const void *data, uint16_t len)
+{
+	uint32_t image[PSTORE_ROW_SIZE / 4];
+	pstore_hdr_t *hdr = (pstore_hdr_t *)image;
+	uint8_t row;
+	uint32_t addr;
+	bool ok;
+
+	if (len > PSTORE_DATA_MAX) {
+		return false;
+	}
+
+	pstore_scan();
+
+	if ((pstore_row != CONF_PSTORE_ROWS) && (pstore_hdr(pstore_row)->len == len) &&
+		!memcmp(pstore_hdr(pstore_row) + 1, data, len)) {
+		return true;
+	}
+
+	memset(image, 0xFF, sizeof(image));
+	hdr->magic = PSTORE_MAGIC;
+	hdr->len = len;
+	hdr->seq = pstore_seq + 1;
+	hdr->crc = pstore_record_crc(len, hdr->seq, data);
+	hdr->reserved = 0xFFFF;
+	memcpy(hdr + 1, data, len);
+
+	/* Rotate through the rows; the newest record is never the one erased */
+	row = (pstore_row + 1) % CONF_PSTORE_ROWS;
+	addr = (uint32_t)pstore_hdr(row);
+
+	ok = pstore_nvm_command(addr, NVMCTRL_CTRLA_CMD_ER) &&
+			pstore_nvm_write(addr, image, sizeof(pstore_hdr_t) + len);
+	/* Drop cached lines of the old contents */
+	pstore_nvm_command(0, NVMCTRL_CTRLA_CMD_INVALL);
+
+	if (ok && pstore_row_valid(row)) {
+		pstore_row = row;
+		pstore_seq = hdr->seq;
+		return true;
+	}
+	return false;
+}
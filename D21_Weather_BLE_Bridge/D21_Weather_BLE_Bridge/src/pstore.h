@@ -0,0 +1,60 @@
+/**
+ * \file
+ *
+ * \brief Wear-levelled, CRC-protected record store in internal flash.
+ *
+ * Holds one record of up to PSTORE_DATA_MAX bytes. Every save is written
+ * to the next flash row with a higher sequence number; loading picks the
+ * newest row whose CRC checks out, so a save interrupted by a reset
+ * leaves the previous record in place.
+ *
+ * Flash is not readable while a row is erased or written, so the CPU
+ * stalls for a few milliseconds during pstore_save().
+ *
+ */
+
+#ifndef PSTORE_H_INCLUDED
+#define PSTORE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_pstore.h"
+
+/** Flash row size; needs the device header from asf.h */
+#define PSTORE_ROW_SIZE			(NVMCTRL_ROW_PAGES * FLASH_PAGE_SIZE)
+
+/** Largest record: one row minus the record header. */
+#define PSTORE_DATA_MAX			(PSTORE_ROW_SIZE - sizeof(pstore_hdr_t))
+
+/** Start of every row, followed by the record */
+typedef struct
+{
+	uint16_t magic;
+	uint16_t len;
+	uint32_t seq;
+	/* CRC-16/CCITT over len, seq and the data */
+	uint16_t crc;
+	uint16_t reserved;
+}pstore_hdr_t;
+
+/** @brief Read the newest valid record
+  *
+  * @param[out] data	Record contents
+  * @param[in] len		Expected record size; a record of another size is ignored
+  *
+  * @return false if there is no valid record of that size
+  */
+bool pstore_load(void *data, uint16_t len);
+
+/** @brief Write a new record
+  *
+  * Nothing is written if the newest record already holds the same data.
+  *
+  * @param[in] data	Record contents
+  * @param[in] len	Record size, at most PSTORE_DATA_MAX
+  *
+  * @return false if len is too big or programming failed
+  */
+bool pstore_save(const void *data, uint16_t len);
+
+#endif /* PSTORE_H_INCLUDED */
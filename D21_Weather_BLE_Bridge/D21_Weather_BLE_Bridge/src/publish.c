@@ -0,0 +1,97 @@
+/**
+ * \file
+ *
+ * \brief Push weather updates to the LAN in UDP datagrams.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "socket/include/socket.h"
+#include "publish.h"
+#include "trace.h"
+
+#if (CONF_BRIDGE_PUBLISH == true)
+
+/* version | sequence(4) | temperature(2) | condition(2) | city length */
+#define PUBLISH_HEADER_SIZE				10
+
+static SOCKET publish_sock = -1;
+static uint32_t publish_seq;
+
+void publish_task(bool uplink)
+{
+	if (!uplink) {
+		if (publish_sock >= 0) {
+			close(publish_sock);
+			publish_sock = -1;
+		}
+		return;
+	}
+	if ((publish_sock < 0) && ((publish_sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)) {
+		TRACE_WARN("publish: no socket");
+	}
+}
+
+void publish_weather(const weather_cache_entry_t *entry)
+{
+	uint8_t datagram[PUBLISH_HEADER_SIZE + CONF_BRIDGE_CITY_SIZE];
+	struct sockaddr_in addr_in;
+	int32_t temperature = entry->temperature;
+	uint16_t condition = entry->condition;
+	uint8_t city_len = (uint8_t)strnlen(entry->city, CONF_BRIDGE_CITY_SIZE - 1);
+
+	if (publish_sock < 0) {
+		return;
+	}
+	if (temperature > INT16_MAX) {
+		temperature = INT16_MAX;
+	} else if (temperature < INT16_MIN) {
+		temperature = INT16_MIN;
+	}
+
+	datagram[0] = PUBLISH_VERSION;
+	datagram[1] = (uint8_t)publish_seq;
+	datagram[2] = (uint8_t)(publish_seq >> 8);
+	datagram[3] = (uint8_t)(publish_seq >> 16);
+	datagram[4] = (uint8_t)(publish_seq >> 24);
+	datagram[5] = (uint8_t)temperature;
+	datagram[6] = (uint8_t)((uint16_t)temperature >> 8);
+	datagram[7] = (uint8_t)condition;
+	datagram[8] = (uint8_t)(condition >> 8);
+	datagram[9] = city_len;
+	memcpy(&datagram[PUBLISH_HEADER_SIZE], entry->city, city_len);
+
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_port = _htons(CONF_BRIDGE_PUBLISH_PORT);
+	addr_in.sin_addr.s_addr = CONF_BRIDGE_PUBLISH_ADDR;
+	/* The sequence moves on even if the WINC refuses, so receivers see the loss */
+	if (sendto(publish_sock, datagram, PUBLISH_HEADER_SIZE + city_len, 0, (struct sockaddr *)&addr_in,
+			sizeof(addr_in)) != SOCK_ERR_NO_ERROR) {
+		TRACE_WARN("publish: %s not sent", entry->city);
+	}
+	publish_seq++;
+}
+
+bool publish_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	/* Nothing to do on SOCKET_MSG_SENDTO */
+	return (publish_sock >= 0) && (sock == publish_sock);
+}
+
+#else
+
+void publish_task(bool uplink)
+{
+}
+
+void publish_weather(const weather_cache_entry_t *entry)
+{
+}
+
+bool publish_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * \file
+ *
+ * \brief Push weather updates to the LAN in UDP datagrams.
+ *
+ * Every time the weather of a city is fetched, one datagram goes to
+ * CONF_BRIDGE_PUBLISH_ADDR:CONF_BRIDGE_PUBLISH_PORT, a multicast group or
+ * the broadcast address, so any number of displays follow the updates
+ * without polling.
+ *
+ * Datagram layout (little endian):
+ * \code
+ *   version | sequence(4) | temperature(2) | condition(2) | city length | city
+ * \endcode
+ * \c sequence counts datagrams from 0 at start-up; a gap means lost
+ * datagrams, a step back a restarted bridge. The temperature and
+ * condition are as in broadcast.h, the city is as asked by the clients,
+ * without a NUL.
+ *
+ */
+
+#ifndef PUBLISH_H_INCLUDED
+#define PUBLISH_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+#include "weather_cache.h"
+
+/** Datagram format, bumped on incompatible changes */
+#define PUBLISH_VERSION					2
+
+/** @brief Open the socket while the uplink is ready. Call from the main loop.
+  *
+  * @param[in] uplink	The Wi-Fi uplink is ready
+  */
+void publish_task(bool uplink);
+
+/** @brief Push fresh weather; dropped while the uplink is down */
+void publish_weather(const weather_cache_entry_t *entry);
+
+/** @brief Socket event, from the socket callback
+  *
+  * @return false if the socket is not the publisher's
+  */
+bool publish_socket_cb(int8_t sock, uint8_t msg, void *msg_data);
+
+#endif /* PUBLISH_H_INCLUDED */
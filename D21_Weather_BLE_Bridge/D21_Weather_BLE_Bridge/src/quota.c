@@ -0,0 +1,168 @@
+/**
+ * \file
+ *
+ * \brief Budget of requests to the weather server.
+ *
+ */
+
+#include <asf.h>
+#include "systime.h"
+#include "idle.h"
+#include "wifi_power.h"
+#include "quota.h"
+#include "trace.h"
+
+/*
+ * A bucket holding burst tokens and refilled at (per - burst) tokens per
+ * period uses at most per tokens in any period.
+ */
+_Static_assert(CONF_BRIDGE_QUOTA_MIN_BURST < CONF_BRIDGE_QUOTA_PER_MIN, "minute burst must be below the minute quota");
+_Static_assert(CONF_BRIDGE_QUOTA_DAY_BURST < CONF_BRIDGE_QUOTA_PER_DAY, "day burst must be below the day quota");
+_Static_assert(CONF_BRIDGE_QUOTA_RESERVE < CONF_BRIDGE_QUOTA_MIN_BURST, "reserve must be below the bursts");
+_Static_assert(CONF_BRIDGE_QUOTA_RESERVE < CONF_BRIDGE_QUOTA_DAY_BURST, "reserve must be below the bursts");
+_Static_assert((CONF_BRIDGE_QUOTA_RESERVE < CONF_BRIDGE_QUOTA_LOW_WATER) &&
+		(CONF_BRIDGE_QUOTA_LOW_WATER < CONF_BRIDGE_QUOTA_MIN_BURST), "low water must lie between the reserve and the bursts");
+
+#define QUOTA_MIN_REFILL_MS				(60000ul / (CONF_BRIDGE_QUOTA_PER_MIN - CONF_BRIDGE_QUOTA_MIN_BURST))
+#define QUOTA_DAY_REFILL_MS				(86400000ul / (CONF_BRIDGE_QUOTA_PER_DAY - CONF_BRIDGE_QUOTA_DAY_BURST))
+
+typedef struct
+{
+	uint16_t tokens;
+	uint16_t burst;
+	/* Time to earn one token */
+	uint32_t refill_interval_ms;
+	/* systime_ms() the next token is earned from */
+	uint32_t refill_ms;
+}quota_bucket_t;
+
+static quota_bucket_t quota_min = {CONF_BRIDGE_QUOTA_MIN_BURST, CONF_BRIDGE_QUOTA_MIN_BURST, QUOTA_MIN_REFILL_MS, 0};
+static quota_bucket_t quota_day = {CONF_BRIDGE_QUOTA_DAY_BURST, CONF_BRIDGE_QUOTA_DAY_BURST, QUOTA_DAY_REFILL_MS, 0};
+static quota_stats_t quota_stat;
+
+static void quota_refill(quota_bucket_t *bucket, uint32_t now)
+{
+	uint32_t earned = (now - bucket->refill_ms) / bucket->refill_interval_ms;
+
+	if (bucket->tokens + earned >= bucket->burst) {
+		/* Full; earning starts again with the next token taken */
+		bucket->tokens = bucket->burst;
+		bucket->refill_ms = now;
+	} else {
+		bucket->tokens += earned;
+		bucket->refill_ms += earned * bucket->refill_interval_ms;
+	}
+}
+
+/* systime_ms() of the next token of an empty bucket */
+static uint32_t quota_next_ms(const quota_bucket_t *bucket)
+{
+	return bucket->refill_ms + bucket->refill_interval_ms;
+}
+
+static void quota_update(void)
+{
+	uint32_t now = systime_ms();
+
+	quota_refill(&quota_min, now);
+	quota_refill(&quota_day, now);
+}
+
+/* Take a token from both buckets, leaving reserve tokens in each */
+static bool quota_take(uint16_t reserve)
+{
+	if ((quota_min.tokens <= reserve) || (quota_day.tokens <= reserve)) {
+		return false;
+	}
+	quota_min.tokens--;
+	quota_day.tokens--;
+	return true;
+}
+
+void quota_init(void)
+{
+	uint32_t now = systime_ms();
+
+	quota_min.refill_ms = now;
+	quota_day.refill_ms = now;
+}
+
+void quota_snapshot(quota_saved_t *saved)
+{
+	quota_update();
+	saved->tokens = quota_day.tokens;
+	saved->reserved = 0;
+	saved->refill_age_ms = systime_ms() - quota_day.refill_ms;
+}
+
+void quota_restore(const quota_saved_t *saved)
+{
+	uint32_t age_ms = saved->refill_age_ms;
+
+	if (saved->tokens >= quota_day.burst) {
+		return;
+	}
+	if (age_ms >= quota_day.refill_interval_ms) {
+		age_ms = quota_day.refill_interval_ms - 1;
+	}
+	quota_day.tokens = saved->tokens;
+	quota_day.refill_ms = systime_ms() - age_ms;
+}
+
+quota_decision_t quota_decide(bool background, bool stale)
+{
+	quota_decision_t decision;
+
+	quota_update();
+	if (background) {
+		/* Refreshes only spend tokens above the reserve */
+		decision = quota_take(CONF_BRIDGE_QUOTA_RESERVE) ? QUOTA_FETCH : QUOTA_SKIP;
+	} else if (stale && quota_take(CONF_BRIDGE_QUOTA_LOW_WATER)) {
+		decision = QUOTA_FETCH;
+	} else if (stale) {
+		/* Short of tokens, the client gets the stale weather now rather than waiting */
+		decision = quota_take(CONF_BRIDGE_QUOTA_RESERVE) ? QUOTA_STALE_REVALIDATE : QUOTA_STALE;
+	} else {
+		decision = quota_take(0) ? QUOTA_FETCH : QUOTA_DEFER;
+	}
+	quota_stat.decisions[decision]++;
+	if (decision >= QUOTA_DEFER) {
+		TRACE_DBG("quota: %d/%d tokens, %s", quota_min.tokens, quota_day.tokens,
+				(decision == QUOTA_DEFER) ? "deferred" : "skipped");
+	}
+	return decision;
+}
+
+void quota_hit(void)
+{
+	quota_stat.hits++;
+}
+
+bool quota_ready(void)
+{
+	quota_update();
+	return quota_min.tokens && quota_day.tokens;
+}
+
+void quota_task(bool waiting)
+{
+	uint32_t next_ms = 0;
+
+	if (!waiting || quota_ready()) {
+		return;
+	}
+	/* The later of the empty buckets' next tokens */
+	if (!quota_min.tokens) {
+		next_ms = quota_next_ms(&quota_min);
+	}
+	if (!quota_day.tokens && (quota_min.tokens || ((int32_t)(quota_next_ms(&quota_day) - next_ms) > 0))) {
+		next_ms = quota_next_ms(&quota_day);
+	}
+	idle_wake_at(next_ms);
+	wifi_power_schedule(next_ms);
+}
+
+const quota_stats_t *quota_stats(void)
+{
+	return &quota_stat;
+}
@@ -0,0 +1,101 @@
+/**
+ * \file
+ *
+ * \brief Budget of requests to the weather server.
+ *
+ * All clients share one API key, whose quota is counted per minute and
+ * per day. Every fetch takes a token from two buckets, one refilled to
+ * stay within CONF_BRIDGE_QUOTA_PER_MIN and one within
+ * CONF_BRIDGE_QUOTA_PER_DAY, each holding up to its burst size, so
+ * however clients ask, the key is never used faster than the quota
+ * allows, and never slower while requests are waiting.
+ *
+ * When a city has no fresh weather, quota_decide() picks between:
+ * - fetching it, if both buckets have a token, or more than
+ *   CONF_BRIDGE_QUOTA_LOW_WATER if stale weather is at hand;
+ * - otherwise answering with weather up to CONF_BRIDGE_CACHE_STALE_S old,
+ *   and fetching fresh weather behind it while tokens are above
+ *   CONF_BRIDGE_QUOTA_RESERVE (stale-while-revalidate);
+ * - keeping the request until the next token, if no stale weather;
+ * - skipping it, for refreshes no client waits for, once tokens are down
+ *   to the reserve; their owners ask again later.
+ *
+ */
+
+#ifndef QUOTA_H_INCLUDED
+#define QUOTA_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Connection handle of revalidation fetches; no client gets the reply */
+#define QUOTA_CONN_HANDLE				((uint16_t)0xFC00)
+
+typedef enum
+{
+	/* Fetch, a token was taken */
+	QUOTA_FETCH,
+	/* Answer with the stale weather only */
+	QUOTA_STALE,
+	/* Answer with the stale weather, then fetch; a token was taken */
+	QUOTA_STALE_REVALIDATE,
+	/* Keep the request until quota_ready() */
+	QUOTA_DEFER,
+	/* Drop the request */
+	QUOTA_SKIP
+}quota_decision_t;
+
+/* Day bucket as kept across resets */
+typedef struct
+{
+	uint16_t tokens;
+	uint16_t reserved;
+	/* Time spent earning the next token */
+	uint32_t refill_age_ms;
+}quota_saved_t;
+
+typedef struct
+{
+	/* Answered from fresh weather, without a decision */
+	uint32_t hits;
+	/* quota_decide() results, by quota_decision_t */
+	uint32_t decisions[QUOTA_SKIP + 1];
+}quota_stats_t;
+
+/** @brief Fill both buckets. Call once after systime_init(). */
+void quota_init(void);
+
+/** @brief Copy out the day bucket */
+void quota_snapshot(quota_saved_t *saved);
+
+/** @brief Put back the day bucket from quota_snapshot(), e.g. after a reset
+  *
+  * Call after quota_init(). The time the bridge was off is not known and
+  * earns no tokens, so a reset never adds to the day's budget.
+  */
+void quota_restore(const quota_saved_t *saved);
+
+/** @brief Decide how to serve a city without fresh weather
+  *
+  * @param[in] background	No client waits for the answer
+  * @param[in] stale		Stale weather of the city is at hand
+  */
+quota_decision_t quota_decide(bool background, bool stale);
+
+/** @brief Count an answer from fresh weather */
+void quota_hit(void);
+
+/** @brief A token is available */
+bool quota_ready(void);
+
+/** @brief Wake up for the next token. Call from the main loop.
+  *
+  * @param[in] waiting	Requests were deferred
+  */
+void quota_task(bool waiting);
+
+/** @brief Decisions so far */
+const quota_stats_t *quota_stats(void);
+
+#endif /* QUOTA_H_INCLUDED */
@@ -0,0 +1,121 @@
+/**
+ * \file
+ *
+ * \brief FIFO of weather requests waiting for the uplink.
+ *
+ */
+
+#include <string.h>
+#include "req_queue.h"
+
+static req_queue_entry_t req_queue[CONF_BRIDGE_REQ_QUEUE_DEPTH];
+/* Index of the oldest entry */
+static uint8_t req_queue_head;
+static uint8_t req_queue_len;
+/* Entries marked deferred */
+static uint8_t req_queue_deferred_len;
+
+static req_queue_entry_t *req_queue_at(uint8_t pos)
+{
+	return &req_queue[(req_queue_head + pos) % CONF_BRIDGE_REQ_QUEUE_DEPTH];
+}
+
+bool req_queue_push(uint16_t conn_handle, const char *city)
+{
+	req_queue_entry_t *entry = NULL;
+	size_t len = strlen(city);
+
+	for (uint8_t pos = 0; pos < req_queue_len; pos++) {
+		if (req_queue_at(pos)->conn_handle == conn_handle) {
+			entry = req_queue_at(pos);
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		if (req_queue_len == CONF_BRIDGE_REQ_QUEUE_DEPTH) {
+			return false;
+		}
+		entry = req_queue_at(req_queue_len++);
+		entry->conn_handle = conn_handle;
+	} else if (entry->deferred) {
+		req_queue_deferred_len--;
+	}
+	/* Another city may have weather at hand, so it is looked at again */
+	entry->deferred = false;
+
+	if (len >= sizeof(entry->city)) {
+		len = sizeof(entry->city) - 1;
+	}
+	memcpy(entry->city, city, len);
+	entry->city[len] = '\0';
+	return true;
+}
+
+/* Remove the entry at pos, keeping the order of the others */
+static void req_queue_remove(uint8_t pos)
+{
+	if (req_queue_at(pos)->deferred) {
+		req_queue_deferred_len--;
+	}
+	for (; pos + 1 < req_queue_len; pos++) {
+		*req_queue_at(pos) = *req_queue_at(pos + 1);
+	}
+	req_queue_len--;
+}
+
+bool req_queue_pop(req_queue_entry_t *entry, bool deferred)
+{
+	uint8_t pos = 0;
+
+	while ((pos < req_queue_len) && !deferred && req_queue_at(pos)->deferred) {
+		pos++;
+	}
+	if (pos == req_queue_len) {
+		return false;
+	}
+	*entry = *req_queue_at(pos);
+	req_queue_remove(pos);
+	return true;
+}
+
+bool req_queue_defer(const req_queue_entry_t *entry)
+{
+	uint8_t pos = req_queue_len;
+
+	if (req_queue_len == CONF_BRIDGE_REQ_QUEUE_DEPTH) {
+		return false;
+	}
+	/* Behind the last deferred one; all of those were taken before it */
+	for (; (pos > 0) && !req_queue_at(pos - 1)->deferred; pos--) {
+		*req_queue_at(pos) = *req_queue_at(pos - 1);
+	}
+	*req_queue_at(pos) = *entry;
+	req_queue_at(pos)->deferred = true;
+	req_queue_len++;
+	req_queue_deferred_len++;
+	return true;
+}
+
+void req_queue_drop(uint16_t conn_handle)
+{
+	uint8_t pos = 0;
+
+	while (pos < req_queue_len) {
+		if (req_queue_at(pos)->conn_handle == conn_handle) {
+			req_queue_remove(pos);
+		} else {
+			pos++;
+		}
+	}
+}
+
+uint8_t req_queue_count(void)
+{
+	return req_queue_len;
+}
+
+uint8_t req_queue_deferred(void)
+{
+	return req_queue_deferred_len;
+}
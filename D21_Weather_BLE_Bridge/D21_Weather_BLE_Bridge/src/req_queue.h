@@ -0,0 +1,69 @@
+/**
+ * \file
+ *
+ * \brief FIFO of weather requests waiting for the uplink.
+ *
+ * BLE clients can ask for weather as soon as advertising starts, which is
+ * well before Wi-Fi, DHCP and DNS are done. Requests are held here and
+ * served one at a time once a TCP connection to the server can be opened.
+ *
+ */
+
+#ifndef REQ_QUEUE_H_INCLUDED
+#define REQ_QUEUE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+typedef struct
+{
+	/* Connection the answer is sent to */
+	uint16_t conn_handle;
+	/* City to look up */
+	char city[CONF_BRIDGE_CITY_SIZE];
+	/* Put back by req_queue_defer(), waits for quota */
+	bool deferred;
+}req_queue_entry_t;
+
+/** @brief Queue a request
+  *
+  * A pending request from the same connection is replaced and keeps its
+  * place in the queue, no longer deferred.
+  *
+  * @param[in] conn_handle	Connection asking
+  * @param[in] city			City name, truncated to CONF_BRIDGE_CITY_SIZE - 1
+  *
+  * @return false if the queue is full
+  */
+bool req_queue_push(uint16_t conn_handle, const char *city);
+
+/** @brief Take the oldest request
+  *
+  * @param[out] entry		Filled with the request
+  * @param[in] deferred		Also take deferred requests; otherwise the
+  *							oldest one not deferred is taken
+  *
+  * @return false if there is no such request
+  */
+bool req_queue_pop(req_queue_entry_t *entry, bool deferred);
+
+/** @brief Put a popped request back, marked deferred
+  *
+  * It goes behind the last deferred request, which is where it was when
+  * it was popped without deferred ones.
+  *
+  * @return false if the queue is full
+  */
+bool req_queue_defer(const req_queue_entry_t *entry);
+
+/** @brief Forget any request of a connection that went away */
+void req_queue_drop(uint16_t conn_handle);
+
+/** @brief Number of queued requests */
+uint8_t req_queue_count(void);
+
+/** @brief Number of queued requests that are deferred */
+uint8_t req_queue_deferred(void);
+
+#endif /* REQ_QUEUE_H_INCLUDED */
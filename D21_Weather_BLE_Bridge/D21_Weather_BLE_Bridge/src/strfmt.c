@@ -0,0 +1,131 @@
+/**
+ * \file
+ *
+ * \brief Bounded string appender used instead of sprintf.
+ *
+ */
+
+#include "strfmt.h"
+
+void strfmt_init(strfmt_t *sf, char *buf, uint16_t size)
+{
+	sf->buf = buf;
+	sf->size = size;
+	sf->len = 0;
+	sf->overflow = false;
+	sf->buf[0] = '\0';
+}
+
+void strfmt_mem(strfmt_t *sf, const char *str, uint16_t len)
+{
+	uint16_t room = sf->size - 1 - sf->len;
+
+	if (len > room) {
+		len = room;
+		sf->overflow = true;
+	}
+	for (uint16_t i = 0; i < len; i++) {
+		sf->buf[sf->len++] = str[i];
+	}
+	sf->buf[sf->len] = '\0';
+}
+
+void strfmt_str(strfmt_t *sf, const char *str)
+{
+	uint16_t len = 0;
+
+	while (str[len] && (len <= sf->size)) {
+		len++;
+	}
+	strfmt_mem(sf, str, len);
+}
+
+void strfmt_uint(strfmt_t *sf, uint32_t value)
+{
+	/* 4294967295 */
+	char digits[10];
+	uint8_t n = sizeof(digits);
+
+	do {
+		digits[--n] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value);
+
+	strfmt_mem(sf, &digits[n], sizeof(digits) - n);
+}
+
+void strfmt_fixed(strfmt_t *sf, int32_t value, uint8_t decimals)
+{
+	uint32_t magnitude;
+	uint32_t scale = 1;
+	char frac[STRFMT_DECIMALS_MAX];
+
+	if (value < 0) {
+		strfmt_mem(sf, "-", 1);
+		magnitude = (uint32_t)0 - (uint32_t)value;
+	} else {
+		magnitude = (uint32_t)value;
+	}
+
+	if (decimals > STRFMT_DECIMALS_MAX) {
+		decimals = STRFMT_DECIMALS_MAX;
+	}
+	for (uint8_t i = 0; i < decimals; i++) {
+		scale *= 10;
+	}
+
+	strfmt_uint(sf, magnitude / scale);
+	if (decimals) {
+		magnitude %= scale;
+		for (uint8_t i = decimals; i > 0; i--) {
+			frac[i - 1] = (char)('0' + (magnitude % 10));
+			magnitude /= 10;
+		}
+		strfmt_mem(sf, ".", 1);
+		strfmt_mem(sf, frac, decimals);
+	}
+}
+
+int32_t strfmt_parse_fixed(const char *str, uint8_t decimals)
+{
+	bool negative = false;
+	int32_t value = 0;
+	uint8_t frac_digits = 0;
+	bool in_frac = false;
+
+	if (*str == '-') {
+		negative = true;
+		str++;
+	} else if (*str == '+') {
+		str++;
+	}
+
+	for (; *str; str++) {
+		if ((*str == '.') && !in_frac) {
+			in_frac = true;
+		} else if ((*str >= '0') && (*str <= '9')) {
+			if (in_frac) {
+				if (frac_digits == decimals) {
+					continue;
+				}
+				frac_digits++;
+			}
+			/* Too many digits, e.g. from a broken answer: saturate instead of overflowing */
+			if (value > (INT32_MAX - 9) / 10) {
+				return negative ? -INT32_MAX : INT32_MAX;
+			}
+			value = value * 10 + (*str - '0');
+		} else {
+			break;
+		}
+	}
+
+	for (; frac_digits < decimals; frac_digits++) {
+		if (value > INT32_MAX / 10) {
+			return negative ? -INT32_MAX : INT32_MAX;
+		}
+		value *= 10;
+	}
+
+	return negative ? -value : value;
+}
@@ -0,0 +1,70 @@
+/**
+ * \file
+ *
+ * \brief Bounded string appender used instead of sprintf.
+ *
+ * All appenders truncate at the end of the destination buffer, keep it
+ * NUL terminated and latch the overflow flag, so a sequence of calls can
+ * be checked once at the end.
+ *
+ */
+
+#ifndef STRFMT_H_INCLUDED
+#define STRFMT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Most fractional digits of strfmt_fixed(); 10^9 is the largest power of ten in 32 bits */
+#define STRFMT_DECIMALS_MAX		9
+
+typedef struct
+{
+	/* Destination buffer */
+	char *buf;
+	/* Destination size, including the terminating NUL */
+	uint16_t size;
+	/* Characters written so far, excluding the terminating NUL */
+	uint16_t len;
+	/* Set once any appender had to truncate */
+	bool overflow;
+}strfmt_t;
+
+/** @brief Start appending to buf, which is emptied
+  *
+  * @param[in] sf	Appender state
+  * @param[in] buf	Destination buffer
+  * @param[in] size	Size of buf in bytes, must be at least 1
+  */
+void strfmt_init(strfmt_t *sf, char *buf, uint16_t size);
+
+/** @brief Append a NUL terminated string */
+void strfmt_str(strfmt_t *sf, const char *str);
+
+/** @brief Append len characters of str */
+void strfmt_mem(strfmt_t *sf, const char *str, uint16_t len);
+
+/** @brief Append an unsigned decimal number */
+void strfmt_uint(strfmt_t *sf, uint32_t value);
+
+/** @brief Append a signed fixed-point number
+  *
+  * @param[in] value	Value scaled by 10^decimals, e.g. 2450 with 2 decimals is "24.50"
+  * @param[in] decimals	Number of fractional digits, at most STRFMT_DECIMALS_MAX
+  */
+void strfmt_fixed(strfmt_t *sf, int32_t value, uint8_t decimals);
+
+/** @brief Parse a decimal string such as "-3.25" into a fixed-point value
+  *
+  * Parsing stops at the first character that is not part of the number;
+  * extra fractional digits are dropped. Values beyond the int32_t range
+  * saturate at +/-INT32_MAX.
+  *
+  * @param[in] str		Text to parse
+  * @param[in] decimals	Number of fractional digits of the result
+  *
+  * @return value scaled by 10^decimals
+  */
+int32_t strfmt_parse_fixed(const char *str, uint8_t decimals);
+
+#endif /* STRFMT_H_INCLUDED */
@@ -0,0 +1,212 @@
+/**
+ * \file
+ *
+ * \brief City subscriptions with change-only notifications.
+ *
+ */
+
+#include <asf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "transparent_uart.h"
+#include "weather_cache.h"
+#include "req_queue.h"
+#include "systime.h"
+#include "wifi_power.h"
+#include "idle.h"
+#include "subscribe.h"
+#include "trace.h"
+
+#if (CONF_BRIDGE_SUB == true)
+
+/* subscribe_refresh() only sees a city as due while weather_cache_find() still has it */
+_Static_assert(CONF_BRIDGE_SUB_REFRESH_S <= CONF_BRIDGE_CACHE_MAX_AGE_S, "subscriptions must refresh before the cache expires");
+
+#define SUBSCRIBE_CMD					"SUB:"
+#define UNSUBSCRIBE_CMD					"UNSUB"
+#define SUBSCRIBE_CMD_LEN				(sizeof(SUBSCRIBE_CMD) - 1)
+#define UNSUBSCRIBE_CMD_LEN				(sizeof(UNSUBSCRIBE_CMD) - 1)
+
+typedef struct
+{
+	bool used;
+	uint16_t conn_handle;
+	char city[CONF_BRIDGE_CITY_SIZE];
+	/* Values last notified */
+	bool notified;
+	int32_t temperature;
+	uint16_t condition;
+	/* systime_ms() of the last fetch queued for the city */
+	uint32_t fetch_ms;
+	bool fetch_tried;
+}subscription_t;
+
+static subscription_t subscriptions[MAX_REMOTE_DEVICE];
+/* Cache generation last looked at, and whether a notification is owed */
+static uint16_t seen_gen;
+static bool notify_retry;
+
+static subscription_t *subscribe_find(uint16_t conn_handle)
+{
+	for (uint8_t i = 0; i < MAX_REMOTE_DEVICE; i++) {
+		if (subscriptions[i].used && (subscriptions[i].conn_handle == conn_handle)) {
+			return &subscriptions[i];
+		}
+	}
+	return NULL;
+}
+
+static void subscribe_add(uint16_t conn_handle, const uint8_t *city, uint16_t len)
+{
+	subscription_t *sub = subscribe_find(conn_handle);
+
+	if (!sub) {
+		for (uint8_t i = 0; i < MAX_REMOTE_DEVICE; i++) {
+			if (!subscriptions[i].used) {
+				sub = &subscriptions[i];
+				break;
+			}
+		}
+	}
+	if (!sub) {
+		TRACE_WARN("subscribe: no room");
+		return;
+	}
+	if (len >= sizeof(sub->city)) {
+		len = sizeof(sub->city) - 1;
+	}
+	memset(sub, 0, sizeof(*sub));
+	sub->used = true;
+	sub->conn_handle = conn_handle;
+	memcpy(sub->city, city, len);
+	sub->city[len] = '\0';
+	/* The current value goes out on the next pass */
+	notify_retry = true;
+	TRACE_INFO("subscribe: %u to %s", conn_handle, sub->city);
+}
+
+bool subscribe_write(uint16_t conn_handle, const uint8_t *data, uint16_t len)
+{
+	if ((len > SUBSCRIBE_CMD_LEN) && !memcmp(data, SUBSCRIBE_CMD, SUBSCRIBE_CMD_LEN)) {
+		subscribe_add(conn_handle, &data[SUBSCRIBE_CMD_LEN], len - SUBSCRIBE_CMD_LEN);
+		return true;
+	}
+	if ((len == UNSUBSCRIBE_CMD_LEN) && !memcmp(data, UNSUBSCRIBE_CMD, UNSUBSCRIBE_CMD_LEN)) {
+		subscribe_drop(conn_handle);
+		return true;
+	}
+	return false;
+}
+
+void subscribe_drop(uint16_t conn_handle)
+{
+	subscription_t *sub = subscribe_find(conn_handle);
+
+	if (sub) {
+		req_queue_drop(SUBSCRIBE_CONN_HANDLE(sub - subscriptions));
+		sub->used = false;
+	}
+}
+
+/* First subscription of the same city, which fetches for all of them */
+static bool subscribe_city_owner(uint8_t index)
+{
+	for (uint8_t i = 0; i < index; i++) {
+		if (subscriptions[i].used && !strcasecmp(subscriptions[i].city, subscriptions[index].city)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void subscribe_refresh(uint32_t now)
+{
+	for (uint8_t i = 0; i < MAX_REMOTE_DEVICE; i++) {
+		subscription_t *sub = &subscriptions[i];
+		const weather_cache_entry_t *entry;
+
+		if (!sub->used || !subscribe_city_owner(i)) {
+			continue;
+		}
+		entry = weather_cache_find(sub->city);
+		if (entry && ((now - entry->updated_ms) < CONF_BRIDGE_SUB_REFRESH_S * 1000ul)) {
+			/* Wake up, with the WINC ready, when it is due */
+			uint32_t due_ms = entry->updated_ms + CONF_BRIDGE_SUB_REFRESH_S * 1000ul;
+
+			idle_wake_at(due_ms);
+			wifi_power_schedule(due_ms);
+			continue;
+		}
+		if (sub->fetch_tried && ((now - sub->fetch_ms) < CONF_BRIDGE_SUB_RETRY_S * 1000ul)) {
+			idle_wake_at(sub->fetch_ms + CONF_BRIDGE_SUB_RETRY_S * 1000ul);
+			continue;
+		}
+		if (req_queue_push(SUBSCRIBE_CONN_HANDLE(i), sub->city)) {
+			sub->fetch_tried = true;
+			sub->fetch_ms = now;
+		}
+	}
+}
+
+/* Notify what changed enough; false if a notification has to be retried */
+static bool subscribe_notify(void)
+{
+	bool done = true;
+
+	for (uint8_t i = 0; i < MAX_REMOTE_DEVICE; i++) {
+		subscription_t *sub = &subscriptions[i];
+		const weather_cache_entry_t *entry;
+		char text[TU_WEATHER_CHAR_MAX_LEN];
+		uint16_t condition;
+		uint16_t len;
+
+		if (!sub->used || !(entry = weather_cache_find(sub->city))) {
+			continue;
+		}
+		condition = entry->condition;
+		if (sub->notified && (condition == sub->condition) &&
+				(labs(entry->temperature - sub->temperature) < CONF_BRIDGE_SUB_TEMP_DELTA)) {
+			continue;
+		}
+		len = weather_cached_text(sub->city, ble_app_units(sub->conn_handle), text, sizeof(text));
+		if (ble_app_push_weather(sub->conn_handle, (uint8_t *)text, len) != AT_BLE_SUCCESS) {
+			done = false;
+			continue;
+		}
+		sub->notified = true;
+		sub->temperature = entry->temperature;
+		sub->condition = condition;
+	}
+	return done;
+}
+
+void subscribe_task(void)
+{
+	uint16_t gen = weather_cache_generation();
+
+	subscribe_refresh(systime_ms());
+
+	/* Values only change when the cache does */
+	if ((gen != seen_gen) || notify_retry) {
+		seen_gen = gen;
+		notify_retry = !subscribe_notify();
+	}
+}
+
+#else
+
+bool subscribe_write(uint16_t conn_handle, const uint8_t *data, uint16_t len)
+{
+	return false;
+}
+
+void subscribe_drop(uint16_t conn_handle)
+{
+}
+
+void subscribe_task(void)
+{
+}
+
+#endif
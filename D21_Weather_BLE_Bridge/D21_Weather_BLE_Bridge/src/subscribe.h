@@ -0,0 +1,43 @@
+/**
+ * \file
+ *
+ * \brief City subscriptions with change-only notifications.
+ *
+ * A client writes \c SUB:<city> to the TX or RX characteristic instead of
+ * a plain city to subscribe the connection to that city, and \c UNSUB to
+ * end it; a connection has one subscription at a time. Subscribed cities
+ * are fetched again every CONF_BRIDGE_SUB_REFRESH_S, once per city however
+ * many clients follow it. A subscriber gets the weather text on TX at once
+ * if it is cached, then only when the temperature moved by at least
+ * CONF_BRIDGE_SUB_TEMP_DELTA or the condition changed, whoever caused the
+ * fetch.
+ *
+ */
+
+#ifndef SUBSCRIBE_H_INCLUDED
+#define SUBSCRIBE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Connection handle of fetches made for subscriptions; no client gets the reply */
+#define SUBSCRIBE_CONN_HANDLE(index)	((uint16_t)(0xFD00 | (index)))
+
+/** @brief Handle a subscription command written by a client
+  *
+  * @param[in] conn_handle	Connection that wrote
+  * @param[in] data			Value written
+  * @param[in] len			Value length
+  *
+  * @return false if the value is not a subscription command
+  */
+bool subscribe_write(uint16_t conn_handle, const uint8_t *data, uint16_t len);
+
+/** @brief End the subscription of a connection that went away */
+void subscribe_drop(uint16_t conn_handle);
+
+/** @brief Refresh subscribed cities and notify changes. Call from the main loop. */
+void subscribe_task(void);
+
+#endif /* SUBSCRIBE_H_INCLUDED */
@@ -0,0 +1,103 @@
+/**
+ * \file
+ *
+ * \brief Millisecond time base running from the RTC.
+ *
+ */
+
+#include <asf.h>
+#include "conf_systime.h"
+#include "systime.h"
+
+/* RTC counter value when systime_ms() last ran */
+static uint32_t systime_last_count;
+/* Longest alarm, so the tick count can't overflow */
+#define SYSTIME_ALARM_MAX_MS		(3600UL * 1000)
+
+/* Milliseconds and the 1/1024 ms remainder accumulated so far */
+static uint32_t systime_acc_ms;
+static uint32_t systime_acc_frac;
+
+static inline void systime_sync(void)
+{
+	while (RTC->MODE0.STATUS.reg & RTC_STATUS_SYNCBUSY);
+}
+
+void systime_init(void)
+{
+	struct system_gclk_chan_config gclk_chan_conf;
+
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBA, PM_APBAMASK_RTC);
+
+	system_gclk_chan_get_config_defaults(&gclk_chan_conf);
+	gclk_chan_conf.source_generator = CONF_SYSTIME_GCLK_GENERATOR;
+	system_gclk_chan_set_config(RTC_GCLK_ID, &gclk_chan_conf);
+	system_gclk_chan_enable(RTC_GCLK_ID);
+
+	RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_SWRST;
+	while (RTC->MODE0.CTRL.reg & RTC_MODE0_CTRL_SWRST);
+
+	/* 32768 Hz / 32 = 1024 Hz, free running */
+	RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV32;
+	systime_sync();
+	/* Keep COUNT synchronized so reads don't stall */
+	RTC->MODE0.READREQ.reg = RTC_READREQ_RCONT | RTC_READREQ_RREQ | RTC_READREQ_ADDR(RTC_MODE0_COUNT_OFFSET);
+	RTC->MODE0.CTRL.reg |= RTC_MODE0_CTRL_ENABLE;
+	systime_sync();
+
+	systime_last_count = 0;
+	systime_acc_ms = 0;
+	systime_acc_frac = 0;
+
+	system_interrupt_enable(SYSTEM_INTERRUPT_MODULE_RTC);
+}
+
+uint32_t systime_ms(void)
+{
+	uint32_t count;
+	uint64_t scaled;
+	uint32_t ms;
+
+	system_interrupt_enter_critical_section();
+	count = RTC->MODE0.COUNT.reg;
+	/* Convert the elapsed ticks, so the result wraps at 2^32 ms, not 2^32 ticks */
+	scaled = (uint64_t)(count - systime_last_count) * 1000 + systime_acc_frac;
+	systime_last_count = count;
+	systime_acc_ms += (uint32_t)(scaled >> 10);
+	systime_acc_frac = (uint32_t)scaled & 0x3FF;
+	ms = systime_acc_ms;
+	system_interrupt_leave_critical_section();
+
+	return ms;
+}
+
+void systime_alarm(uint32_t at_ms)
+{
+	int32_t delta = (int32_t)(at_ms - systime_ms());
+	uint32_t ticks;
+
+	if (delta < 1) {
+		delta = 1;
+	} else if (delta > (int32_t)SYSTIME_ALARM_MAX_MS) {
+		delta = SYSTIME_ALARM_MAX_MS;
+	}
+	/* Round up, and keep clear of the tick that may be in progress */
+	ticks = ((uint32_t)delta * 1024 + 999) / 1000 + 1;
+
+	RTC->MODE0.COMP[0].reg = systime_last_count + ticks;
+	systime_sync();
+	RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_CMP0;
+	RTC->MODE0.INTENSET.reg = RTC_MODE0_INTENSET_CMP0;
+}
+
+void systime_alarm_cancel(void)
+{
+	RTC->MODE0.INTENCLR.reg = RTC_MODE0_INTENCLR_CMP0;
+	RTC->MODE0.INTFLAG.reg = RTC_MODE0_INTFLAG_CMP0;
+}
+
+void RTC_Handler(void)
+{
+	/* Waking up is all that's needed */
+	systime_alarm_cancel();
+}
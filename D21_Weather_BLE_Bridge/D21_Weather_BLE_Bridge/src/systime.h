@@ -0,0 +1,38 @@
+/**
+ * \file
+ *
+ * \brief Millisecond time base running from the RTC.
+ *
+ * The RTC counts at 1024 Hz from the 32.768 kHz generator. SysTick is
+ * not used because the delay service reprograms it for busy waits. The
+ * RTC keeps counting in standby, so its compare match also serves as the
+ * timer that wakes the core from idle.
+ *
+ */
+
+#ifndef SYSTIME_H_INCLUDED
+#define SYSTIME_H_INCLUDED
+
+#include <stdint.h>
+
+/** @brief Start the RTC counter. Call once after system_init(). */
+void systime_init(void);
+
+/** @brief Milliseconds since systime_init(), wrapping at 2^32
+  *
+  * Compare times by subtraction, e.g. (systime_ms() - start) >= timeout.
+  */
+uint32_t systime_ms(void);
+
+/** @brief Raise the RTC interrupt at a given time, to wake the core from sleep
+  *
+  * Times already passed fire on the next tick. Only one alarm is kept.
+  *
+  * @param[in] at_ms	systime_ms() value to wake at
+  */
+void systime_alarm(uint32_t at_ms);
+
+/** @brief Cancel the alarm */
+void systime_alarm_cancel(void);
+
+#endif /* SYSTIME_H_INCLUDED */
@@ -0,0 +1,51 @@
+/**
+ * \file
+ *
+ * \brief Binary trace frame encoder.
+ *
+ */
+
+#include <asf.h>
+#include "sio2host.h"
+#include "trace.h"
+
+/* sync, len, id, level/argc, types */
+#define TRACE_HDR_LEN			7
+#define TRACE_FRAME_MAX			(TRACE_HDR_LEN + TRACE_MAX_ARGS * (CONF_TRACE_STR_MAX + 1))
+
+void trace_write(uint16_t id, uint8_t level, uint16_t types, uint8_t argc, const uint32_t *args)
+{
+	uint8_t frame[TRACE_FRAME_MAX];
+	uint8_t len = TRACE_HDR_LEN;
+
+	frame[0] = TRACE_SYNC;
+	frame[2] = (uint8_t)id;
+	frame[3] = (uint8_t)(id >> 8);
+	frame[4] = (uint8_t)((level << 4) | argc);
+	frame[5] = (uint8_t)types;
+	frame[6] = (uint8_t)(types >> 8);
+
+	for (uint8_t i = 0; i < argc; i++, types >>= 2) {
+		if ((types & 0x3) == TRACE_ARG_STR) {
+			const char *str = (const char *)(uintptr_t)args[i];
+			uint8_t n = 0;
+
+			if (str) {
+				while ((n < CONF_TRACE_STR_MAX) && str[n]) {
+					frame[len + 1 + n] = (uint8_t)str[n];
+					n++;
+				}
+			}
+			frame[len] = n;
+			len += n + 1;
+		} else {
+			frame[len++] = (uint8_t)args[i];
+			frame[len++] = (uint8_t)(args[i] >> 8);
+			frame[len++] = (uint8_t)(args[i] >> 16);
+			frame[len++] = (uint8_t)(args[i] >> 24);
+		}
+	}
+
+	frame[1] = len - 2;
+	sio2host_tx(frame, len);
+}
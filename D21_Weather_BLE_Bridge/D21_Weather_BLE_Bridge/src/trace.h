@@ -0,0 +1,145 @@
+/**
+ * \file
+ *
+ * \brief Compile-time filtered, deferred-format trace logging.
+ *
+ * In binary mode every call site stores its format string in the
+ * non-loaded .trace_fmt section and only emits the string's offset in that
+ * section plus the raw argument values. Formatting is done on the host by
+ * tools/trace_decode.py, which reads the strings back from the ELF image.
+ *
+ * Frame layout (little endian):
+ * \code
+ *   0xA5 | len | id(2) | level << 4 | argc | types(2) | args...
+ * \endcode
+ * \c len counts the bytes following it. \c types holds two bits per
+ * argument (@ref TRACE_ARG_WORD, @ref TRACE_ARG_STR, @ref TRACE_ARG_FLOAT).
+ * Words and floats take four bytes, strings a length byte and the
+ * characters.
+ *
+ */
+
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_LEVEL_NONE				0
+#define TRACE_LEVEL_ERROR				1
+#define TRACE_LEVEL_WARN				2
+#define TRACE_LEVEL_INFO				3
+#define TRACE_LEVEL_DEBUG				4
+
+#include "conf_trace.h"
+
+#define TRACE_SYNC						0xA5
+#define TRACE_MAX_ARGS					8
+
+#define TRACE_ARG_WORD					0
+#define TRACE_ARG_STR					1
+#define TRACE_ARG_FLOAT					2
+
+/** Emit one binary trace frame. Use the TRACE_xxx macros instead. */
+void trace_write(uint16_t id, uint8_t level, uint16_t types, uint8_t argc, const uint32_t *args);
+
+/** Raw bit pattern of a floating point argument, as single precision. */
+static inline uint32_t trace_arg_float(double value)
+{
+	union {
+		float f;
+		uint32_t u;
+	} bits;
+
+	bits.f = (float)value;
+	return bits.u;
+}
+
+static inline uint32_t trace_arg_int(uint32_t value)
+{
+	return value;
+}
+
+/* _Generic converts its controlling expression like an rvalue: arrays decay, qualifiers go */
+#define TRACE_ARG_TYPE(x) _Generic((x),						\
+		char *: TRACE_ARG_STR, const char *: TRACE_ARG_STR,			\
+		signed char *: TRACE_ARG_STR, const signed char *: TRACE_ARG_STR,	\
+		unsigned char *: TRACE_ARG_STR, const unsigned char *: TRACE_ARG_STR,	\
+		float: TRACE_ARG_FLOAT, double: TRACE_ARG_FLOAT,			\
+		default: TRACE_ARG_WORD)
+
+/* Pointers and integers alike go through uintptr_t, floats keep their value */
+#define TRACE_ARG_VAL(x) _Generic((x),							\
+		float: trace_arg_float, double: trace_arg_float,			\
+		default: trace_arg_int)(_Generic((x),					\
+		float: (x), double: (x),									\
+		default: (uintptr_t)(x)))
+
+#define TRACE_NARGS(...)		TRACE_NARGS_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define TRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)	n
+
+#define TRACE_CAT(a, b)			TRACE_CAT_(a, b)
+#define TRACE_CAT_(a, b)		a##b
+#define TRACE_STRINGZ(x)		TRACE_STRINGZ_(x)
+#define TRACE_STRINGZ_(x)		#x
+
+#define TRACE_VALS_0()
+#define TRACE_VALS_1(a)				TRACE_ARG_VAL(a)
+#define TRACE_VALS_2(a, ...)		TRACE_ARG_VAL(a), TRACE_VALS_1(__VA_ARGS__)
+#define TRACE_VALS_3(a, ...)		TRACE_ARG_VAL(a), TRACE_VALS_2(__VA_ARGS__)
+#define TRACE_VALS_4(a, ...)		TRACE_ARG_VAL(a), TRACE_VALS_3(__VA_ARGS__)
+#define TRACE_VALS_5(a, ...)		TRACE_ARG_VAL(a), TRACE_VALS_4(__VA_ARGS__)
+#define TRACE_VALS_6(a, ...)		TRACE_ARG_VAL(a), TRACE_VALS_5(__VA_ARGS__)
+#define TRACE_VALS_7(a, ...)		TRACE_ARG_VAL(a), TRACE_VALS_6(__VA_ARGS__)
+#define TRACE_VALS_8(a, ...)		TRACE_ARG_VAL(a), TRACE_VALS_7(__VA_ARGS__)
+
+#define TRACE_TYPES_0()				0
+#define TRACE_TYPES_1(a)			TRACE_ARG_TYPE(a)
+#define TRACE_TYPES_2(a, ...)		(TRACE_ARG_TYPE(a) | (TRACE_TYPES_1(__VA_ARGS__) << 2))
+#define TRACE_TYPES_3(a, ...)		(TRACE_ARG_TYPE(a) | (TRACE_TYPES_2(__VA_ARGS__) << 2))
+#define TRACE_TYPES_4(a, ...)		(TRACE_ARG_TYPE(a) | (TRACE_TYPES_3(__VA_ARGS__) << 2))
+#define TRACE_TYPES_5(a, ...)		(TRACE_ARG_TYPE(a) | (TRACE_TYPES_4(__VA_ARGS__) << 2))
+#define TRACE_TYPES_6(a, ...)		(TRACE_ARG_TYPE(a) | (TRACE_TYPES_5(__VA_ARGS__) << 2))
+#define TRACE_TYPES_7(a, ...)		(TRACE_ARG_TYPE(a) | (TRACE_TYPES_6(__VA_ARGS__) << 2))
+#define TRACE_TYPES_8(a, ...)		(TRACE_ARG_TYPE(a) | (TRACE_TYPES_7(__VA_ARGS__) << 2))
+
+#if (CONF_TRACE_BINARY == 1)
+/* Site location and format, split by 0x1F. Lives only in the ELF, never in flash. */
+#define TRACE_EMIT(level, fmt, ...)											\
+	do {																	\
+		static const char trace_fmt_[] __attribute__((section(".trace_fmt"), used)) =	\
+				__FILE__ ":" TRACE_STRINGZ(__LINE__) "\x1f" fmt;			\
+		const uint32_t trace_args_[] = {0, TRACE_CAT(TRACE_VALS_, TRACE_NARGS(__VA_ARGS__))(__VA_ARGS__)};	\
+		trace_write((uint16_t)(uintptr_t)trace_fmt_, (level),				\
+				(uint16_t)TRACE_CAT(TRACE_TYPES_, TRACE_NARGS(__VA_ARGS__))(__VA_ARGS__),	\
+				TRACE_NARGS(__VA_ARGS__), &trace_args_[1]);					\
+	} while (0)
+#else
+#define TRACE_EMIT(level, fmt, ...)		printf(fmt "\r\n", ##__VA_ARGS__)
+#endif
+
+#if (CONF_TRACE_LEVEL >= TRACE_LEVEL_ERROR)
+#define TRACE_ERR(...)			TRACE_EMIT(TRACE_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define TRACE_ERR(...)			do {} while (0)
+#endif
+
+#if (CONF_TRACE_LEVEL >= TRACE_LEVEL_WARN)
+#define TRACE_WARN(...)			TRACE_EMIT(TRACE_LEVEL_WARN, __VA_ARGS__)
+#else
+#define TRACE_WARN(...)			do {} while (0)
+#endif
+
+#if (CONF_TRACE_LEVEL >= TRACE_LEVEL_INFO)
+#define TRACE_INFO(...)			TRACE_EMIT(TRACE_LEVEL_INFO, __VA_ARGS__)
+#else
+#define TRACE_INFO(...)			do {} while (0)
+#endif
+
+#if (CONF_TRACE_LEVEL >= TRACE_LEVEL_DEBUG)
+#define TRACE_DBG(...)			TRACE_EMIT(TRACE_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define TRACE_DBG(...)			do {} while (0)
+#endif
+
+#endif /* TRACE_H_INCLUDED */
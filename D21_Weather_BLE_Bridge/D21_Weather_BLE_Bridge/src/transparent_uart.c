@@ -3,22 +3,76 @@
 #include "ble_manager.h"
 #include "ble_utils.h"
 #include "transparent_uart.h"
+#include "req_queue.h"
+#include "wifi_power.h"
+#include "tunnel.h"
+#include "subscribe.h"
+#include "weather_units.h"
+#include "weather_cache.h"
+#include "trace.h"
 
 
 /* Transparent UART service */
 static transparent_uart_service_t  transparent_uart;
 
-/* Buffer data to be send over the air */
-static uint8_t send_data[APP_BUF_SIZE];
+/* Definition of one characteristic, see TU_CHARACTERISTICS */
+typedef struct
+{
+	uint8_t uuid[UUID_128_LEN];
+	at_ble_char_properties_t properties;
+	uint16_t value_max_len;
+	at_ble_attr_permissions_t value_permissions;
+}tu_char_def_t;
+
+#define TU_CHAR_DEF(id, uuid_str, props, max_len, permissions)	\
+	[id] = { .uuid = uuid_str, .properties = (props), .value_max_len = (max_len), .value_permissions = (permissions) },
+
+#define TU_CHAR_CHECK(id, uuid_str, props, max_len, permissions)	\
+	_Static_assert(sizeof(uuid_str) == UUID_128_LEN + 1, #id " UUID is not 128 bits");	\
+	_Static_assert(((max_len) > 0) && ((max_len) <= TU_ATT_VALUE_MAX_LEN), #id " value length out of range");
+
+TU_CHARACTERISTICS(TU_CHAR_CHECK)
+_Static_assert(sizeof(TU_SERVICE_UUID) == UUID_128_LEN + 1, "service UUID is not 128 bits");
+
+/* Transparent UART characteristics, in flash */
+static const tu_char_def_t tu_char_defs[TOTAL_NUM_OF_TU_CHARATERISTIC] = {
+	TU_CHARACTERISTICS(TU_CHAR_DEF)
+};
+
+/* Initial value of every characteristic, zero length */
+static uint8_t tu_char_init_value;
 
 /* Remote device connection info */
 static remote_dev_info_t remote_dev_info[MAX_REMOTE_DEVICE] = {0};
 
+/* Bit of a remote_dev_info slot in the slot masks below */
+#define SLOT_BIT(slot)		(1ul << (slot))
+#define ALL_SLOTS			(SLOT_BIT(MAX_REMOTE_DEVICE) - 1)
+/* No slot for a connection handle */
+#define NO_SLOT				0xFF
+
+/* Write choosing the units of a connection */
+#define UNITS_CMD			"UNITS:"
+#define UNITS_CMD_LEN		(sizeof(UNITS_CMD) - 1)
+
+_Static_assert(MAX_REMOTE_DEVICE <= 32, "slot masks are 32 bits");
+
+/* remote_dev_info slot of each connection handle plus one, 0 when not connected */
+static uint8_t conn_slot[TU_CONN_HANDLE_COUNT];
+/* Free remote_dev_info slots */
+static uint32_t free_slots = ALL_SLOTS;
+/* Connected slots in each ble_app_sq_state_t */
+static uint32_t slots_in_state[BLE_APP_WEATHER_UNDER_PROCESSING + 1];
+
 /* BLE Application state */
 static ble_app_init_t ble_app_state = BLE_APP_INIT;
 
 static bool is_ble_advertising = false;
 
+/* Scan response data, see ble_app_set_scan_resp() */
+static uint8_t scan_resp_data[31];
+static uint8_t scan_resp_len;
+
 /* Stock symbol */
 //static char stock_symbol[10];
 static char city_name[20];
@@ -29,15 +83,16 @@ static at_ble_status_t ble_app_connected_event(void *param);
 static at_ble_status_t ble_app_disconnected_event(void *param);
 static at_ble_status_t ble_app_char_changed_event(void *param);
 static at_ble_status_t ble_app_noti_confirmed_event(void *param);
+static at_ble_status_t ble_app_read_authorize_event(void *param);
+static at_ble_status_t ble_app_mtu_changed_event(void *param);
 static at_ble_status_t ble_app_start_adv(void);
 static at_ble_status_t ble_app_tu_primary_service_define(transparent_uart_service_t *tu_serv);
-static at_ble_status_t ble_app_tu_serv_init(uint8_t *buf, uint16_t len);
 static at_ble_status_t ble_app_tu_serv_send_data(uint16_t connhandle, uint8_t *databuf, uint16_t datalen);
 static void ble_app_state_set(ble_app_init_t state);
 
 /* Request stock quote from internet */
 //extern void request_stock_quote(char *symbol);
-extern void request_weather(char* symbol);
+extern bool request_weather(uint16_t conn_handle, char* symbol);
 
 /* GAP event callback list */
 const ble_gap_event_cb_t app_ble_gap_event = {
@@ -49,41 +104,67 @@ const ble_gap_event_cb_t app_ble_gap_event = {
 const ble_gatt_server_event_cb_t app_ble_gatt_server_event = {
 	.notification_confirmed = ble_app_noti_confirmed_event,
 	.characteristic_changed = ble_app_char_changed_event,
+	.read_authorize_request = ble_app_read_authorize_event,
+	.mtu_changed_indication = ble_app_mtu_changed_event,
 };
 
+/** @brief Lowest slot in a non-empty slot mask */
+static uint8_t ble_app_slot_first(uint32_t slots)
+{
+	return (uint8_t)__builtin_ctzl(slots);
+}
+
+/** @brief Slot of a connection, NO_SLOT if it is not connected */
+static uint8_t ble_app_conn_slot(at_ble_handle_t handle)
+{
+	if((handle >= TU_CONN_HANDLE_COUNT) || !conn_slot[handle])
+	{
+		return NO_SLOT;
+	}
+	return conn_slot[handle] - 1;
+}
+
+/** @brief Move a connected slot to another state */
+static void ble_app_sq_state_set(uint8_t conn_index, ble_app_sq_state_t state)
+{
+	slots_in_state[remote_dev_info[conn_index].sq_state] &= ~SLOT_BIT(conn_index);
+	remote_dev_info[conn_index].sq_state = state;
+	slots_in_state[state] |= SLOT_BIT(conn_index);
+}
+
 /* Callback registered for AT_BLE_CONNECTED event from stack */
 static at_ble_status_t ble_app_connected_event(void *param)
 {
 	at_ble_connected_t *conn_param = (at_ble_connected_t *) param;
-	bool disconnect = true;
 	
 	if(AT_BLE_SUCCESS == conn_param->conn_status)
 	{
-		/* Find an empty space for new device */
-		for(uint8_t conn_index = 0; conn_index < MAX_REMOTE_DEVICE; conn_index++)
+		if(free_slots && (conn_param->handle < TU_CONN_HANDLE_COUNT))
 		{
-			if(!remote_dev_info[conn_index].entry_flag)
+			/* Take a free slot for the new device */
+			uint8_t conn_index = ble_app_slot_first(free_slots);
+			
+			/* Copy connection parameters of remote device */
+			memcpy(&remote_dev_info[conn_index].remote_dev_conn_info, conn_param, sizeof(at_ble_connected_t));
+			/* mark this entry as used */
+			free_slots &= ~SLOT_BIT(conn_index);
+			conn_slot[conn_param->handle] = conn_index + 1;
+			remote_dev_info[conn_index].mtu = AT_MTU_VAL_MIN;
+			remote_dev_info[conn_index].sq_state = BLE_APP_CITY_NAME_NOT_RECEIVED;
+			remote_dev_info[conn_index].units = CONF_BRIDGE_DEFAULT_UNITS;
+			slots_in_state[BLE_APP_CITY_NAME_NOT_RECEIVED] |= SLOT_BIT(conn_index);
+			wifi_power_ble_connected();
+			/* Start advertisement again */
+			is_ble_advertising = false;
+			
+			/* If there is no connection exist before, mark it as connected now.
+				So that it can process user data */
+			if(ble_app_state < BLE_APP_CONNECTED)
 			{
-				/* Copy connection parameters of remote device */
-				memcpy(&remote_dev_info[conn_index].remote_dev_conn_info, conn_param, sizeof(at_ble_connected_t));
-				/* mark this entry as used */
-				remote_dev_info[conn_index].entry_flag = true;
-				/* There is enough space to accommodate this device */
-				disconnect = false;
-				/* Start advertisement again */
-				is_ble_advertising = false;
-				
-				/* If there is no connection exist before, mark it as connected now.
-					So that it can process user data */
-				if(ble_app_state < BLE_APP_CONNECTED)
-				{
-					ble_app_state = BLE_APP_CONNECTED;
-				}
-				break;
+				ble_app_state = BLE_APP_CONNECTED;
 			}
 		}
-		
-		if(disconnect)
+		else
 		{
 			/* Since there is not enough space to accommodate this device, disconnect it */
 			at_ble_disconnect(conn_param->handle, AT_BLE_REMOTE_DEV_TERM_LOW_RESOURCES);
@@ -100,15 +181,20 @@ static at_ble_status_t ble_app_disconnected_event(void *param)
 	
 	if(disconnected->status == AT_BLE_SUCCESS)
 	{
+		uint8_t conn_index = ble_app_conn_slot(disconnected->handle);
+		
 		LED_Off(LED0);
-		for(uint8_t conn_index = 0; conn_index < MAX_REMOTE_DEVICE; conn_index++)
+		if(conn_index != NO_SLOT)
 		{
-			if(remote_dev_info[conn_index].remote_dev_conn_info.handle == disconnected->handle)
-			{
-				memset(&remote_dev_info[conn_index], 0, sizeof(remote_dev_info_t));
-				ble_app_state = BLE_APP_DISCONNECTED;
-				break;
-			}
+			slots_in_state[remote_dev_info[conn_index].sq_state] &= ~SLOT_BIT(conn_index);
+			memset(&remote_dev_info[conn_index], 0, sizeof(remote_dev_info_t));
+			conn_slot[disconnected->handle] = 0;
+			free_slots |= SLOT_BIT(conn_index);
+			req_queue_drop(disconnected->handle);
+			tunnel_drop(disconnected->handle);
+			subscribe_drop(disconnected->handle);
+			wifi_power_ble_disconnected();
+			ble_app_state = BLE_APP_DISCONNECTED;
 		}
 	}
 	
@@ -123,7 +209,12 @@ static at_ble_status_t ble_app_char_changed_event(void *param)
 	
 	if(char_data->status == AT_BLE_SUCCESS)
 	{
-		if((char_data->char_len == 2) && ((uint16_t)*char_data->char_new_value == 0x0001))
+		if(char_data->char_handle == transparent_uart.chars[CHAR_TCP].char_val_handle)
+		{
+			wifi_power_activity();
+			tunnel_write(char_data->conn_handle, char_data->char_new_value, char_data->char_len);
+		}
+		else if((char_data->char_len == 2) && ((uint16_t)*char_data->char_new_value == 0x0001))
 		{
 			/* Notification enabled */
 			/* The phone Apps should enable notifications (mandatory). So not keep tracking, who is enabled and who is not */
@@ -131,23 +222,33 @@ static at_ble_status_t ble_app_char_changed_event(void *param)
 		}
 		else
 		{
-			for(uint8_t conn_index = 0; conn_index < MAX_REMOTE_DEVICE; conn_index++)
+			uint8_t conn_index = ble_app_conn_slot(char_data->conn_handle);
+			
+			if(conn_index != NO_SLOT)
 			{
-				if((remote_dev_info[conn_index].remote_dev_conn_info.handle == char_data->conn_handle) && (remote_dev_info[conn_index].entry_flag))
+				wifi_power_activity();
+				if(subscribe_write(char_data->conn_handle, char_data->char_new_value, char_data->char_len))
+				{
+					return AT_BLE_SUCCESS;
+				}
+				/* "UNITS:<units>" chooses the units of the following answers */
+				if((char_data->char_len > UNITS_CMD_LEN) && !memcmp(char_data->char_new_value, UNITS_CMD, UNITS_CMD_LEN))
 				{
-					for(index = 0; index < char_data->char_len; index++)
+					if(!weather_units_parse((const char *)&char_data->char_new_value[UNITS_CMD_LEN], char_data->char_len - UNITS_CMD_LEN,
+							&remote_dev_info[conn_index].units))
 					{
-						//DBG_LOG_CONT("%c",char_data->char_new_value[index]);
-//						remote_dev_info[conn_index].stock_symbol[index] = (char)char_data->char_new_value[index];
-						remote_dev_info[conn_index].city_name[index] = (char)char_data->char_new_value[index];
+						TRACE_WARN("unknown units");
 					}
-//					remote_dev_info[conn_index].stock_symbol[index] = '\0';
-//					remote_dev_info[conn_index].sq_state = BLE_APP_STOCK_SYMBOL_RECEIVED;
-					remote_dev_info[conn_index].city_name[index] = '\0';
-					remote_dev_info[conn_index].sq_state = BLE_APP_CITY_NAME_RECEIVED;
-					ble_app_state = BLE_APP_SYMBOL_RECEIVED;
-					break;
+					return AT_BLE_SUCCESS;
+				}
+				for(index = 0; (index < char_data->char_len) && (index < sizeof(remote_dev_info[conn_index].city_name) - 1); index++)
+				{
+					//DBG_LOG_CONT("%c",char_data->char_new_value[index]);
+					remote_dev_info[conn_index].city_name[index] = (char)char_data->char_new_value[index];
 				}
+				remote_dev_info[conn_index].city_name[index] = '\0';
+				ble_app_sq_state_set(conn_index, BLE_APP_CITY_NAME_RECEIVED);
+				ble_app_state = BLE_APP_SYMBOL_RECEIVED;
 			}
 		}
 	}
@@ -165,11 +266,58 @@ static at_ble_status_t ble_app_noti_confirmed_event(void *param)
 	
 	if (noti_cmpl->status != AT_BLE_SUCCESS)
 	{
-		DBG_LOG("Sending Notification over the air failed");
+		TRACE_WARN("Sending Notification over the air failed");
 	}
+	tunnel_notified(noti_cmpl->conn_handle);
 	return AT_BLE_SUCCESS;
 }
 
+/**
+* \ The client exchanged the ATT MTU
+*/
+static at_ble_status_t ble_app_mtu_changed_event(void *param)
+{
+	at_ble_mtu_changed_ind_t *mtu_ind = (at_ble_mtu_changed_ind_t *)param;
+	uint8_t conn_index = ble_app_conn_slot(mtu_ind->conhdl);
+	
+	if(conn_index != NO_SLOT)
+	{
+		remote_dev_info[conn_index].mtu = mtu_ind->mtu_value;
+	}
+	return AT_BLE_SUCCESS;
+}
+
+/**
+* \ Read of the current weather: fill in the value for this connection, then let the read go on
+*/
+static at_ble_status_t ble_app_read_authorize_event(void *param)
+{
+	at_ble_read_authorize_request_t *read_req = (at_ble_read_authorize_request_t *)param;
+	char value[TU_WEATHER_CHAR_MAX_LEN];
+	uint16_t len = 0;
+	uint8_t conn_index;
+	
+	if(read_req->char_handle != transparent_uart.chars[CHAR_WEATHER].char_val_handle)
+	{
+		return at_ble_read_authorize_reply(read_req->conn_handle, read_req->char_handle, false);
+	}
+	
+	conn_index = ble_app_conn_slot(read_req->conn_handle);
+	if(conn_index != NO_SLOT)
+	{
+		wifi_power_activity();
+		/* Empty until a city is written and its weather is cached */
+		if(remote_dev_info[conn_index].city_name[0])
+		{
+			len = weather_cached_text(remote_dev_info[conn_index].city_name, remote_dev_info[conn_index].units, value, sizeof(value));
+		}
+	}
+	
+	/* The value is shared; events are handled one at a time, so it holds until the read is answered */
+	at_ble_characteristic_value_set(transparent_uart.chars[CHAR_WEATHER].char_val_handle, (uint8_t *)value, len);
+	return at_ble_read_authorize_reply(read_req->conn_handle, read_req->char_handle, true);
+}
+
 /**
 * \ Initialize and start advertisement
 */
@@ -184,22 +332,22 @@ static at_ble_status_t ble_app_start_adv(void)
 	
 	at_ble_status_t status = AT_BLE_SUCCESS;
 	
-	status = at_ble_adv_data_set(adv_data, sizeof(adv_data), NULL, 0);
+	status = at_ble_adv_data_set(adv_data, sizeof(adv_data), scan_resp_len ? scan_resp_data : NULL, scan_resp_len);
 	if(AT_BLE_SUCCESS != status)
 	{
-		DBG_LOG("Adv data set failed. Reason = 0x%02X", status);
+		TRACE_ERR("Adv data set failed. Reason = 0x%02X", status);
 		return status;
 	}
 	
 	status = at_ble_adv_start(AT_BLE_ADV_TYPE_UNDIRECTED, AT_BLE_ADV_GEN_DISCOVERABLE, NULL, AT_BLE_ADV_FP_ANY, 160, 0, false);
 	if(AT_BLE_SUCCESS != status)
 	{
-		DBG_LOG("Adv start failed. Reason = 0x%02X", status);
+		TRACE_ERR("Adv start failed. Reason = 0x%02X", status);
 		return status;
 	}
 	
 	is_ble_advertising = true;
-	DBG_LOG("Advertisement started");
+	TRACE_INFO("Advertisement started");
 	return status;
 }
 
@@ -216,7 +364,7 @@ static at_ble_status_t ble_app_tu_serv_send_data(uint16_t connhandle, uint8_t *d
 	status = at_ble_characteristic_value_get(transparent_uart.chars[CHAR_TX].client_config_handle, (uint8_t *)&value, &length);
 	if (status != AT_BLE_SUCCESS)
 	{
-		DBG_LOG("at_ble_characteristic_value_get value get failed = 0x%02X", status);
+		TRACE_ERR("at_ble_characteristic_value_get value get failed = 0x%02X", status);
 		return status;
 	}
 	if(value == 1)
@@ -226,124 +374,80 @@ static at_ble_status_t ble_app_tu_serv_send_data(uint16_t connhandle, uint8_t *d
 //		printf("status = %x\r\n",status);
 		if (status != AT_BLE_SUCCESS)
 		{
-			DBG_LOG("at_ble_characteristic_value_set value set failed = 0x%02X", status);
+			TRACE_ERR("at_ble_characteristic_value_set value set failed = 0x%02X", status);
 			return status;
 		}
 //		printf("notif send\r\n");
 		status = at_ble_notification_send(connhandle, transparent_uart.chars[CHAR_TX].char_val_handle);
 		if (status != AT_BLE_SUCCESS)
 		{
-			DBG_LOG("at_ble_notification_send  failed = 0x%02X", status);
+			TRACE_ERR("at_ble_notification_send  failed = 0x%02X", status);
 			return status;
 		}
 	}
 	return status;
 }
 
-/** @brief Send stock quote to remote device
+/** @brief Send weather data to remote device
   * 
-  * @param[in] data	Stock quote
-  * @param[in] data_len	Stock quote length
+  * @param[in] conn_handle	Connection that asked for it
+  * @param[in] data	Weather data
+  * @param[in] data_len	Weather data length
   *
   * @return 
   */
 //void ble_app_send_stock_quote(uint8_t *data, uint16_t data_len)
-void ble_app_send_weather_data(uint8_t *data, uint16_t data_len)
+void ble_app_send_weather_data(uint16_t conn_handle, uint8_t *data, uint16_t data_len)
 {
-	for(uint8_t index = 0; index < MAX_REMOTE_DEVICE; index++)
+	uint8_t index = ble_app_conn_slot(conn_handle);
+	
+	if((index != NO_SLOT) && (remote_dev_info[index].sq_state == BLE_APP_WEATHER_UNDER_PROCESSING))
 	{
-//		if(remote_dev_info[index].sq_state == BLE_APP_STOCK_QUOTE_UNDER_PROCESSING)
-		if(remote_dev_info[index].sq_state == BLE_APP_WEATHER_UNDER_PROCESSING)
-		{
-//			printf("send data packet\r\n");
-			ble_app_tu_serv_send_data(remote_dev_info[index].remote_dev_conn_info.handle, data, data_len);
-			/* This application is NOT resending stock quote, if it fails first time. */
-//			remote_dev_info[index].sq_state = BLE_APP_STOCK_SYMBOL_NOT_RECEIVED;
-			remote_dev_info[index].sq_state = BLE_APP_CITY_NAME_NOT_RECEIVED;
-//			printf("breaking from send packet\r\n");
-			break;
-		}
+		ble_app_tu_serv_send_data(conn_handle, data, data_len);
+		/* This application is NOT resending stock quote, if it fails first time. */
+		ble_app_sq_state_set(index, BLE_APP_CITY_NAME_NOT_RECEIVED);
 	}
 }
 
-/** @brief Initialize the Transparent UART
-  * 
-  * @param[in] buf		Buffer pointer for data to be send
-  * @param[in] len      size of buffer
-  *
-  * @return Upon successful completion the function shall return @ref AT_BLE_SUCCESS,
-  * Otherwise the function shall return @ref at_ble_status_t
-  */
-static at_ble_status_t ble_app_tu_serv_init(uint8_t *buf, uint16_t len)
+at_ble_status_t ble_app_push_weather(uint16_t conn_handle, uint8_t *data, uint16_t data_len)
 {
-	transparent_uart.serv_handle = 0;
-	transparent_uart.serv_uuid.type = AT_BLE_UUID_128;
-	memcpy(transparent_uart.serv_uuid.uuid, TU_SERVICE_UUID, UUID_128_LEN);
-	
-	/* Characteristic TX */
-	transparent_uart.chars[CHAR_TX].char_val_handle = 0;
-	transparent_uart.chars[CHAR_TX].uuid.type = AT_BLE_UUID_128;
-	memcpy(transparent_uart.chars[CHAR_TX].uuid.uuid, TU_TX_CHAR_UUID, UUID_128_LEN);
-	transparent_uart.chars[CHAR_TX].properties = AT_BLE_CHAR_NOTIFY | AT_BLE_CHAR_WRITE | AT_BLE_CHAR_WRITE_WITHOUT_RESPONSE;
-	transparent_uart.chars[CHAR_TX].init_value = buf;
-	transparent_uart.chars[CHAR_TX].value_init_len = len;
-	transparent_uart.chars[CHAR_TX].value_max_len = len;
-	transparent_uart.chars[CHAR_TX].presentation_format = NULL;
-	transparent_uart.chars[CHAR_TX].value_permissions = AT_BLE_ATTR_WRITABLE_NO_AUTHN_NO_AUTHR;
-	transparent_uart.chars[CHAR_TX].user_desc_handle = 0;
-	transparent_uart.chars[CHAR_TX].user_desc = NULL;
-	transparent_uart.chars[CHAR_TX].user_desc_len = 0;
-	transparent_uart.chars[CHAR_TX].user_desc_max_len = 0;
-	transparent_uart.chars[CHAR_TX].user_desc_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	transparent_uart.chars[CHAR_TX].client_config_handle = 0;
-	transparent_uart.chars[CHAR_TX].client_config_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	transparent_uart.chars[CHAR_TX].server_config_handle = 0;
-	transparent_uart.chars[CHAR_TX].server_config_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	
-	/* Characteristic RX */
-	transparent_uart.chars[CHAR_RX].char_val_handle = 0;
-	transparent_uart.chars[CHAR_RX].uuid.type = AT_BLE_UUID_128;
-	memcpy(transparent_uart.chars[CHAR_RX].uuid.uuid, TU_RX_CHAR_UUID, UUID_128_LEN);
-	transparent_uart.chars[CHAR_RX].properties = AT_BLE_CHAR_WRITE | AT_BLE_CHAR_WRITE_WITHOUT_RESPONSE;
-	transparent_uart.chars[CHAR_RX].init_value = buf;
-	transparent_uart.chars[CHAR_RX].value_init_len = len;
-	transparent_uart.chars[CHAR_RX].value_max_len = len;
-	transparent_uart.chars[CHAR_RX].presentation_format = NULL;
-	transparent_uart.chars[CHAR_RX].value_permissions = AT_BLE_ATTR_WRITABLE_NO_AUTHN_NO_AUTHR;
-	transparent_uart.chars[CHAR_RX].user_desc_handle = 0;
-	transparent_uart.chars[CHAR_RX].user_desc = NULL;
-	transparent_uart.chars[CHAR_RX].user_desc_len = 0;
-	transparent_uart.chars[CHAR_RX].user_desc_max_len = 0;
-	transparent_uart.chars[CHAR_RX].user_desc_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	transparent_uart.chars[CHAR_RX].client_config_handle = 0;
-	transparent_uart.chars[CHAR_RX].client_config_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	transparent_uart.chars[CHAR_RX].server_config_handle = 0;
-	transparent_uart.chars[CHAR_RX].server_config_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	
-	/* Characteristic TCP */
-	transparent_uart.chars[CHAR_TCP].char_val_handle = 0;
-	transparent_uart.chars[CHAR_TCP].uuid.type = AT_BLE_UUID_128;
-	memcpy(transparent_uart.chars[CHAR_TCP].uuid.uuid, TU_TCP_CHAR_UUID, UUID_128_LEN);
-	transparent_uart.chars[CHAR_TCP].properties = AT_BLE_CHAR_NOTIFY | AT_BLE_CHAR_WRITE;
-	transparent_uart.chars[CHAR_TCP].init_value = buf;
-	transparent_uart.chars[CHAR_TCP].value_init_len = len;
-	transparent_uart.chars[CHAR_TCP].value_max_len = len;
-	transparent_uart.chars[CHAR_TCP].presentation_format = NULL;
-	transparent_uart.chars[CHAR_TCP].value_permissions = AT_BLE_ATTR_WRITABLE_NO_AUTHN_NO_AUTHR;
-	transparent_uart.chars[CHAR_TCP].user_desc_handle = 0;
-	transparent_uart.chars[CHAR_TCP].user_desc = NULL;
-	transparent_uart.chars[CHAR_TCP].user_desc_len = 0;
-	transparent_uart.chars[CHAR_TCP].user_desc_max_len = 0;
-	transparent_uart.chars[CHAR_TCP].user_desc_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	transparent_uart.chars[CHAR_TCP].client_config_handle = 0;
-	transparent_uart.chars[CHAR_TCP].client_config_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
-	transparent_uart.chars[CHAR_TCP].server_config_handle = 0;
-	transparent_uart.chars[CHAR_TCP].server_config_permissions = AT_BLE_ATTR_NO_PERMISSIONS;
+	if(ble_app_conn_slot(conn_handle) == NO_SLOT)
+	{
+		return AT_BLE_FAILURE;
+	}
+	return ble_app_tu_serv_send_data(conn_handle, data, data_len);
+}
+
+at_ble_status_t ble_app_tunnel_notify(uint16_t conn_handle, uint8_t *data, uint16_t len)
+{
+	at_ble_status_t status;
 	
-	return AT_BLE_SUCCESS;
+	status = at_ble_characteristic_value_set(transparent_uart.chars[CHAR_TCP].char_val_handle, data, len);
+	if(status == AT_BLE_SUCCESS)
+	{
+		status = at_ble_notification_send(conn_handle, transparent_uart.chars[CHAR_TCP].char_val_handle);
+	}
+	return status;
+}
+
+uint16_t ble_app_conn_mtu(uint16_t conn_handle)
+{
+	uint8_t conn_index = ble_app_conn_slot(conn_handle);
+	
+	return (conn_index == NO_SLOT) ? AT_MTU_VAL_MIN : remote_dev_info[conn_index].mtu;
+}
+
+uint8_t ble_app_units(uint16_t conn_handle)
+{
+	uint8_t conn_index = ble_app_conn_slot(conn_handle);
+	
+	return (conn_index == NO_SLOT) ? CONF_BRIDGE_DEFAULT_UNITS : remote_dev_info[conn_index].units;
 }
 
 /** @brief Register Transparent UART service
+  * 
+  * The characteristics are built on the stack from tu_char_defs; only the
+  * handles the stack assigns are kept.
   * 
   * @param[in] tu_serv	Transparent UART service
   *
@@ -352,9 +456,36 @@ static at_ble_status_t ble_app_tu_serv_init(uint8_t *buf, uint16_t len)
   */
 static at_ble_status_t ble_app_tu_primary_service_define(transparent_uart_service_t *tu_serv)
 {
-	return(at_ble_primary_service_define(&tu_serv->serv_uuid,
-										&tu_serv->serv_handle, NULL, 0, 
-										&tu_serv->chars[CHAR_TX], TOTAL_NUM_OF_TU_CHARATERISTIC));
+	at_ble_uuid_t serv_uuid;
+	at_ble_characteristic_t chars[TOTAL_NUM_OF_TU_CHARATERISTIC];
+	at_ble_status_t status;
+	
+	serv_uuid.type = AT_BLE_UUID_128;
+	memcpy(serv_uuid.uuid, TU_SERVICE_UUID, UUID_128_LEN);
+	
+	/* No descriptors, no presentation format, values start empty */
+	memset(chars, 0, sizeof(chars));
+	for(uint8_t index = 0; index < TOTAL_NUM_OF_TU_CHARATERISTIC; index++)
+	{
+		chars[index].uuid.type = AT_BLE_UUID_128;
+		memcpy(chars[index].uuid.uuid, tu_char_defs[index].uuid, UUID_128_LEN);
+		chars[index].properties = tu_char_defs[index].properties;
+		chars[index].init_value = &tu_char_init_value;
+		chars[index].value_max_len = tu_char_defs[index].value_max_len;
+		chars[index].value_permissions = tu_char_defs[index].value_permissions;
+	}
+	
+	tu_serv->serv_handle = 0;
+	status = at_ble_primary_service_define(&serv_uuid, &tu_serv->serv_handle, NULL, 0,
+										chars, TOTAL_NUM_OF_TU_CHARATERISTIC);
+	
+	for(uint8_t index = 0; index < TOTAL_NUM_OF_TU_CHARATERISTIC; index++)
+	{
+		tu_serv->chars[index].char_val_handle = chars[index].char_val_handle;
+		tu_serv->chars[index].client_config_handle = chars[index].client_config_handle;
+	}
+	
+	return status;
 }
 
 /** @brief Set BLE application state
@@ -385,12 +516,10 @@ at_ble_status_t ble_app_init(void)
 	ble_mgr_events_callback_handler(REGISTER_CALL_BACK, BLE_GATT_SERVER_EVENT_TYPE, &app_ble_gatt_server_event);
 	
 	
-	/* Define the Transparent UART primary service in the GATT server database */
-	ble_app_tu_serv_init(send_data, APP_BUF_SIZE);
-	/* Register Primary service */
+	/* Register the Transparent UART primary service in the GATT server database */
 	if((status = ble_app_tu_primary_service_define(&transparent_uart)) != AT_BLE_SUCCESS)
 	{
-		DBG_LOG("Transparent UART Service definition failed,reason %x",status);
+		TRACE_ERR("Transparent UART Service definition failed,reason %x",status);
 		return status;
 	}
 	
@@ -426,6 +555,63 @@ bool ble_app_is_init_state(void)
 	return ble_app_state == BLE_APP_INIT;
 }
 
+at_ble_status_t ble_app_set_scan_resp(const uint8_t *data, uint8_t len)
+{
+	at_ble_adv_data_update_on_the_fly_t update;
+	
+	if(len > sizeof(scan_resp_data))
+	{
+		return AT_BLE_INVALID_PARAM;
+	}
+	memcpy(scan_resp_data, data, len);
+	scan_resp_len = len;
+	
+	if(!is_ble_advertising)
+	{
+		return AT_BLE_SUCCESS;
+	}
+	update.presence_bit_mask = SCN_RESP_DATA_PRESENT;
+	update.adv_data = NULL;
+	update.adv_data_len = 0;
+	update.scan_resp_data = scan_resp_data;
+	update.scan_response_data_len = scan_resp_len;
+	return at_ble_adv_data_update_on_the_fly(&update);
+}
+
+bool ble_app_is_idle(void)
+{
+	switch(ble_app_state)
+	{
+		case BLE_APP_INIT:
+		case BLE_APP_ADV_STARTED:
+			return true;
+		
+		case BLE_APP_CONNECTED:
+		{
+			/* Advertising is restarted while there is a free slot */
+			return is_ble_advertising || !free_slots;
+		}
+		
+		case BLE_APP_DISCONNECTED:
+		{
+			/* Once advertising runs again, only the move to BLE_APP_ADV_STARTED is left,
+				and that needs another pass when the last device went away */
+			return (is_ble_advertising || !free_slots) && (free_slots != ALL_SLOTS);
+		}
+		
+		case BLE_APP_SYMBOL_RECEIVED:
+		{
+			/* Cities are all handed to the request queue; the state is left when
+				the last answer has gone out, which needs another pass */
+			return !slots_in_state[BLE_APP_CITY_NAME_RECEIVED] &&
+					slots_in_state[BLE_APP_WEATHER_UNDER_PROCESSING];
+		}
+		
+		default:
+			return false;
+	}
+}
+
 /** @brief Get stock symbol sent by remote device
   * 
   * @param
@@ -435,15 +621,13 @@ bool ble_app_is_init_state(void)
 //char* ble_app_get_stock_symbol(void)
 char* ble_app_get_city_name(void)
 {
-	for(uint8_t conn_index = 0; conn_index < MAX_REMOTE_DEVICE; conn_index++)
+	uint32_t slots = slots_in_state[BLE_APP_WEATHER_UNDER_PROCESSING];
+	
+	if(!slots)
 	{
-		if(remote_dev_info[conn_index].sq_state == BLE_APP_WEATHER_UNDER_PROCESSING)
-		{
-			return remote_dev_info[conn_index].city_name;
-		}
+		return NULL;
 	}
-	
-	return NULL;
+	return remote_dev_info[ble_app_slot_first(slots)].city_name;
 }
 
 /** @brief Handle different BLE application states and BLE events
@@ -484,40 +668,24 @@ void ble_app_process(void)
 		
 		case BLE_APP_CONNECTED:
 		{
-			for(uint8_t conn_index = 0; conn_index < MAX_REMOTE_DEVICE; conn_index++)
+			if(free_slots && !is_ble_advertising)
 			{
-				if(!remote_dev_info[conn_index].entry_flag && !is_ble_advertising)
-				{
-					is_ble_advertising = true;
-					/* Still there is room for more devices. Start advertisement */
-					ble_app_start_adv();
-					
-					break;
-				}
+				is_ble_advertising = true;
+				/* Still there is room for more devices. Start advertisement */
+				ble_app_start_adv();
 			}
 			break;
 		}
 		
 		case BLE_APP_DISCONNECTED:
 		{
-			bool conn_exist = false;
-			
 			/* Start advertisement, if it is not in progress */
 			if(!is_ble_advertising)
 			{
 				status = ble_app_start_adv();
 			}
 			
-			for(uint8_t conn_index = 0; conn_index < MAX_REMOTE_DEVICE; conn_index++)
-			{
-				if(remote_dev_info[conn_index].entry_flag)
-				{
-					conn_exist = true;
-					break;
-				}
-			}
-			
-			if(conn_exist)
+			if(free_slots != ALL_SLOTS)
 			{
 				/* Since there are other connections, don't change the application state */
 				break;
@@ -537,31 +705,24 @@ void ble_app_process(void)
 		
 		case BLE_APP_SYMBOL_RECEIVED:
 		{
-			/* Set to true, if any other devices requested stock quote. Otherwise set to false */
-//			bool more_stock_symbol = false;
-			bool more_city_name = false;
+			/* Only the connections that wrote a city are visited */
+			uint32_t received = slots_in_state[BLE_APP_CITY_NAME_RECEIVED];
 			
-			for(uint8_t conn_index = 0; conn_index < MAX_REMOTE_DEVICE; conn_index++)
+			while(received)
 			{
-//				if(remote_dev_info[conn_index].sq_state == BLE_APP_STOCK_SYMBOL_RECEIVED)
-				if(remote_dev_info[conn_index].sq_state == BLE_APP_CITY_NAME_RECEIVED)
-				{
-//					remote_dev_info[conn_index].sq_state = BLE_APP_STOCK_QUOTE_UNDER_PROCESSING;
-					remote_dev_info[conn_index].sq_state = BLE_APP_WEATHER_UNDER_PROCESSING;
-					//request_stock_quote(remote_dev_info[conn_index].stock_symbol);
-					request_weather(remote_dev_info[conn_index].city_name);
-				}
+				uint8_t conn_index = ble_app_slot_first(received);
 				
-//				if(remote_dev_info[conn_index].sq_state == BLE_APP_STOCK_SYMBOL_RECEIVED)
-				if(remote_dev_info[conn_index].sq_state == BLE_APP_WEATHER_UNDER_PROCESSING)
+				received &= ~SLOT_BIT(conn_index);
+				ble_app_sq_state_set(conn_index, BLE_APP_WEATHER_UNDER_PROCESSING);
+				if(!request_weather(remote_dev_info[conn_index].remote_dev_conn_info.handle,
+									remote_dev_info[conn_index].city_name))
 				{
-//					more_stock_symbol = true;
-					more_city_name = true;
+					ble_app_sq_state_set(conn_index, BLE_APP_CITY_NAME_NOT_RECEIVED);
 				}
 			}
 			
-//			if(!more_stock_symbol)
-			if(!more_city_name)
+			/* Stay here while any other device waits for weather */
+			if(!slots_in_state[BLE_APP_WEATHER_UNDER_PROCESSING])
 			{
 				ble_app_state = BLE_APP_CONNECTED;
 			}
@@ -577,4 +738,4 @@ void ble_app_process(void)
 	{
 		ble_event_task();
 	}
-}
\ No newline at end of file
+}
\ No newline at end of file
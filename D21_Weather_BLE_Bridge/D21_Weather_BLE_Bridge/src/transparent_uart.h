@@ -1,6 +1,7 @@
 #ifndef TRANSPARENT_UART_SERVICE_H_
 #define TRANSPARENT_UART_SERVICE_H_
 #include "at_ble_api.h"
+#include "conf_bridge.h"
 
 /****************************************************************************************
 *							        Macros	                                     							*
@@ -35,9 +36,39 @@
 /** \brief Transparent UART TCP characteristic UUID */
 #define TU_TCP_CHAR_UUID			("\x7e\x3b\x07\xff\x1c\x51\x49\x2f\xb3\x39\x8a\x4c\x43\x53\x53\x49")
 
-#define TOTAL_NUM_OF_TU_CHARATERISTIC	3
+/** \brief Current weather characteristic UUID, read for the city last written on the connection */
+#define TU_WEATHER_CHAR_UUID		("\x5c\x1e\x9a\x20\x4b\x77\x4e\x12\x8d\x3f\x61\x0b\x43\x53\x53\x49")
+
+/** \brief Longest current weather value */
+#define TU_WEATHER_CHAR_MAX_LEN		(100)
+
 #define UUID_128_LEN					16
-#define MAX_REMOTE_DEVICE				3
+
+/** \brief Longest attribute value allowed by ATT */
+#define TU_ATT_VALUE_MAX_LEN		(512)
+
+/**
+ * \brief Transparent UART characteristics, in attribute order.
+ *
+ * X(id, uuid, properties, value max length, value permissions). The list
+ * expands into the CHAR_xxx indexes and the const definition table, so a
+ * characteristic is added by adding its line here.
+ */
+#define TU_CHARACTERISTICS(X)																	\
+	X(CHAR_TX,		TU_TX_CHAR_UUID,		AT_BLE_CHAR_NOTIFY | AT_BLE_CHAR_WRITE | AT_BLE_CHAR_WRITE_WITHOUT_RESPONSE,	\
+				APP_BUF_SIZE,				AT_BLE_ATTR_WRITABLE_NO_AUTHN_NO_AUTHR)					\
+	X(CHAR_RX,		TU_RX_CHAR_UUID,		AT_BLE_CHAR_WRITE | AT_BLE_CHAR_WRITE_WITHOUT_RESPONSE,	\
+				APP_BUF_SIZE,				AT_BLE_ATTR_WRITABLE_NO_AUTHN_NO_AUTHR)					\
+	X(CHAR_TCP,		TU_TCP_CHAR_UUID,		AT_BLE_CHAR_NOTIFY | AT_BLE_CHAR_WRITE | AT_BLE_CHAR_WRITE_WITHOUT_RESPONSE,	\
+				CONF_BRIDGE_TUNNEL_VALUE_MAX,	AT_BLE_ATTR_WRITABLE_NO_AUTHN_NO_AUTHR)				\
+	X(CHAR_WEATHER,	TU_WEATHER_CHAR_UUID,	AT_BLE_CHAR_READ,										\
+				TU_WEATHER_CHAR_MAX_LEN,	AT_BLE_ATTR_READABLE_NO_AUTHN_REQ_AUTHR)
+
+/** \brief Simultaneous connections, as many as the BTLC1000 links (BLE_MAX_DEVICE_CONNECTION) */
+#define MAX_REMOTE_DEVICE				8
+
+/** \brief Connection handles are link indexes; larger handles are refused */
+#define TU_CONN_HANDLE_COUNT			(16)
 
 /* Advertisement payload definitions */
 #define ADV_DATA_TYPE_SIZE				1
@@ -52,11 +83,12 @@
 #define ADV_PAYLOAD_128_UUID_SIZE		16
 #define ADV_PAYLOAD_128_UUID			(ADV_DATA_TYPE_SIZE + ADV_PAYLOAD_128_UUID_SIZE, ADV_DATA_TYPE_128_COMP_UUID, ADV_PAYLOAD_128_UUID_VAL)	
 
+#define TU_CHAR_INDEX(id, uuid, properties, max_len, permissions)		id,
+
 enum
 {
-	CHAR_TX,
-	CHAR_RX,
-	CHAR_TCP,	
+	TU_CHARACTERISTICS(TU_CHAR_INDEX)
+	TOTAL_NUM_OF_TU_CHARATERISTIC
 };
 
 typedef enum
@@ -83,24 +115,32 @@ typedef struct
 {
 	/* Connection parameters */
 	at_ble_connected_t remote_dev_conn_info;
-	/* Entry is occupied or not */
-	bool entry_flag;
+	/* ATT MTU of the connection */
+	uint16_t mtu;
 	/* BLE Application state */
 	ble_app_sq_state_t sq_state;
 	/* Stock symbol received from remote device */
 	//char stock_symbol[10];
 	char city_name[20];
+	/* Units weather is sent in, see weather_units_t */
+	uint8_t units;
 }remote_dev_info_t;
 
 /****************************************************************************************
 *							        Structures                                     		*
 ****************************************************************************************/
+/** @brief Handles the stack assigned to a characteristic */
+typedef struct
+{
+	at_ble_handle_t	char_val_handle;
+	at_ble_handle_t	client_config_handle;
+}tu_char_handles_t;
+
 /** @brief Transparent UART service info */
 typedef struct transparent_uart_service
 {
-	at_ble_uuid_t	serv_uuid;
 	at_ble_handle_t	serv_handle;
-	at_ble_characteristic_t	chars[3];
+	tu_char_handles_t	chars[TOTAL_NUM_OF_TU_CHARATERISTIC];
 }transparent_uart_service_t;
 
 /****************************************************************************************
@@ -132,6 +172,26 @@ void ble_app_process(void);
   */
 bool ble_app_is_init_state(void);
 
+/** @brief Tells whether ble_app_process() has work left besides waiting for events
+  * 
+  * @param
+  *
+  * @return true if only BLE events can move the application on
+  */
+bool ble_app_is_idle(void);
+
+/** @brief Set the scan response data
+  *
+  * Takes effect at once while advertising, otherwise at the next start.
+  * 
+  * @param[in] data	AD structures, copied
+  * @param[in] len	Length of data, at most 31
+  *
+  * @return Upon successful completion the function shall return @ref AT_BLE_SUCCESS,
+  * Otherwise the function shall return @ref at_ble_status_t
+  */
+at_ble_status_t ble_app_set_scan_resp(const uint8_t *data, uint8_t len);
+
 /** @brief Get stock symbol sent by remote device
   * 
   * @param
@@ -140,15 +200,42 @@ bool ble_app_is_init_state(void);
   */
 //char* ble_app_get_stock_symbol(void);
 char* ble_app_get_city_name(void);
-/** @brief Send stock quote to remote device
+/** @brief Send weather data to remote device
   * 
-  * @param[in] data	Stock quote
-  * @param[in] data_len	Stock quote length
+  * @param[in] conn_handle	Connection that asked for it
+  * @param[in] data	Weather data
+  * @param[in] data_len	Weather data length
   *
   * @return 
   */
 //void ble_app_send_stock_quote(uint8_t *data, uint16_t data_len);
-void ble_app_send_weather_data(uint8_t *data, uint16_t data_len);
+void ble_app_send_weather_data(uint16_t conn_handle, uint8_t *data, uint16_t data_len);
+
+/** @brief Notify weather a connection subscribed to, whatever it is waiting for
+  * 
+  * @param[in] conn_handle	Subscribed connection
+  * @param[in] data	Weather data
+  * @param[in] data_len	Weather data length
+  *
+  * @return @ref AT_BLE_SUCCESS if the notification was queued or notifications are off
+  */
+at_ble_status_t ble_app_push_weather(uint16_t conn_handle, uint8_t *data, uint16_t data_len);
+
+/** @brief Notify a tunnel frame on the TCP characteristic
+  * 
+  * @param[in] conn_handle	Connection of the tunnel
+  * @param[in] data	Frame
+  * @param[in] len	Frame length
+  *
+  * @return @ref AT_BLE_SUCCESS if the notification was queued
+  */
+at_ble_status_t ble_app_tunnel_notify(uint16_t conn_handle, uint8_t *data, uint16_t len);
+
+/** @brief ATT MTU of a connection, AT_MTU_VAL_MIN until the client exchanges it */
+uint16_t ble_app_conn_mtu(uint16_t conn_handle);
+
+/** @brief Units a connection wants weather in, CONF_BRIDGE_DEFAULT_UNITS until it chooses */
+uint8_t ble_app_units(uint16_t conn_handle);
 
 /** @brief Set BLE application state to start advertisement
   * 
@@ -158,4 +245,4 @@ void ble_app_send_weather_data(uint8_t *data, uint16_t data_len);
   */
 void ble_app_state_set_start_adv(void);
 
-#endif //TRANSPARENT_UART_SERVICE_H_
\ No newline at end of file
+#endif //TRANSPARENT_UART_SERVICE_H_
\ No newline at end of file
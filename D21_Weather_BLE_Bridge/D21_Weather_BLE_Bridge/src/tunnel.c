@@ -0,0 +1,443 @@
+/**
+ * \file
+ *
+ * \brief Byte tunnel between a BLE client and a TCP connection.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "socket/include/socket.h"
+#include "transparent_uart.h"
+#include "systime.h"
+#include "tunnel.h"
+#include "trace.h"
+
+/* ATT header of a notification */
+#define TUNNEL_ATT_HEADER				3
+/* Payload of a recv() is handed over in pieces of this size */
+#define TUNNEL_RX_PIECE					(128)
+
+_Static_assert(CONF_BRIDGE_TUNNEL_RX_BUF_SIZE >= SOCKET_BUFFER_MAX_LENGTH, "a whole recv() must fit the receive buffer");
+_Static_assert(CONF_BRIDGE_TUNNEL_TX_BUF_SIZE <= UINT16_MAX, "credits are 16 bits");
+
+typedef enum
+{
+	TUNNEL_IDLE,
+	/* connect() issued */
+	TUNNEL_CONNECTING,
+	TUNNEL_OPEN,
+	/* Socket gone, the final frame is still to be sent */
+	TUNNEL_CLOSING,
+}tunnel_state_t;
+
+static tunnel_state_t tunnel_state = TUNNEL_IDLE;
+static uint16_t tunnel_conn;
+static SOCKET tunnel_sock = -1;
+
+/* Client to TCP: ring of bytes written by the client, not yet sent */
+static uint8_t tx_buf[CONF_BRIDGE_TUNNEL_TX_BUF_SIZE];
+static uint16_t tx_head;
+static uint16_t tx_len;
+/* Bytes handed to send(), waiting for SOCKET_MSG_SEND */
+static uint16_t tx_sending;
+/* Bytes the client may still write */
+static uint16_t tx_credit;
+/* Bytes sent on, not yet granted back to the client */
+static uint16_t tx_credit_due;
+
+/* TCP to client: ring of received bytes, not yet notified */
+static uint8_t rx_buf[CONF_BRIDGE_TUNNEL_RX_BUF_SIZE];
+static uint16_t rx_head;
+static uint16_t rx_len;
+static uint8_t rx_piece[TUNNEL_RX_PIECE];
+static bool rx_pending;
+static bool rx_peer_closed;
+/* Bytes the client can take */
+static uint16_t rx_credit;
+
+/* Notifications sent and not yet confirmed */
+static uint8_t notify_inflight;
+/* OPENED still to be sent */
+static bool opened_due;
+/* OPENED or CLOSED frame that ends the tunnel in TUNNEL_CLOSING */
+static uint8_t final_frame[4];
+static uint8_t final_len;
+/* A notification was refused; tunnel_task() retries */
+static bool notify_retry;
+
+static tunnel_stats_t tunnel_stat;
+/* systime_ms() when notifications went in flight */
+static uint32_t busy_since_ms;
+
+static void tunnel_reset(void)
+{
+	if (notify_inflight) {
+		tunnel_stat.busy_ms += systime_ms() - busy_since_ms;
+	}
+	if (tunnel_sock >= 0) {
+		close(tunnel_sock);
+		tunnel_sock = -1;
+	}
+	tunnel_state = TUNNEL_IDLE;
+	tx_head = tx_len = tx_sending = tx_credit = tx_credit_due = 0;
+	rx_head = rx_len = rx_credit = 0;
+	rx_pending = rx_peer_closed = false;
+	notify_inflight = 0;
+	opened_due = false;
+	final_len = 0;
+	notify_retry = false;
+}
+
+/* Close the socket and end with a frame; the tunnel is free once it is sent */
+static void tunnel_finish(uint8_t op, uint8_t code)
+{
+	if (tunnel_sock >= 0) {
+		close(tunnel_sock);
+		tunnel_sock = -1;
+	}
+	tunnel_state = TUNNEL_CLOSING;
+	opened_due = false;
+	/* Nothing more is delivered or granted */
+	rx_len = 0;
+	tx_credit_due = 0;
+	final_frame[0] = op;
+	final_frame[1] = code;
+	final_len = 2;
+	if (op == TUNNEL_OP_OPENED) {
+		/* No credit */
+		final_frame[2] = 0;
+		final_frame[3] = 0;
+		final_len = 4;
+	}
+}
+
+static uint16_t tunnel_rd16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void tunnel_wr16(uint8_t *p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t tunnel_add_credit(uint16_t credit, uint16_t more)
+{
+	return (credit > UINT16_MAX - more) ? UINT16_MAX : credit + more;
+}
+
+/* Next notification to the client, 0 if there is none */
+static uint16_t tunnel_next_frame(uint8_t *frame, uint16_t size)
+{
+	if (opened_due) {
+		frame[0] = TUNNEL_OP_OPENED;
+		frame[1] = TUNNEL_OPEN_OK;
+		tunnel_wr16(&frame[2], tx_credit);
+		return 4;
+	}
+	/* Grant in batches, unless everything was sent on */
+	if (tx_credit_due && ((tx_credit_due >= CONF_BRIDGE_TUNNEL_CREDIT_BATCH) || !tx_len)) {
+		frame[0] = TUNNEL_OP_CREDIT_IND;
+		tunnel_wr16(&frame[1], tx_credit_due);
+		return 3;
+	}
+	if (rx_len && rx_credit) {
+		uint16_t n = size - 1;
+
+		if (n > rx_len) {
+			n = rx_len;
+		}
+		if (n > rx_credit) {
+			n = rx_credit;
+		}
+		frame[0] = TUNNEL_OP_DATA_IND;
+		for (uint16_t i = 0; i < n; i++) {
+			frame[1 + i] = rx_buf[(rx_head + i) % sizeof(rx_buf)];
+		}
+		return n + 1;
+	}
+	if (tunnel_state == TUNNEL_CLOSING) {
+		memcpy(frame, final_frame, final_len);
+		return final_len;
+	}
+	return 0;
+}
+
+/* Account for a frame from tunnel_next_frame() that went out */
+static void tunnel_frame_sent(const uint8_t *frame, uint16_t len)
+{
+	switch (frame[0]) {
+	case TUNNEL_OP_OPENED:
+		if (tunnel_state == TUNNEL_CLOSING) {
+			tunnel_reset();
+		} else {
+			opened_due = false;
+		}
+		break;
+
+	case TUNNEL_OP_CREDIT_IND:
+		tx_credit = tunnel_add_credit(tx_credit, tx_credit_due);
+		tx_credit_due = 0;
+		break;
+
+	case TUNNEL_OP_DATA_IND:
+		tunnel_stat.bytes += len - 1;
+		rx_head = (rx_head + len - 1) % sizeof(rx_buf);
+		rx_len -= len - 1;
+		rx_credit -= len - 1;
+		break;
+
+	default:
+		/* CLOSED */
+		tunnel_reset();
+		break;
+	}
+}
+
+static void tunnel_pump(void)
+{
+	uint8_t frame[CONF_BRIDGE_TUNNEL_VALUE_MAX];
+	uint16_t size;
+	uint16_t len;
+
+	if (tunnel_state == TUNNEL_OPEN) {
+		/* Client to TCP, one send() at a time */
+		if (!tx_sending && tx_len) {
+			uint16_t n = sizeof(tx_buf) - tx_head;
+
+			if (n > tx_len) {
+				n = tx_len;
+			}
+			if (n > SOCKET_BUFFER_MAX_LENGTH) {
+				n = SOCKET_BUFFER_MAX_LENGTH;
+			}
+			if (send(tunnel_sock, &tx_buf[tx_head], n, 0) == SOCK_ERR_NO_ERROR) {
+				tx_sending = n;
+			} else {
+				TRACE_WARN("tunnel: send failed");
+				tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_ERROR);
+			}
+		}
+		/* TCP to client, only while a whole recv() fits */
+		if ((tunnel_state == TUNNEL_OPEN) && !rx_pending && !rx_peer_closed &&
+				(sizeof(rx_buf) - rx_len >= SOCKET_BUFFER_MAX_LENGTH)) {
+			if (recv(tunnel_sock, rx_piece, sizeof(rx_piece), 0) == SOCK_ERR_NO_ERROR) {
+				rx_pending = true;
+			} else {
+				TRACE_WARN("tunnel: recv failed");
+				tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_ERROR);
+			}
+		}
+		/* The peer is done and everything it sent was delivered */
+		if ((tunnel_state == TUNNEL_OPEN) && rx_peer_closed && !rx_len) {
+			tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_PEER);
+		}
+	}
+
+	if (tunnel_state == TUNNEL_IDLE) {
+		return;
+	}
+
+	/* Fill the ATT MTU of the connection */
+	size = ble_app_conn_mtu(tunnel_conn) - TUNNEL_ATT_HEADER;
+	if (size > sizeof(frame)) {
+		size = sizeof(frame);
+	}
+
+	notify_retry = false;
+	while ((tunnel_state != TUNNEL_IDLE) && (notify_inflight < CONF_BRIDGE_TUNNEL_NOTIFY_WINDOW)) {
+		len = tunnel_next_frame(frame, size);
+		if (!len) {
+			break;
+		}
+		if (ble_app_tunnel_notify(tunnel_conn, frame, len) != AT_BLE_SUCCESS) {
+			notify_retry = true;
+			break;
+		}
+		if (!notify_inflight++) {
+			busy_since_ms = systime_ms();
+		}
+		tunnel_frame_sent(frame, len);
+	}
+}
+
+static void tunnel_open(uint16_t conn_handle, const uint8_t *data, uint16_t len)
+{
+	struct sockaddr_in addr_in;
+
+	if (len != 9) {
+		return;
+	}
+	if (tunnel_state != TUNNEL_IDLE) {
+		uint8_t busy[4] = {TUNNEL_OP_OPENED, TUNNEL_OPEN_BUSY, 0, 0};
+
+		/* Best effort; the owner's frames are not held up */
+		ble_app_tunnel_notify(conn_handle, busy, sizeof(busy));
+		return;
+	}
+
+	tunnel_conn = conn_handle;
+	rx_credit = tunnel_rd16(&data[7]);
+	tunnel_state = TUNNEL_CONNECTING;
+
+	addr_in.sin_family = AF_INET;
+	addr_in.sin_port = _htons(tunnel_rd16(&data[5]));
+	/* Dotted order is the network order of the WINC */
+	memcpy(&addr_in.sin_addr.s_addr, &data[1], 4);
+	TRACE_INFO("tunnel: %u.%u.%u.%u:%u", data[1], data[2], data[3], data[4], tunnel_rd16(&data[5]));
+
+	if ((tunnel_sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		TRACE_WARN("tunnel: no socket");
+		tunnel_finish(TUNNEL_OP_OPENED, TUNNEL_OPEN_FAILED);
+	} else if (connect(tunnel_sock, (struct sockaddr *)&addr_in, sizeof(addr_in)) != SOCK_ERR_NO_ERROR) {
+		TRACE_WARN("tunnel: connect failed");
+		tunnel_finish(TUNNEL_OP_OPENED, TUNNEL_OPEN_FAILED);
+	}
+}
+
+void tunnel_write(uint16_t conn_handle, const uint8_t *data, uint16_t len)
+{
+	if (!len) {
+		return;
+	}
+	if (data[0] == TUNNEL_OP_OPEN) {
+		tunnel_open(conn_handle, data, len);
+	} else if ((tunnel_state == TUNNEL_IDLE) || (tunnel_state == TUNNEL_CLOSING) || (conn_handle != tunnel_conn)) {
+		/* Not this client's tunnel, or already closing */
+		return;
+	} else if (data[0] == TUNNEL_OP_DATA) {
+		len--;
+		if ((tunnel_state != TUNNEL_OPEN) || (len > tx_credit)) {
+			TRACE_WARN("tunnel: %u bytes over credit", len);
+			tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_PROTOCOL);
+		} else {
+			/* Credit never exceeds the free space of the ring */
+			for (uint16_t i = 0; i < len; i++) {
+				tx_buf[(tx_head + tx_len + i) % sizeof(tx_buf)] = data[1 + i];
+			}
+			tx_len += len;
+			tx_credit -= len;
+		}
+	} else if (data[0] == TUNNEL_OP_CREDIT) {
+		if (len == 3) {
+			rx_credit = tunnel_add_credit(rx_credit, tunnel_rd16(&data[1]));
+		}
+	} else if (data[0] == TUNNEL_OP_CLOSE) {
+		tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_CLIENT);
+	} else {
+		tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_PROTOCOL);
+	}
+	tunnel_pump();
+}
+
+void tunnel_notified(uint16_t conn_handle)
+{
+	/* Weather notifications are confirmed the same way; the window is only a bound */
+	if ((tunnel_state != TUNNEL_IDLE) && (conn_handle == tunnel_conn) && notify_inflight) {
+		if (!--notify_inflight) {
+			tunnel_stat.busy_ms += systime_ms() - busy_since_ms;
+		}
+		tunnel_pump();
+	}
+}
+
+void tunnel_drop(uint16_t conn_handle)
+{
+	if ((tunnel_state != TUNNEL_IDLE) && (conn_handle == tunnel_conn)) {
+		tunnel_reset();
+	}
+}
+
+bool tunnel_socket_cb(int8_t sock, uint8_t msg, void *msg_data)
+{
+	if ((tunnel_sock < 0) || (sock != tunnel_sock)) {
+		return false;
+	}
+
+	switch (msg) {
+	case SOCKET_MSG_CONNECT:
+	{
+		tstrSocketConnectMsg *connect_msg = (tstrSocketConnectMsg *)msg_data;
+
+		if (connect_msg && (connect_msg->s8Error >= SOCK_ERR_NO_ERROR)) {
+			tunnel_state = TUNNEL_OPEN;
+			tx_credit = sizeof(tx_buf);
+			opened_due = true;
+		} else {
+			TRACE_WARN("tunnel: connect error");
+			tunnel_finish(TUNNEL_OP_OPENED, TUNNEL_OPEN_FAILED);
+		}
+	}
+	break;
+
+	case SOCKET_MSG_SEND:
+	{
+		int16_t sent = *(int16_t *)msg_data;
+
+		if ((sent <= 0) || (sent > tx_sending)) {
+			tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_ERROR);
+			break;
+		}
+		tx_head = (tx_head + sent) % sizeof(tx_buf);
+		tx_len -= sent;
+		tx_credit_due += sent;
+		tx_sending = 0;
+	}
+	break;
+
+	case SOCKET_MSG_RECV:
+	{
+		tstrSocketRecvMsg *recv_msg = (tstrSocketRecvMsg *)msg_data;
+
+		if (recv_msg->s16BufferSize > (int16_t)(sizeof(rx_buf) - rx_len)) {
+			TRACE_ERR("tunnel: receive overrun");
+			tunnel_finish(TUNNEL_OP_CLOSED, TUNNEL_CLOSE_ERROR);
+			break;
+		} else if (recv_msg->s16BufferSize > 0) {
+			for (int16_t i = 0; i < recv_msg->s16BufferSize; i++) {
+				rx_buf[(rx_head + rx_len + i) % sizeof(rx_buf)] = recv_msg->pu8Buffer[i];
+			}
+			rx_len += recv_msg->s16BufferSize;
+			if (recv_msg->u16RemainingSize) {
+				/* More pieces of this recv() follow */
+				return true;
+			}
+		} else if (recv_msg->s16BufferSize != SOCK_ERR_TIMEOUT) {
+			/* Deliver what is buffered, then report the close */
+			rx_peer_closed = true;
+		}
+		rx_pending = false;
+	}
+	break;
+
+	default:
+		break;
+	}
+
+	tunnel_pump();
+	return true;
+}
+
+void tunnel_task(void)
+{
+	if (notify_retry) {
+		tunnel_pump();
+	}
+}
+
+bool tunnel_is_open(void)
+{
+	return (tunnel_state == TUNNEL_CONNECTING) || (tunnel_state == TUNNEL_OPEN);
+}
+
+bool tunnel_pending(void)
+{
+	return notify_retry;
+}
+
+const tunnel_stats_t *tunnel_stats(void)
+{
+	return &tunnel_stat;
+}
@@ -0,0 +1,99 @@
+/**
+ * \file
+ *
+ * \brief Byte tunnel between a BLE client and a TCP connection.
+ *
+ * The TCP characteristic (CHAR_TCP) carries a stream between one BLE
+ * client and a TCP socket of the WINC1500, so the client can reach any
+ * LAN or Internet service through the bridge. The client writes frames,
+ * the bridge answers with notifications. Every value starts with an
+ * opcode; numbers are little endian, the address is in dotted order:
+ * \code
+ *   client -> bridge                        bridge -> client
+ *   0x01 OPEN   ip(4) port(2) credit(2)     0x81 OPENED status credit(2)
+ *   0x02 DATA   bytes...                    0x82 DATA   bytes...
+ *   0x03 CLOSE                              0x83 CLOSED reason
+ *   0x04 CREDIT bytes(2)                    0x84 CREDIT bytes(2)
+ * \endcode
+ *
+ * Both directions are credit based. The client may write as many DATA
+ * bytes as the bridge granted in OPENED and later CREDIT frames; the
+ * bridge grants again as the bytes reach the WINC. The bridge sends as
+ * many DATA bytes as the client granted in OPEN and later CREDIT frames;
+ * meanwhile the socket is not read, so TCP flow control holds the remote
+ * end. At most CONF_BRIDGE_TUNNEL_NOTIFY_WINDOW notifications are in
+ * flight, and DATA frames fill the ATT MTU of the connection.
+ *
+ * One tunnel is open at a time.
+ *
+ */
+
+#ifndef TUNNEL_H_INCLUDED
+#define TUNNEL_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Frame opcodes */
+#define TUNNEL_OP_OPEN					0x01
+#define TUNNEL_OP_DATA					0x02
+#define TUNNEL_OP_CLOSE					0x03
+#define TUNNEL_OP_CREDIT				0x04
+#define TUNNEL_OP_OPENED				0x81
+#define TUNNEL_OP_DATA_IND				0x82
+#define TUNNEL_OP_CLOSED				0x83
+#define TUNNEL_OP_CREDIT_IND			0x84
+
+/** OPENED status */
+#define TUNNEL_OPEN_OK					0
+#define TUNNEL_OPEN_BUSY				1
+#define TUNNEL_OPEN_FAILED				2
+
+/** CLOSED reason */
+#define TUNNEL_CLOSE_CLIENT				0
+#define TUNNEL_CLOSE_PEER				1
+#define TUNNEL_CLOSE_ERROR				2
+#define TUNNEL_CLOSE_PROTOCOL			3
+
+typedef struct
+{
+	/* DATA bytes notified */
+	uint32_t bytes;
+	/* Time with notifications in flight, in ms */
+	uint32_t busy_ms;
+}tunnel_stats_t;
+
+/** @brief A client wrote the TCP characteristic
+  *
+  * @param[in] conn_handle	Connection that wrote
+  * @param[in] data			Frame
+  * @param[in] len			Frame length
+  */
+void tunnel_write(uint16_t conn_handle, const uint8_t *data, uint16_t len);
+
+/** @brief A notification was sent on a connection */
+void tunnel_notified(uint16_t conn_handle);
+
+/** @brief Close the tunnel of a connection that went away */
+void tunnel_drop(uint16_t conn_handle);
+
+/** @brief Socket event, from the socket callback
+  *
+  * @return false if the socket is not the tunnel's
+  */
+bool tunnel_socket_cb(int8_t sock, uint8_t msg, void *msg_data);
+
+/** @brief Retry what could not be sent from the events. Call from the main loop. */
+void tunnel_task(void);
+
+/** @brief A tunnel is connecting or open */
+bool tunnel_is_open(void);
+
+/** @brief tunnel_task() has a notification to retry */
+bool tunnel_pending(void);
+
+/** @brief Notification throughput, for comparison with bulk.h */
+const tunnel_stats_t *tunnel_stats(void);
+
+#endif /* TUNNEL_H_INCLUDED */
@@ -0,0 +1,166 @@
+/**
+ * \file
+ *
+ * \brief Network and weather state kept in flash across resets.
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "platform.h"
+#include "serial_drv.h"
+#include "pstore.h"
+#include "systime.h"
+#include "weather_cache.h"
+#include "quota.h"
+#include "idle.h"
+#include "warm_state.h"
+#include "trace.h"
+
+/* Bump when warm_state_t changes; older records are then ignored */
+#define WARM_STATE_VERSION			6
+
+typedef struct
+{
+	uint8_t version;
+	/* platform_baud_state_t of the BTLC1000 link, 0 in older records */
+	uint8_t baud_state;
+	uint8_t reserved[2];
+	warm_state_net_t net;
+	/* Day quota left, so a reset does not refill it */
+	quota_saved_t quota;
+	weather_cache_entry_t cache[CONF_BRIDGE_PERSIST_CACHE_ENTRIES];
+}warm_state_t;
+
+_Static_assert(sizeof(warm_state_t) <= PSTORE_DATA_MAX, "warm state does not fit a pstore record");
+
+static warm_state_t warm_state;
+/* Network part changed since the last save */
+static bool warm_state_net_dirty;
+/* Cache generation saved last */
+static uint16_t warm_state_cache_gen;
+static uint32_t warm_state_saved_ms;
+/* Lease age at warm_state_lease_ms, in s */
+static uint32_t warm_state_lease_base_s = UINT32_MAX;
+static uint32_t warm_state_lease_ms;
+
+/* Reset by power-on or brown-out, after which RAM and the RTC start over */
+static bool warm_state_cold_start(void)
+{
+	enum system_reset_cause cause = system_get_reset_cause();
+
+	return (cause == SYSTEM_RESET_CAUSE_POR) || (cause == SYSTEM_RESET_CAUSE_BOD12) ||
+			(cause == SYSTEM_RESET_CAUSE_BOD33);
+}
+
+bool warm_state_restore(void)
+{
+	if (!pstore_load(&warm_state, sizeof(warm_state)) || (warm_state.version != WARM_STATE_VERSION)) {
+		memset(&warm_state, 0, sizeof(warm_state));
+		warm_state.version = WARM_STATE_VERSION;
+		return false;
+	}
+
+	/* Only a warm reset takes no time the lease age would miss */
+	warm_state_lease_base_s = warm_state_cold_start() ? UINT32_MAX : warm_state.net.lease_age_s;
+	warm_state_lease_ms = systime_ms();
+	platform_host_baud_state_restore((platform_baud_state_t)warm_state.baud_state);
+	quota_restore(&warm_state.quota);
+	weather_cache_restore(warm_state.cache, CONF_BRIDGE_PERSIST_CACHE_ENTRIES);
+	warm_state_cache_gen = weather_cache_generation();
+	warm_state_saved_ms = systime_ms();
+	TRACE_INFO("warm start: channel %d, server %x", warm_state.net.channel, warm_state.net.host_ip);
+	return true;
+}
+
+const warm_state_net_t *warm_state_net(void)
+{
+	return &warm_state.net;
+}
+
+void warm_state_set_link(uint8_t channel, const uint8_t *bssid)
+{
+	if ((warm_state.net.channel != channel) || memcmp(warm_state.net.bssid, bssid, sizeof(warm_state.net.bssid))) {
+		warm_state.net.channel = channel;
+		memcpy(warm_state.net.bssid, bssid, sizeof(warm_state.net.bssid));
+		warm_state_net_dirty = true;
+	}
+}
+
+void warm_state_set_lease(const tstrM2MIPConfig *lease)
+{
+	warm_state_lease_base_s = 0;
+	warm_state_lease_ms = systime_ms();
+	if (memcmp(&warm_state.net.lease, lease, sizeof(*lease))) {
+		warm_state.net.lease = *lease;
+		warm_state_net_dirty = true;
+	}
+}
+
+uint32_t warm_state_lease_age_s(void)
+{
+	uint32_t age_s = (systime_ms() - warm_state_lease_ms) / 1000;
+
+	if (warm_state_lease_base_s > UINT32_MAX - age_s) {
+		return UINT32_MAX;
+	}
+	return warm_state_lease_base_s + age_s;
+}
+
+void warm_state_set_host(uint32_t host_ip)
+{
+	if (host_ip && (warm_state.net.host_ip != host_ip)) {
+		warm_state.net.host_ip = host_ip;
+		warm_state_net_dirty = true;
+	}
+}
+
+static void warm_state_save(void)
+{
+	warm_state.baud_state = (uint8_t)platform_host_baud_state();
+	warm_state.net.lease_age_s = warm_state_lease_age_s();
+	warm_state_cache_gen = weather_cache_generation();
+	weather_cache_snapshot(warm_state.cache, CONF_BRIDGE_PERSIST_CACHE_ENTRIES);
+	quota_snapshot(&warm_state.quota);
+
+	/* Flash stalls the CPU for a few ms; hold off the BTLC1000 meanwhile */
+	platform_set_ble_rts_high();
+	if (!pstore_save(&warm_state, sizeof(warm_state))) {
+		TRACE_WARN("warm state save failed");
+	}
+	platform_set_ble_rts_low();
+
+	warm_state_net_dirty = false;
+	warm_state_saved_ms = systime_ms();
+}
+
+void warm_state_flush(void)
+{
+	warm_state_save();
+}
+
+void warm_state_task(void)
+{
+	bool cache_changed = (weather_cache_generation() != warm_state_cache_gen);
+	bool cache_due = cache_changed &&
+			((systime_ms() - warm_state_saved_ms) >= (CONF_BRIDGE_PERSIST_INTERVAL_S * 1000ul));
+
+	/* A latched fallback rate is saved right away */
+	if (warm_state.baud_state != (uint8_t)platform_host_baud_state()) {
+		warm_state_net_dirty = true;
+	}
+	/* So is a lease that became too old to reuse, so a restored record
+	   never makes it look younger than that */
+	if ((warm_state.net.lease_age_s < warm_state.net.lease.u32DhcpLeaseTime / 2) &&
+			(warm_state_lease_age_s() >= warm_state.net.lease.u32DhcpLeaseTime / 2)) {
+		warm_state_net_dirty = true;
+	}
+	if (!warm_state_net_dirty && !cache_due) {
+		if (cache_changed) {
+			idle_wake_at(warm_state_saved_ms + CONF_BRIDGE_PERSIST_INTERVAL_S * 1000ul);
+		}
+		return;
+	}
+
+	warm_state_save();
+}
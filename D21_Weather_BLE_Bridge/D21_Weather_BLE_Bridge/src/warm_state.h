@@ -0,0 +1,68 @@
+/**
+ * \file
+ *
+ * \brief Network and weather state kept in flash across resets.
+ *
+ * After a reset the bridge reconnects on the last channel and starts with
+ * the last server address. The restored weather cache only holds stale
+ * entries. They answer requests until the uplink is back, and later when
+ * the quota allows an answer with stale weather.
+ * The day quota carries on where it was instead of starting full.
+ * A BTLC1000 link that had to fall back to a lower rate stays there.
+ *
+ */
+
+#ifndef WARM_STATE_H_INCLUDED
+#define WARM_STATE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/include/m2m_wifi.h"
+
+typedef struct
+{
+	/* Channel of the last association, 0 if unknown */
+	uint8_t channel;
+	/* BSSID of the last association */
+	uint8_t bssid[6];
+	uint8_t reserved;
+	/* Last DHCP lease, u32StaticIP is 0 if none */
+	tstrM2MIPConfig lease;
+	/* Age of the lease when saved, in s; UINT32_MAX if unknown */
+	uint32_t lease_age_s;
+	/* Last resolved weather server address, 0 if unknown */
+	uint32_t host_ip;
+}warm_state_net_t;
+
+/** @brief Load the saved state and restore the weather cache from it
+  *
+  * @return false if nothing valid was saved
+  */
+bool warm_state_restore(void);
+
+/** @brief Network part of the saved state, zeroed if there was none */
+const warm_state_net_t *warm_state_net(void);
+
+/** @brief Record the current association */
+void warm_state_set_link(uint8_t channel, const uint8_t *bssid);
+
+/** @brief Record a new DHCP lease */
+void warm_state_set_lease(const tstrM2MIPConfig *lease);
+
+/** @brief Time since the lease was granted, in s
+  *
+  * UINT32_MAX if unknown, e.g. for a lease restored after a power cycle,
+  * whose time off cannot be told.
+  */
+uint32_t warm_state_lease_age_s(void);
+
+/** @brief Record the resolved weather server address */
+void warm_state_set_host(uint32_t host_ip);
+
+/** @brief Save to flash now, e.g. before a reset */
+void warm_state_flush(void);
+
+/** @brief Save to flash when needed. Call from the main loop. */
+void warm_state_task(void);
+
+#endif /* WARM_STATE_H_INCLUDED */
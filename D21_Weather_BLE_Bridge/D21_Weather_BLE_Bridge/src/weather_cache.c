@@ -0,0 +1,178 @@
+/**
+ * \file
+ *
+ * \brief Most recently fetched weather, per city.
+ *
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include "systime.h"
+#include "strfmt.h"
+#include "weather_units.h"
+#include "weather_cache.h"
+
+/* Labels of the weather text sent to clients */
+#define CITY_NAME						    ("\r\nCity Name   : ")
+#define TEMPERATURE_VALUE					("\r\nTemperature : ")
+#define WEATHER_VALUE					    ("\r\nWeather     : ")
+#define NEW_LINE							("\r\n")
+
+static weather_cache_entry_t weather_cache[CONF_BRIDGE_CACHE_ENTRIES];
+static uint16_t weather_cache_gen;
+
+static bool weather_cache_match(const char *a, const char *b)
+{
+	while (*a && (tolower((unsigned char)*a) == tolower((unsigned char)*b))) {
+		a++;
+		b++;
+	}
+	return *a == *b;
+}
+
+static weather_cache_entry_t *weather_cache_lookup(const char *city)
+{
+	for (uint8_t i = 0; i < CONF_BRIDGE_CACHE_ENTRIES; i++) {
+		if (weather_cache[i].city[0] && weather_cache_match(weather_cache[i].city, city)) {
+			return &weather_cache[i];
+		}
+	}
+	return NULL;
+}
+
+/* Entry of the same city, else a free one, else the least recently updated */
+static weather_cache_entry_t *weather_cache_slot(const char *city)
+{
+	weather_cache_entry_t *slot = weather_cache_lookup(city);
+	uint32_t now = systime_ms();
+
+	if (slot) {
+		return slot;
+	}
+	slot = &weather_cache[0];
+	for (uint8_t i = 0; i < CONF_BRIDGE_CACHE_ENTRIES; i++) {
+		if (!weather_cache[i].city[0]) {
+			return &weather_cache[i];
+		}
+		if ((now - weather_cache[i].updated_ms) > (now - slot->updated_ms)) {
+			slot = &weather_cache[i];
+		}
+	}
+	return slot;
+}
+
+const weather_cache_entry_t *weather_cache_find(const char *city)
+{
+	weather_cache_entry_t *entry = weather_cache_lookup(city);
+
+	if (entry && ((systime_ms() - entry->updated_ms) < (CONF_BRIDGE_CACHE_MAX_AGE_S * 1000ul))) {
+		return entry;
+	}
+	return NULL;
+}
+
+const weather_cache_entry_t *weather_cache_find_stale(const char *city)
+{
+	weather_cache_entry_t *entry = weather_cache_lookup(city);
+
+	if (entry && ((systime_ms() - entry->updated_ms) < (CONF_BRIDGE_CACHE_STALE_S * 1000ul))) {
+		return entry;
+	}
+	return NULL;
+}
+
+static void weather_cache_put(const weather_cache_entry_t *entry, uint32_t updated_ms)
+{
+	weather_cache_entry_t *slot;
+
+	if (!entry->city[0]) {
+		return;
+	}
+	slot = weather_cache_slot(entry->city);
+	*slot = *entry;
+	slot->updated_ms = updated_ms;
+	weather_cache_gen++;
+}
+
+void weather_cache_store(const weather_cache_entry_t *entry)
+{
+	weather_cache_put(entry, systime_ms());
+}
+
+void weather_cache_snapshot(weather_cache_entry_t *entries, uint8_t count)
+{
+	uint32_t now = systime_ms();
+	bool taken[CONF_BRIDGE_CACHE_ENTRIES] = {false};
+
+	for (uint8_t n = 0; n < count; n++) {
+		int8_t newest = -1;
+
+		for (uint8_t i = 0; i < CONF_BRIDGE_CACHE_ENTRIES; i++) {
+			if (taken[i] || !weather_cache[i].city[0]) {
+				continue;
+			}
+			if ((newest < 0) || ((now - weather_cache[i].updated_ms) < (now - weather_cache[newest].updated_ms))) {
+				newest = i;
+			}
+		}
+		if (newest < 0) {
+			memset(&entries[n], 0, sizeof(entries[n]));
+		} else {
+			taken[newest] = true;
+			entries[n] = weather_cache[newest];
+			/* Times don't survive a reset, so keep the age instead */
+			entries[n].updated_ms = now - weather_cache[newest].updated_ms;
+		}
+	}
+}
+
+void weather_cache_restore(const weather_cache_entry_t *entries, uint8_t count)
+{
+	uint32_t now = systime_ms();
+
+	/* Oldest first, so the newest entries win if the cache is smaller */
+	for (uint8_t n = count; n-- > 0;) {
+		weather_cache_entry_t entry = entries[n];
+		/* The time spent in reset is unknown; never count restored weather as fresh */
+		uint32_t age = (entry.updated_ms > CONF_BRIDGE_CACHE_MAX_AGE_S * 1000ul) ?
+				entry.updated_ms : CONF_BRIDGE_CACHE_MAX_AGE_S * 1000ul;
+
+		if (!entry.city[0] || (age >= CONF_BRIDGE_CACHE_STALE_S * 1000ul)) {
+			continue;
+		}
+		entry.city[sizeof(entry.city) - 1] = '\0';
+		entry.name[sizeof(entry.name) - 1] = '\0';
+		entry.weather[sizeof(entry.weather) - 1] = '\0';
+		weather_cache_put(&entry, now - age);
+	}
+}
+
+uint16_t weather_cache_generation(void)
+{
+	return weather_cache_gen;
+}
+
+uint16_t weather_format(const weather_cache_entry_t *entry, uint8_t units, char *buf, uint16_t size)
+{
+	strfmt_t resp;
+
+	strfmt_init(&resp, buf, size);
+	strfmt_str(&resp, CITY_NAME);
+	strfmt_str(&resp, entry->name);
+	strfmt_str(&resp, TEMPERATURE_VALUE);
+	strfmt_fixed(&resp, weather_units_temperature(entry->temperature, units), TEMPERATURE_DECIMALS);
+	strfmt_str(&resp, WEATHER_VALUE);
+	strfmt_str(&resp, entry->weather);
+	strfmt_str(&resp, NEW_LINE);
+	return resp.len;
+}
+
+uint16_t weather_cached_text(const char *city, uint8_t units, char *buf, uint16_t size)
+{
+	const weather_cache_entry_t *cached = weather_cache_find(city);
+
+	if (!cached) {
+		return 0;
+	}
+	return weather_format(cached, units, buf, size);
+}
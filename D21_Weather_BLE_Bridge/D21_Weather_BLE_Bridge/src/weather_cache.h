@@ -0,0 +1,107 @@
+/**
+ * \file
+ *
+ * \brief Most recently fetched weather, per city.
+ *
+ */
+
+#ifndef WEATHER_CACHE_H_INCLUDED
+#define WEATHER_CACHE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Fractional digits kept for temperatures */
+#define TEMPERATURE_DECIMALS		2
+
+/** Fractional digits kept for wind speeds */
+#define WIND_SPEED_DECIMALS			1
+
+typedef struct
+{
+	/* City as asked by the client, the lookup key; empty if unused */
+	char city[CONF_BRIDGE_CITY_SIZE];
+	/* City name reported by the server */
+	char name[CONF_BRIDGE_CITY_SIZE];
+	/* Weather condition text */
+	char weather[20];
+	/* Temperature in degrees Celsius, scaled by 10^TEMPERATURE_DECIMALS */
+	int32_t temperature;
+	/* Weather condition code, 0 if unknown */
+	uint16_t condition;
+	/* Pressure in hPa */
+	uint16_t pressure;
+	/* Wind speed in m/s, scaled by 10^WIND_SPEED_DECIMALS */
+	uint16_t wind_speed;
+	/* Sunrise and sunset, in minutes after midnight UTC */
+	uint16_t sunrise;
+	uint16_t sunset;
+	/* Relative humidity in % */
+	uint8_t humidity;
+	/* systime_ms() when fetched */
+	uint32_t updated_ms;
+}weather_cache_entry_t;
+
+/** @brief Look up a city, ignoring case
+  *
+  * @param[in] city	City as asked by the client
+  *
+  * @return the entry, or NULL if the city is unknown or the entry is
+  * older than CONF_BRIDGE_CACHE_MAX_AGE_S
+  */
+const weather_cache_entry_t *weather_cache_find(const char *city);
+
+/** @brief Look up a city, ignoring case, accepting stale weather
+  *
+  * @param[in] city	City as asked by the client
+  *
+  * @return the entry, or NULL if the city is unknown or the entry is
+  * older than CONF_BRIDGE_CACHE_STALE_S
+  */
+const weather_cache_entry_t *weather_cache_find_stale(const char *city);
+
+/** @brief Store fresh weather, replacing the entry of the same city or the oldest one
+  *
+  * updated_ms is set to the current time.
+  */
+void weather_cache_store(const weather_cache_entry_t *entry);
+
+/** @brief Copy out the most recently updated entries, newest first
+  *
+  * updated_ms of the copies holds their age in ms instead of a time.
+  *
+  * @param[out] entries	Filled with up to count entries, unused ones cleared
+  * @param[in] count	Number of entries wanted
+  */
+void weather_cache_snapshot(weather_cache_entry_t *entries, uint8_t count);
+
+/** @brief Put back entries from weather_cache_snapshot(), e.g. after a reset
+  *
+  * Restored entries keep their saved age, but at least
+  * CONF_BRIDGE_CACHE_MAX_AGE_S, so only weather_cache_find_stale() returns
+  * them. Entries older than CONF_BRIDGE_CACHE_STALE_S are dropped.
+  */
+void weather_cache_restore(const weather_cache_entry_t *entries, uint8_t count);
+
+/** @brief Incremented on every change, to tell when a snapshot is out of date */
+uint16_t weather_cache_generation(void);
+
+/** @brief Format weather as sent to clients
+  *
+  * @param[in] entry	Weather to format
+  * @param[in] units	Units of the client, see weather_units_t
+  * @param[out] buf		Destination
+  * @param[in] size		Size of buf
+  *
+  * @return length of the text
+  */
+uint16_t weather_format(const weather_cache_entry_t *entry, uint8_t units, char *buf, uint16_t size);
+
+/** @brief Format the fresh cached weather of a city
+  *
+  * @return length of the text, 0 if the city has no fresh weather
+  */
+uint16_t weather_cached_text(const char *city, uint8_t units, char *buf, uint16_t size);
+
+#endif /* WEATHER_CACHE_H_INCLUDED */
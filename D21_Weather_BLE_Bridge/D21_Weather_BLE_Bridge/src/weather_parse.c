@@ -0,0 +1,263 @@
+/**
+ * \file
+ *
+ * \brief Streaming parser of the weather server's XML answer.
+ *
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strfmt.h"
+#include "weather_parse.h"
+
+/** Element closing the answer */
+#define WEATHER_PARSE_ROOT				"current"
+
+typedef enum
+{
+	/* Text, truncated to the member */
+	WEATHER_FIELD_TEXT,
+	/* Decimal number, scaled by 10^arg */
+	WEATHER_FIELD_FIXED,
+	/* Time of day of an ISO 8601 date, in minutes */
+	WEATHER_FIELD_TIME
+}weather_field_type_t;
+
+typedef struct
+{
+	const char *element;
+	const char *attribute;
+	uint8_t type;
+	/* Decimals of a number */
+	uint8_t arg;
+	/* Member size; numbers are truncated to 1, 2 or 4 bytes */
+	uint8_t size;
+	/* The answer is useless without it */
+	bool required;
+	uint16_t offset;
+}weather_field_t;
+
+#define WEATHER_MEMBER_SIZE(member)		sizeof(((weather_cache_entry_t *)0)->member)
+#define WEATHER_FIELD(element, attribute, type, decimals, member, required) \
+	{element, attribute, type, decimals, WEATHER_MEMBER_SIZE(member), required, offsetof(weather_cache_entry_t, member)}
+#define WEATHER_TEXT(element, attribute, member, required) \
+	WEATHER_FIELD(element, attribute, WEATHER_FIELD_TEXT, 0, member, required)
+#define WEATHER_FIXED(element, attribute, member, decimals, required) \
+	WEATHER_FIELD(element, attribute, WEATHER_FIELD_FIXED, decimals, member, required)
+#define WEATHER_TIME(element, attribute, member) \
+	WEATHER_FIELD(element, attribute, WEATHER_FIELD_TIME, 0, member, false)
+
+/* Elements and attributes are the ones of the mode=xml answer */
+static const weather_field_t weather_fields[] = {
+	WEATHER_TEXT("city", "name", name, true),
+	WEATHER_FIXED("temperature", "value", temperature, TEMPERATURE_DECIMALS, true),
+	WEATHER_FIXED("weather", "number", condition, 0, false),
+	WEATHER_TEXT("weather", "value", weather, false),
+	WEATHER_FIXED("humidity", "value", humidity, 0, false),
+	WEATHER_FIXED("pressure", "value", pressure, 0, false),
+	WEATHER_FIXED("speed", "value", wind_speed, WIND_SPEED_DECIMALS, false),
+	WEATHER_TIME("sun", "rise", sunrise),
+	WEATHER_TIME("sun", "set", sunset),
+};
+
+#define WEATHER_FIELD_COUNT				(sizeof(weather_fields) / sizeof(weather_fields[0]))
+
+_Static_assert(WEATHER_FIELD_COUNT <= 16, "found fields are kept in 16 bits");
+
+typedef enum
+{
+	/* Between tags */
+	WEATHER_PARSE_TEXT,
+	WEATHER_PARSE_ELEMENT,
+	/* Inside a tag, before an attribute name */
+	WEATHER_PARSE_TAG,
+	WEATHER_PARSE_ATTRIBUTE,
+	/* After '=' */
+	WEATHER_PARSE_EQUALS,
+	WEATHER_PARSE_VALUE
+}weather_parse_state_t;
+
+static weather_cache_entry_t *parse_entry;
+static uint8_t parse_state;
+static bool parse_closing;
+static char parse_quote;
+/* Names longer than any in the table are kept truncated and match nothing */
+static char parse_element[16];
+static char parse_attribute[16];
+static char parse_value[32];
+static uint8_t parse_element_len;
+static uint8_t parse_attribute_len;
+static uint8_t parse_value_len;
+static uint16_t parse_found;
+
+static bool weather_parse_space(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+static void weather_parse_name(char *buf, uint8_t size, uint8_t *len, char c)
+{
+	if (*len < size - 1) {
+		buf[(*len)++] = c;
+		buf[*len] = '\0';
+	} else {
+		/* Too long for any field */
+		buf[0] = '\0';
+	}
+}
+
+/* hh:mm of yyyy-mm-ddThh:mm:ss, in minutes */
+static int32_t weather_parse_time(const char *value)
+{
+	const char *time = strchr(value, 'T');
+
+	if (!time || (strlen(time) < 6)) {
+		return 0;
+	}
+	return strtol(&time[1], NULL, 10) * 60 + strtol(&time[4], NULL, 10);
+}
+
+static void weather_parse_store(const weather_field_t *field)
+{
+	uint8_t *member = (uint8_t *)parse_entry + field->offset;
+	int32_t number;
+
+	if (field->type == WEATHER_FIELD_TEXT) {
+		strncpy((char *)member, parse_value, field->size - 1);
+		member[field->size - 1] = '\0';
+		return;
+	}
+	if (field->type == WEATHER_FIELD_FIXED) {
+		number = strfmt_parse_fixed(parse_value, field->arg);
+	} else {
+		number = weather_parse_time(parse_value);
+	}
+	if (field->size == sizeof(int8_t)) {
+		*(int8_t *)member = (int8_t)number;
+	} else if (field->size == sizeof(int16_t)) {
+		int16_t half = (int16_t)number;
+
+		memcpy(member, &half, sizeof(half));
+	} else {
+		memcpy(member, &number, sizeof(number));
+	}
+}
+
+/* An attribute value ended; store it if a field wants it */
+static void weather_parse_value(void)
+{
+	for (uint8_t i = 0; i < WEATHER_FIELD_COUNT; i++) {
+		const weather_field_t *field = &weather_fields[i];
+
+		/* The first occurrence counts */
+		if (!(parse_found & (1u << i)) && !strcmp(field->element, parse_element) &&
+				!strcmp(field->attribute, parse_attribute)) {
+			weather_parse_store(field);
+			parse_found |= 1u << i;
+			return;
+		}
+	}
+}
+
+void weather_parse_start(weather_cache_entry_t *entry)
+{
+	memset(entry, 0, sizeof(*entry));
+	parse_entry = entry;
+	parse_state = WEATHER_PARSE_TEXT;
+	parse_found = 0;
+}
+
+bool weather_parse_feed(const char *data, uint16_t len)
+{
+	for (uint16_t i = 0; i < len; i++) {
+		char c = data[i];
+
+		switch (parse_state) {
+		case WEATHER_PARSE_TEXT:
+			if (c == '<') {
+				parse_state = WEATHER_PARSE_ELEMENT;
+				parse_closing = false;
+				parse_element_len = 0;
+				parse_element[0] = '\0';
+			}
+			break;
+
+		case WEATHER_PARSE_ELEMENT:
+			if ((c == '/') && !parse_element_len) {
+				parse_closing = true;
+			} else if (c == '>') {
+				parse_state = WEATHER_PARSE_TEXT;
+				if (parse_closing && !strcmp(parse_element, WEATHER_PARSE_ROOT)) {
+					return true;
+				}
+			} else if (weather_parse_space(c) || (c == '/')) {
+				parse_state = WEATHER_PARSE_TAG;
+			} else {
+				weather_parse_name(parse_element, sizeof(parse_element), &parse_element_len, c);
+			}
+			break;
+
+		case WEATHER_PARSE_TAG:
+			if (c == '>') {
+				parse_state = WEATHER_PARSE_TEXT;
+			} else if (!weather_parse_space(c) && (c != '/')) {
+				parse_state = WEATHER_PARSE_ATTRIBUTE;
+				parse_attribute_len = 0;
+				weather_parse_name(parse_attribute, sizeof(parse_attribute), &parse_attribute_len, c);
+			}
+			break;
+
+		case WEATHER_PARSE_ATTRIBUTE:
+			if (c == '=') {
+				parse_state = WEATHER_PARSE_EQUALS;
+			} else if (c == '>') {
+				parse_state = WEATHER_PARSE_TEXT;
+			} else if (weather_parse_space(c)) {
+				parse_state = WEATHER_PARSE_TAG;
+			} else {
+				weather_parse_name(parse_attribute, sizeof(parse_attribute), &parse_attribute_len, c);
+			}
+			break;
+
+		case WEATHER_PARSE_EQUALS:
+			if ((c == '"') || (c == '\'')) {
+				parse_state = WEATHER_PARSE_VALUE;
+				parse_quote = c;
+				parse_value_len = 0;
+				parse_value[0] = '\0';
+			} else if (c == '>') {
+				parse_state = WEATHER_PARSE_TEXT;
+			} else if (!weather_parse_space(c)) {
+				parse_state = WEATHER_PARSE_TAG;
+			}
+			break;
+
+		case WEATHER_PARSE_VALUE:
+			if (c == parse_quote) {
+				parse_state = WEATHER_PARSE_TAG;
+				weather_parse_value();
+			} else if (parse_value_len < sizeof(parse_value) - 1) {
+				/* Longer values are truncated */
+				parse_value[parse_value_len++] = c;
+				parse_value[parse_value_len] = '\0';
+			}
+			break;
+
+		default:
+			parse_state = WEATHER_PARSE_TEXT;
+			break;
+		}
+	}
+	return false;
+}
+
+bool weather_parse_valid(void)
+{
+	for (uint8_t i = 0; i < WEATHER_FIELD_COUNT; i++) {
+		if (weather_fields[i].required && !(parse_found & (1u << i))) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+/**
+ * \file
+ *
+ * \brief Streaming parser of the weather server's XML answer.
+ *
+ * The fields taken from the answer are rows of a table in
+ * weather_parse.c, each naming an element, one of its attributes, how to
+ * convert the value and the weather_cache_entry_t member it goes to:
+ * \code
+ *   <city id="2988507" name="Paris">               city/name -> name
+ *   <temperature value="75.2" ... />               temperature/value -> temperature
+ *   <weather number="800" value="clear sky" ... /> weather/number -> condition
+ * \endcode
+ * Answers are fed as they arrive, in pieces of any size, and scanned
+ * once whatever the number of fields.
+ *
+ */
+
+#ifndef WEATHER_PARSE_H_INCLUDED
+#define WEATHER_PARSE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "weather_cache.h"
+
+/** @brief Start parsing an answer
+  *
+  * @param[out] entry	Cleared, then filled as fields are found
+  */
+void weather_parse_start(weather_cache_entry_t *entry);
+
+/** @brief Parse the next piece of the answer
+  *
+  * @param[in] data	Piece of the answer
+  * @param[in] len	Length of the piece
+  *
+  * @return true once the end of the weather element was seen
+  */
+bool weather_parse_feed(const char *data, uint16_t len);
+
+/** @brief The fields every answer must have were found */
+bool weather_parse_valid(void);
+
+#endif /* WEATHER_PARSE_H_INCLUDED */
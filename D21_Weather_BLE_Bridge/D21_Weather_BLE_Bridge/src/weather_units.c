@@ -0,0 +1,43 @@
+/**
+ * \file
+ *
+ * \brief Units weather is given to clients in.
+ *
+ */
+
+#include <string.h>
+#include "weather_cache.h"
+#include "weather_units.h"
+
+static const char *const weather_units_names[] = {
+	[WEATHER_UNITS_IMPERIAL] = "imperial",
+	[WEATHER_UNITS_METRIC] = "metric",
+};
+
+bool weather_units_parse(const char *name, uint16_t len, uint8_t *units)
+{
+	for (uint8_t i = 0; i < sizeof(weather_units_names) / sizeof(weather_units_names[0]); i++) {
+		if ((strlen(weather_units_names[i]) == len) && !memcmp(weather_units_names[i], name, len)) {
+			*units = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+int32_t weather_units_temperature(int32_t celsius, uint8_t units)
+{
+	int32_t offset = 32;
+	int32_t scaled;
+
+	if (units != WEATHER_UNITS_IMPERIAL) {
+		return celsius;
+	}
+	for (uint8_t i = 0; i < TEMPERATURE_DECIMALS; i++) {
+		offset *= 10;
+	}
+	/* F = C * 9 / 5 + 32, rounded half away from zero */
+	scaled = celsius * 9;
+	scaled = (scaled + ((scaled < 0) ? -2 : 2)) / 5;
+	return scaled + offset;
+}
@@ -0,0 +1,55 @@
+/**
+ * \file
+ *
+ * \brief Units weather is given to clients in.
+ *
+ * The weather server is asked for metric values only, and the cache keeps
+ * one canonical value per city: temperatures in degrees Celsius scaled by
+ * 10^TEMPERATURE_DECIMALS, wind speeds in m/s scaled by
+ * 10^WIND_SPEED_DECIMALS. Each client picks its units, and values are
+ * converted when its answer is formatted, so clients in different units
+ * share fetches and cache entries. The answer text only carries a
+ * temperature; wind speeds are published in m/s whatever the units.
+ *
+ * Units are named as by the weather server: \c metric or \c imperial.
+ * BLE clients write \c UNITS:<units> to the TX or RX characteristic, HTTP
+ * clients add \c &units=<units> to the query. Clients that don't choose
+ * get CONF_BRIDGE_DEFAULT_UNITS.
+ *
+ */
+
+#ifndef WEATHER_UNITS_H_INCLUDED
+#define WEATHER_UNITS_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+typedef enum
+{
+	/* Degrees Fahrenheit */
+	WEATHER_UNITS_IMPERIAL,
+	/* Degrees Celsius */
+	WEATHER_UNITS_METRIC
+}weather_units_t;
+
+/** @brief Look up units by name
+  *
+  * @param[in] name		Units name, not NUL terminated
+  * @param[in] len		Name length
+  * @param[out] units	Set to the units if the name is known
+  *
+  * @return false if the name is unknown
+  */
+bool weather_units_parse(const char *name, uint16_t len, uint8_t *units);
+
+/** @brief Temperature in the given units
+  *
+  * @param[in] celsius	Canonical temperature, scaled by 10^TEMPERATURE_DECIMALS
+  * @param[in] units	@ref weather_units_t
+  *
+  * @return the temperature, scaled by 10^TEMPERATURE_DECIMALS
+  */
+int32_t weather_units_temperature(int32_t celsius, uint8_t units);
+
+#endif /* WEATHER_UNITS_H_INCLUDED */
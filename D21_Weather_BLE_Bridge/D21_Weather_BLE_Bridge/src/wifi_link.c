@@ -0,0 +1,106 @@
+/**
+ * \file
+ *
+ * \brief Wi-Fi reconnect policy.
+ *
+ */
+
+#include <asf.h>
+#include "driver/include/m2m_types.h"
+#include "systime.h"
+#include "warm_state.h"
+#include "idle.h"
+#include "wifi_link.h"
+#include "trace.h"
+
+static wifi_link_connect_t wifi_link_connect;
+static wifi_link_stats_t wifi_link_stat;
+
+static bool wifi_link_connected;
+/* An attempt is waiting for its backoff to pass */
+static bool wifi_link_retry;
+static uint32_t wifi_link_retry_ms;
+/* Failed attempts since the link was lost */
+static uint8_t wifi_link_failures;
+static uint32_t wifi_link_down_ms;
+
+void wifi_link_start(wifi_link_connect_t connect)
+{
+	wifi_link_connect = connect;
+	wifi_link_connected = false;
+	wifi_link_failures = 0;
+	wifi_link_down_ms = systime_ms();
+	wifi_link_retry_ms = wifi_link_down_ms;
+	wifi_link_retry = true;
+	wifi_link_task();
+}
+
+void wifi_link_up(void)
+{
+	uint32_t outage = systime_ms() - wifi_link_down_ms;
+
+	wifi_link_connected = true;
+	wifi_link_retry = false;
+	wifi_link_stat.connects++;
+	wifi_link_stat.last_outage_ms = outage;
+	if (outage > wifi_link_stat.max_outage_ms) {
+		wifi_link_stat.max_outage_ms = outage;
+	}
+	wifi_link_stat.backoff_ms = 0;
+	TRACE_INFO("wifi up after %lu ms, %u failed attempts", outage, wifi_link_failures);
+}
+
+void wifi_link_down(void)
+{
+	uint32_t now = systime_ms();
+
+	if (wifi_link_connected) {
+		/* Link lost: retry the same channel right away */
+		wifi_link_connected = false;
+		wifi_link_failures = 0;
+		wifi_link_down_ms = now;
+		wifi_link_stat.backoff_ms = 0;
+	} else {
+		if (wifi_link_failures < UINT8_MAX) {
+			wifi_link_failures++;
+		}
+		if (wifi_link_stat.backoff_ms == 0) {
+			wifi_link_stat.backoff_ms = CONF_BRIDGE_WIFI_BACKOFF_MIN_MS;
+		} else if (wifi_link_stat.backoff_ms < CONF_BRIDGE_WIFI_BACKOFF_MAX_MS / 2) {
+			wifi_link_stat.backoff_ms *= 2;
+		} else {
+			wifi_link_stat.backoff_ms = CONF_BRIDGE_WIFI_BACKOFF_MAX_MS;
+		}
+	}
+
+	wifi_link_retry_ms = now + wifi_link_stat.backoff_ms;
+	wifi_link_retry = true;
+	TRACE_INFO("wifi down, retry %u in %lu ms", wifi_link_failures, wifi_link_stat.backoff_ms);
+}
+
+void wifi_link_task(void)
+{
+	uint8_t channel = warm_state_net()->channel;
+
+	if (!wifi_link_retry) {
+		return;
+	}
+	if ((int32_t)(systime_ms() - wifi_link_retry_ms) < 0) {
+		idle_wake_at(wifi_link_retry_ms);
+		return;
+	}
+	wifi_link_retry = false;
+
+	if ((channel == 0) || (wifi_link_failures >= CONF_BRIDGE_WIFI_CHANNEL_RETRIES)) {
+		channel = M2M_WIFI_CH_ALL;
+		wifi_link_stat.full_scans++;
+	}
+	wifi_link_stat.attempts++;
+	TRACE_DBG("wifi connect on channel %u", channel);
+	wifi_link_connect(channel);
+}
+
+const wifi_link_stats_t *wifi_link_stats(void)
+{
+	return &wifi_link_stat;
+}
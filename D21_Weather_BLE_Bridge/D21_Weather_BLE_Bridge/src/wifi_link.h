@@ -0,0 +1,56 @@
+/**
+ * \file
+ *
+ * \brief Wi-Fi reconnect policy.
+ *
+ * A lost link is first retried on the channel it was last seen on, which
+ * skips the scan of every channel. After CONF_BRIDGE_WIFI_CHANNEL_RETRIES
+ * failed attempts, or when no channel is known, every channel is scanned.
+ * Failed attempts back off exponentially between
+ * CONF_BRIDGE_WIFI_BACKOFF_MIN_MS and CONF_BRIDGE_WIFI_BACKOFF_MAX_MS.
+ *
+ */
+
+#ifndef WIFI_LINK_H_INCLUDED
+#define WIFI_LINK_H_INCLUDED
+
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** Start a connection attempt on a channel, or M2M_WIFI_CH_ALL to scan */
+typedef void (*wifi_link_connect_t)(uint8_t channel);
+
+typedef struct
+{
+	/* Connection attempts started */
+	uint32_t attempts;
+	/* Attempts that scanned every channel */
+	uint32_t full_scans;
+	/* Times the link came up */
+	uint32_t connects;
+	/* Time from link loss to link up, last and worst, in ms */
+	uint32_t last_outage_ms;
+	uint32_t max_outage_ms;
+	/* Backoff before the current retry, in ms */
+	uint32_t backoff_ms;
+}wifi_link_stats_t;
+
+/** @brief Start the first connection attempt
+  *
+  * @param[in] connect	Called for every attempt
+  */
+void wifi_link_start(wifi_link_connect_t connect);
+
+/** @brief Report M2M_WIFI_CONNECTED */
+void wifi_link_up(void);
+
+/** @brief Report M2M_WIFI_DISCONNECTED, for a lost link or a failed attempt */
+void wifi_link_down(void);
+
+/** @brief Start the next attempt once its backoff has passed. Call from the main loop. */
+void wifi_link_task(void);
+
+/** @brief Reconnect metrics */
+const wifi_link_stats_t *wifi_link_stats(void);
+
+#endif /* WIFI_LINK_H_INCLUDED */
@@ -0,0 +1,86 @@
+/**
+ * \file
+ *
+ * \brief WINC power-save policy.
+ *
+ */
+
+#include <asf.h>
+#include "driver/include/m2m_wifi.h"
+#include "systime.h"
+#include "req_queue.h"
+#include "idle.h"
+#include "wifi_power.h"
+#include "trace.h"
+
+/* Mode currently set on the WINC; starts as the driver default */
+static uint8_t wifi_power_mode = M2M_NO_PS;
+static uint8_t wifi_power_clients;
+static uint32_t wifi_power_active_ms;
+static bool wifi_power_wake_pending;
+static uint32_t wifi_power_wake_ms;
+
+void wifi_power_ble_connected(void)
+{
+	wifi_power_clients++;
+	wifi_power_activity();
+}
+
+void wifi_power_ble_disconnected(void)
+{
+	if (wifi_power_clients) {
+		wifi_power_clients--;
+	}
+	wifi_power_activity();
+}
+
+void wifi_power_activity(void)
+{
+	wifi_power_active_ms = systime_ms();
+}
+
+void wifi_power_schedule(uint32_t at_ms)
+{
+	uint32_t wake = at_ms - CONF_BRIDGE_PS_PREWAKE_MS;
+
+	if (!wifi_power_wake_pending || ((int32_t)(wake - wifi_power_wake_ms) < 0)) {
+		wifi_power_wake_ms = wake;
+		wifi_power_wake_pending = true;
+	}
+}
+
+void wifi_power_task(bool busy)
+{
+	uint32_t now = systime_ms();
+	uint8_t mode;
+
+	if (wifi_power_wake_pending && ((int32_t)(now - wifi_power_wake_ms) >= 0)) {
+		wifi_power_wake_pending = false;
+		wifi_power_activity();
+	}
+	if (busy || wifi_power_clients || req_queue_count()) {
+		wifi_power_activity();
+	}
+
+	mode = ((now - wifi_power_active_ms) < CONF_BRIDGE_PS_LINGER_MS) ? M2M_NO_PS : M2M_PS_DEEP_AUTOMATIC;
+	if (mode == M2M_NO_PS) {
+		idle_wake_at(wifi_power_active_ms + CONF_BRIDGE_PS_LINGER_MS);
+	}
+	if (wifi_power_wake_pending) {
+		idle_wake_at(wifi_power_wake_ms);
+	}
+	if (mode == wifi_power_mode) {
+		return;
+	}
+
+	if (mode == M2M_PS_DEEP_AUTOMATIC) {
+		tstrM2mLsnInt lsn = {.u16LsnInt = CONF_BRIDGE_PS_LISTEN_INTERVAL};
+
+		m2m_wifi_set_sleep_mode(M2M_PS_DEEP_AUTOMATIC, 0);
+		m2m_wifi_set_lsn_int(&lsn);
+	} else {
+		m2m_wifi_set_sleep_mode(M2M_NO_PS, 1);
+	}
+	wifi_power_mode = mode;
+	TRACE_DBG("wifi power save %d", mode);
+}
@@ -0,0 +1,42 @@
+/**
+ * \file
+ *
+ * \brief WINC power-save policy.
+ *
+ * With no BLE client connected and nothing to fetch, the WINC is put in
+ * M2M_PS_DEEP_AUTOMATIC and only wakes every CONF_BRIDGE_PS_LISTEN_INTERVAL
+ * beacons. A BLE connection, a write from a client, a queued request or a
+ * scheduled wake switches it to M2M_NO_PS at once; it goes back to deep
+ * power save CONF_BRIDGE_PS_LINGER_MS after the last of these.
+ *
+ */
+
+#ifndef WIFI_POWER_H_INCLUDED
+#define WIFI_POWER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_bridge.h"
+
+/** @brief A BLE client connected */
+void wifi_power_ble_connected(void);
+
+/** @brief A BLE client disconnected */
+void wifi_power_ble_disconnected(void);
+
+/** @brief A BLE client wrote something; stay in low-latency mode for a while */
+void wifi_power_activity(void);
+
+/** @brief Leave power save CONF_BRIDGE_PS_PREWAKE_MS before a planned fetch
+  *
+  * @param[in] at_ms	systime_ms() of the fetch; the earliest pending one is kept
+  */
+void wifi_power_schedule(uint32_t at_ms);
+
+/** @brief Apply the policy. Call from the main loop once the WINC driver is up.
+  *
+  * @param[in] busy	The uplink has work in flight
+  */
+void wifi_power_task(bool busy);
+
+#endif /* WIFI_POWER_H_INCLUDED */
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Decode binary trace frames emitted by src/trace.c.
+
+Usage: trace_decode.py <firmware.elf> [capture file | serial device]
+
+Format strings are read from the .trace_fmt section of the ELF image; a
+frame's id is the offset of its string in that section. Bytes outside
+frames (plain printf output) are passed through unchanged.
+"""
+
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+LEVELS = {1: "ERR", 2: "WRN", 3: "INF", 4: "DBG"}
+ARG_WORD, ARG_STR, ARG_FLOAT = 0, 1, 2
+SPEC = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l|z)?([diouxXcsfeEgGp%])")
+
+
+def load_section(path, name=b".trace_fmt"):
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1:
+        raise SystemExit("expected a 32-bit ELF image")
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def header(i):
+        return struct.unpack_from("<IIIIIIIIII", elf, shoff + i * shentsize)
+
+    strtab = header(shstrndx)
+    for i in range(shnum):
+        sh = header(i)
+        start = strtab[4] + sh[0]
+        if elf[start:start + len(name) + 1] == name + b"\0":
+            return elf[sh[4]:sh[4] + sh[5]]
+    raise SystemExit("no %s section in %s" % (name.decode(), path))
+
+
+def format_string(table, ident):
+    end = table.index(b"\0", ident)
+    site, _, fmt = table[ident:end].decode("ascii", "replace").partition("\x1f")
+    return site, fmt
+
+
+def render(fmt, values):
+    it = iter(values)
+
+    def convert(m):
+        conv = m.group(1)
+        if conv == "%":
+            return "%"
+        val = next(it, None)
+        if val is None:
+            return "<?>"
+        spec = re.sub(r"(hh|h|ll|l|z)", "", m.group(0))
+        if conv in "di" and isinstance(val, int):
+            val = val - (1 << 32) if val & 0x80000000 else val
+        elif conv == "p":
+            spec, val = "%#x", val
+        elif conv == "u":
+            spec = spec[:-1] + "d"
+        elif conv == "s" and not isinstance(val, str):
+            val = "0x%08x" % val
+        try:
+            return spec % val
+        except (TypeError, ValueError):
+            return str(val)
+
+    return SPEC.sub(convert, fmt).rstrip("\r\n")
+
+
+def decode_args(payload, argc, types):
+    values, pos = [], 0
+    for _ in range(argc):
+        kind = types & 0x3
+        types >>= 2
+        if kind == ARG_STR:
+            n = payload[pos]
+            values.append(payload[pos + 1:pos + 1 + n].decode("ascii", "replace"))
+            pos += n + 1
+        elif kind == ARG_FLOAT:
+            values.append(struct.unpack_from("<f", payload, pos)[0])
+            pos += 4
+        else:
+            values.append(struct.unpack_from("<I", payload, pos)[0])
+            pos += 4
+    return values
+
+
+def decode(stream, table, out):
+    buf = bytearray()
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            break
+        buf += chunk
+        while buf:
+            if buf[0] != SYNC:
+                out.write(chr(buf.pop(0)))
+                continue
+            if len(buf) < 2 or len(buf) < buf[1] + 2:
+                break
+            frame = bytes(buf[2:buf[1] + 2])
+            del buf[:buf[1] + 2]
+            ident, info, types = struct.unpack_from("<HBH", frame, 0)
+            try:
+                site, fmt = format_string(table, ident)
+                text = render(fmt, decode_args(frame[5:], info & 0x0F, types))
+            except (ValueError, IndexError, struct.error):
+                site, text = "?", "undecodable frame id 0x%04x" % ident
+            out.write("[%s] %s  (%s)\n" % (LEVELS.get(info >> 4, "?"), text, site))
+        out.flush()
+
+
+def main():
+    if len(sys.argv) < 2:
+        raise SystemExit(__doc__)
+    table = load_section(sys.argv[1])
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "rb", buffering=0) as stream:
+            decode(stream, table, sys.stdout)
+    else:
+        decode(sys.stdin.buffer, table, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()